@@ -9,6 +9,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glib.h>
 
@@ -27,29 +28,60 @@
 #define CHECK_VOID_RET() \
   do { if (!db.initialized) { return; } } while (0)
 
-/* Unprovisioned and backlog devices use UUID as key */
-#define KEY_FROM_UUID(uuid) ((gpointer)(uuid))
-#define UNPROV_DEV_KEY(n) (KEY_FROM_UUID((n)->uuid))
-#define BACKLOG_DEV_KEY(n) (KEY_FROM_UUID((n)->uuid))
-
-/* Provisioned nodes use unicast address as key */
-#define KEY_FROM_ADDR(addr) ((gpointer)(&addr))
-#define NODE_KEY(n) (KEY_FROM_ADDR(n->addr))
 #define TMPL_KEY(refid) ((gpointer)(&(refid)))
 
-/* Get the tree by address and template ID fields */
-#define __HTB(addr, tmpl)                       \
-  ((addr) ? db.devdb.nodes                      \
-   : ((tmpl) && *(tmpl)) ? db.devdb.unprov_devs \
-   : db.devdb.backlog)
+/* Unicast addresses are 15 bits, 0 is unassigned */
+#define NODE_SLOTS  0x8000
+#define VALID_NODE_ADDR(addr) ((addr) && (addr) < NODE_SLOTS)
+#define NODE_IDX_INIT_CAP 64
 
-#define G_KEY(n) ((n)->addr == 0 ? UNPROV_DEV_KEY((n)) : NODE_KEY((n)))
-#define G_HTB(n) (__HTB(n->addr, n->tmpl))
+#define UUIDTAB_INIT_CAP 64
+/* Grow when 3/4 of the slots are in use or deleted */
+#define UUIDTAB_FULL(t) ((t)->used * 4 >= (t)->cap * 3)
 
 /* Static Variables *************************************************** */
 static cfgdb_t db = { 0 };
+/* Marks a deleted slot in the uuid tables */
+static node_t uuid_tomb;
 
 /* Static Functions Declaractions ************************************* */
+static inline void __u16list_free(uint16list_t **l)
+{
+  if (*l) {
+    SAFE_FREE((*l)->data);
+    SAFE_FREE(*l);
+  }
+}
+
+static void __config_free(mesh_config_t *c)
+{
+  SAFE_FREE(c->ttl);
+  SAFE_FREE(c->snb);
+  SAFE_FREE(c->net_txp);
+  SAFE_FREE(c->features.relay_txp);
+  SAFE_FREE(c->pub);
+  __u16list_free(&c->bindings);
+  __u16list_free(&c->sublist);
+  SAFE_FREE(c->product);
+}
+
+static void __config_copy(mesh_config_t *dst, const mesh_config_t *src)
+{
+  memset(dst, 0, sizeof(mesh_config_t));
+  dst->features = src->features;
+  dst->features.relay_txp = NULL;
+  alloc_copy((uint8_t **)&dst->features.relay_txp,
+             src->features.relay_txp,
+             sizeof(txparam_t));
+  alloc_copy(&dst->ttl, src->ttl, sizeof(uint8_t));
+  alloc_copy(&dst->snb, src->snb, sizeof(uint8_t));
+  alloc_copy((uint8_t **)&dst->net_txp, src->net_txp, sizeof(txparam_t));
+  alloc_copy((uint8_t **)&dst->pub, src->pub, sizeof(publication_t));
+  alloc_copy_u16list(&dst->bindings, src->bindings);
+  alloc_copy_u16list(&dst->sublist, src->sublist);
+  alloc_copy((uint8_t **)&dst->product, src->product, sizeof(product_t));
+}
+
 static void node_free(void *p)
 {
   if (!p) {
@@ -57,13 +89,8 @@ static void node_free(void *p)
   }
   node_t *n = (node_t *)p;
   SAFE_FREE(n->tmpl);
-  SAFE_FREE(n->config.ttl);
-  SAFE_FREE(n->config.snb);
-  SAFE_FREE(n->config.net_txp);
-  SAFE_FREE(n->config.features.relay_txp);
-  SAFE_FREE(n->config.pub);
-  SAFE_FREE(n->config.bindings);
-  SAFE_FREE(n->config.sublist);
+  __config_free(&n->config);
+  cfgdb_node_applied_clr(n);
   SAFE_FREE(n);
 }
 
@@ -80,6 +107,7 @@ static void tmpl_free(void *p)
   SAFE_FREE(t->pub);
   SAFE_FREE(t->bindings);
   SAFE_FREE(t->sublist);
+  SAFE_FREE(t->product);
   SAFE_FREE(t);
 }
 
@@ -89,9 +117,227 @@ static gint u16_comp(gconstpointer a, gconstpointer b, gpointer user_data)
           : *(uint16_t *)a > *(uint16_t *)b ? 1 : -1);
 }
 
-static gint uuid_comp(gconstpointer a, gconstpointer b, gpointer user_data)
+/*
+ * Provisioned nodes table
+ */
+static void __ntab_init(nodetab_t *t)
+{
+  t->slots = calloc(NODE_SLOTS, sizeof(node_t *));
+  t->cap = NODE_IDX_INIT_CAP;
+  t->idx = malloc(t->cap * sizeof(uint16_t));
+  t->num = 0;
+}
+
+static void __ntab_deinit(nodetab_t *t)
+{
+  if (t->slots) {
+    for (int i = 0; i < t->num; i++) {
+      node_free(t->slots[t->idx[i]]);
+    }
+  }
+  SAFE_FREE(t->slots);
+  SAFE_FREE(t->idx);
+  t->num = 0;
+  t->cap = 0;
+}
+
+/* Position of {addr} in the index, or where it should be inserted */
+static int __ntab_pos(const nodetab_t *t, uint16_t addr)
+{
+  int lo = 0, hi = t->num;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (t->idx[mid] < addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static inline node_t *__ntab_get(const nodetab_t *t, uint16_t addr)
+{
+  return VALID_NODE_ADDR(addr) ? t->slots[addr] : NULL;
+}
+
+static void __ntab_put(nodetab_t *t, node_t *n)
+{
+  int pos;
+
+  if (t->slots[n->addr]) {
+    t->slots[n->addr] = n;
+    return;
+  }
+  if (t->num == t->cap) {
+    t->cap *= 2;
+    t->idx = realloc(t->idx, t->cap * sizeof(uint16_t));
+  }
+  pos = __ntab_pos(t, n->addr);
+  memmove(t->idx + pos + 1, t->idx + pos, (t->num - pos) * sizeof(uint16_t));
+  t->idx[pos] = n->addr;
+  t->num++;
+  t->slots[n->addr] = n;
+}
+
+static node_t *__ntab_del(nodetab_t *t, uint16_t addr)
+{
+  node_t *n = __ntab_get(t, addr);
+  int pos;
+
+  if (!n) {
+    return NULL;
+  }
+  pos = __ntab_pos(t, addr);
+  memmove(t->idx + pos, t->idx + pos + 1, (t->num - pos - 1) * sizeof(uint16_t));
+  t->num--;
+  t->slots[addr] = NULL;
+  return n;
+}
+
+static void __ntab_foreach(const nodetab_t *t, GTraverseFunc func, gpointer data)
+{
+  node_t *n;
+
+  for (int i = 0; i < t->num; i++) {
+    n = t->slots[t->idx[i]];
+    if (func(&n->addr, n, data)) {
+      break;
+    }
+  }
+}
+
+/*
+ * Unprovisioned devices and backlog tables
+ */
+static inline uint32_t __uuid_hash(const uint8_t *uuid)
+{
+  /* FNV-1a */
+  uint32_t h = 2166136261u;
+
+  for (int i = 0; i < 16; i++) {
+    h = (h ^ uuid[i]) * 16777619u;
+  }
+  return h;
+}
+
+static void __utab_init(uuidtab_t *t, int cap)
+{
+  t->slots = calloc(cap, sizeof(uuidslot_t));
+  t->cap = cap;
+  t->num = 0;
+  t->used = 0;
+}
+
+static void __utab_deinit(uuidtab_t *t)
+{
+  for (int i = 0; i < t->cap; i++) {
+    if (t->slots[i].n && t->slots[i].n != &uuid_tomb) {
+      node_free(t->slots[i].n);
+    }
+  }
+  SAFE_FREE(t->slots);
+  t->cap = 0;
+  t->num = 0;
+  t->used = 0;
+}
+
+/* Slot holding {uuid}, or -1 if not found */
+static int __utab_find(const uuidtab_t *t, const uint8_t *uuid, uint32_t h)
+{
+  int mask = t->cap - 1;
+  const uuidslot_t *s;
+
+  for (int i = h & mask;; i = (i + 1) & mask) {
+    s = &t->slots[i];
+    if (!s->n) {
+      return -1;
+    }
+    if (s->n != &uuid_tomb && s->hash == h && !memcmp(s->n->uuid, uuid, 16)) {
+      return i;
+    }
+  }
+}
+
+static inline node_t *__utab_get(const uuidtab_t *t, const uint8_t *uuid)
 {
-  return memcmp(a, b, 16);
+  int i = __utab_find(t, uuid, __uuid_hash(uuid));
+  return i < 0 ? NULL : t->slots[i].n;
+}
+
+static void __utab_insert(uuidtab_t *t, uint32_t h, node_t *n)
+{
+  int mask = t->cap - 1;
+  int i;
+
+  for (i = h & mask; t->slots[i].n && t->slots[i].n != &uuid_tomb;
+       i = (i + 1) & mask) ;
+  if (!t->slots[i].n) {
+    t->used++;
+  }
+  t->slots[i].hash = h;
+  t->slots[i].n = n;
+  t->num++;
+}
+
+static void __utab_rehash(uuidtab_t *t)
+{
+  uuidtab_t old = *t;
+  int cap = old.cap;
+
+  /* Only grow if the deleted slots are not the major part */
+  if (old.num * 2 >= old.cap) {
+    cap *= 2;
+  }
+  __utab_init(t, cap);
+  for (int i = 0; i < old.cap; i++) {
+    if (old.slots[i].n && old.slots[i].n != &uuid_tomb) {
+      __utab_insert(t, old.slots[i].hash, old.slots[i].n);
+    }
+  }
+  free(old.slots);
+}
+
+static void __utab_put(uuidtab_t *t, node_t *n)
+{
+  uint32_t h = __uuid_hash(n->uuid);
+  int i = __utab_find(t, n->uuid, h);
+
+  if (i >= 0) {
+    t->slots[i].n = n;
+    return;
+  }
+  __utab_insert(t, h, n);
+  if (UUIDTAB_FULL(t)) {
+    __utab_rehash(t);
+  }
+}
+
+static node_t *__utab_del(uuidtab_t *t, const uint8_t *uuid)
+{
+  int i = __utab_find(t, uuid, __uuid_hash(uuid));
+  node_t *n;
+
+  if (i < 0) {
+    return NULL;
+  }
+  n = t->slots[i].n;
+  t->slots[i].n = &uuid_tomb;
+  t->num--;
+  return n;
+}
+
+static void __utab_foreach(const uuidtab_t *t, GTraverseFunc func, gpointer data)
+{
+  node_t *n;
+
+  for (int i = 0; i < t->cap; i++) {
+    n = t->slots[i].n;
+    if (n && n != &uuid_tomb && func(n->uuid, n, data)) {
+      break;
+    }
+  }
 }
 
 err_t cfgdb_init(void)
@@ -105,10 +351,10 @@ err_t cfgdb_init(void)
     err_exit_en(ret, "pthread_rwlock_init");
   }
   /* Initialize the device database */
-  db.devdb.unprov_devs = g_tree_new_full(uuid_comp, NULL, NULL, node_free);
-  db.devdb.nodes = g_tree_new_full(u16_comp, NULL, NULL, node_free);
+  __utab_init(&db.devdb.unprov_devs, UUIDTAB_INIT_CAP);
+  __ntab_init(&db.devdb.nodes);
   db.devdb.templates = g_tree_new_full(u16_comp, NULL, NULL, tmpl_free);
-  db.devdb.backlog = g_tree_new_full(uuid_comp, NULL, NULL, node_free);
+  __utab_init(&db.devdb.backlog, UUIDTAB_INIT_CAP);
   db.initialized = 1;
   return ec_success;
 }
@@ -132,18 +378,9 @@ void cfgdb_deinit(void)
     free(db.self.subnets);
     db.self.subnets = NULL;
   }
-  if (db.devdb.backlog) {
-    g_tree_destroy(db.devdb.backlog);
-    db.devdb.backlog = NULL;
-  }
-  if (db.devdb.unprov_devs) {
-    g_tree_destroy(db.devdb.unprov_devs);
-    db.devdb.unprov_devs = NULL;
-  }
-  if (db.devdb.nodes) {
-    g_tree_destroy(db.devdb.nodes);
-    db.devdb.nodes = NULL;
-  }
+  __utab_deinit(&db.devdb.backlog);
+  __utab_deinit(&db.devdb.unprov_devs);
+  __ntab_deinit(&db.devdb.nodes);
   if (db.devdb.templates) {
     g_tree_destroy(db.devdb.templates);
     db.devdb.templates = NULL;
@@ -165,13 +402,13 @@ int cfgdb_get_devnum(int which)
       ret = g_tree_nnodes(db.devdb.templates);
       break;
     case upl_em:
-      ret = g_tree_nnodes(db.devdb.unprov_devs);
+      ret = db.devdb.unprov_devs.num;
       break;
     case nodes_em:
-      ret = g_tree_nnodes(db.devdb.nodes);
+      ret = db.devdb.nodes.num;
       break;
     case backlog_em:
-      ret = g_tree_nnodes(db.devdb.backlog);
+      ret = db.devdb.backlog.num;
       break;
     default:
       ret = 0;
@@ -183,7 +420,7 @@ int cfgdb_get_devnum(int which)
 node_t *cfgdb_node_get(uint16_t addr)
 {
   CHECK_NULL_RET();
-  return (node_t *)g_tree_lookup(db.devdb.nodes, KEY_FROM_ADDR(addr));
+  return __ntab_get(&db.devdb.nodes, addr);
 }
 
 node_t *cfgdb_unprov_dev_get(const uint8_t *uuid)
@@ -192,7 +429,7 @@ node_t *cfgdb_unprov_dev_get(const uint8_t *uuid)
   if (!uuid) {
     return NULL;
   }
-  return (node_t *)g_tree_lookup(db.devdb.unprov_devs, KEY_FROM_UUID(uuid));
+  return __utab_get(&db.devdb.unprov_devs, uuid);
 }
 
 node_t *cfgdb_backlog_get(const uint8_t *uuid)
@@ -201,7 +438,7 @@ node_t *cfgdb_backlog_get(const uint8_t *uuid)
   if (!uuid) {
     return NULL;
   }
-  return (node_t *)g_tree_lookup(db.devdb.backlog, KEY_FROM_UUID(uuid));
+  return __utab_get(&db.devdb.backlog, uuid);
 }
 
 tmpl_t *cfgdb_tmpl_get(uint16_t refid)
@@ -244,80 +481,123 @@ err_t cfgdb_tmpl_add(tmpl_t *n)
   return ec_success;
 }
 
-static err_t __cfgdb_remove(node_t *n, GTree *tree, bool destory)
+static err_t __uuid_remove(node_t *n, uuidtab_t *t, bool destory)
 {
   CHECK_STATE(ec_state);
-  if (!n || !tree) {
+  if (!n) {
     return err(ec_param_invalid);
   }
   pthread_rwlock_wrlock(&db.lock);
+  n = __utab_del(t, n->uuid);
+  pthread_rwlock_unlock(&db.lock);
   if (destory) {
-    g_tree_remove(G_HTB(n), G_KEY(n));
-  } else {
-    g_tree_steal(G_HTB(n), G_KEY(n));
+    node_free(n);
   }
-  pthread_rwlock_unlock(&db.lock);
   return ec_success;
 }
 
-static err_t __cfgdb_add(node_t *n, GTree *tree)
+static err_t __uuid_add(node_t *n, uuidtab_t *t)
 {
-  err_t e;
   node_t *node;
   CHECK_STATE(ec_state);
-  if (!n || !tree) {
+  if (!n) {
     return err(ec_param_invalid);
   }
-  /* Check if it's already in? */
-  pthread_rwlock_rdlock(&db.lock);
-  node = g_tree_lookup(tree, G_KEY(n));
+  pthread_rwlock_wrlock(&db.lock);
+  node = __utab_get(t, n->uuid);
+  if (node != n) {
+    /* A different node with the same UUID is replaced and freed */
+    __utab_put(t, n);
+  }
   pthread_rwlock_unlock(&db.lock);
   if (node && node != n) {
-    /* key n->addr already has a value in tree and the value doesn't equal
-     * to n, need to remove and free it first, then add */
-    if (ec_success != (e = __cfgdb_remove(node, tree, 1))) {
-      return e;
-    }
-  } else if (n == node) {
-    return ec_success;
+    node_free(node);
   }
-
-  pthread_rwlock_wrlock(&db.lock);
-  g_tree_insert(tree, G_KEY(n), n);
-  pthread_rwlock_unlock(&db.lock);
-
-  /* TODO: Also update the lists */
   return ec_success;
 }
 
 err_t cfgdb_backlog_add(node_t *n)
 {
-  return __cfgdb_add(n, db.devdb.backlog);
+  return __uuid_add(n, &db.devdb.backlog);
 }
 
 err_t cfgdb_unpl_add(node_t *n)
 {
-  return __cfgdb_add(n, db.devdb.unprov_devs);
+  return __uuid_add(n, &db.devdb.unprov_devs);
 }
 
 err_t cfgdb_nodes_add(node_t *n)
 {
-  return __cfgdb_add(n, db.devdb.nodes);
+  node_t *node;
+  CHECK_STATE(ec_state);
+  if (!n || !VALID_NODE_ADDR(n->addr)) {
+    return err(ec_param_invalid);
+  }
+  pthread_rwlock_wrlock(&db.lock);
+  node = __ntab_get(&db.devdb.nodes, n->addr);
+  if (node != n) {
+    __ntab_put(&db.devdb.nodes, n);
+  }
+  pthread_rwlock_unlock(&db.lock);
+  if (node && node != n) {
+    node_free(node);
+  }
+  return ec_success;
 }
 
 err_t cfgdb_backlog_remove(node_t *n, bool destory)
 {
-  return __cfgdb_remove(n, db.devdb.backlog, destory);
+  return __uuid_remove(n, &db.devdb.backlog, destory);
 }
 
 err_t cfgdb_unpl_remove(node_t *n, bool destory)
 {
-  return __cfgdb_remove(n, db.devdb.unprov_devs, destory);
+  return __uuid_remove(n, &db.devdb.unprov_devs, destory);
 }
 
 err_t cfgdb_nodes_remove(node_t *n, bool destory)
 {
-  return __cfgdb_remove(n, db.devdb.nodes, destory);
+  CHECK_STATE(ec_state);
+  if (!n) {
+    return err(ec_param_invalid);
+  }
+  pthread_rwlock_wrlock(&db.lock);
+  n = __ntab_del(&db.devdb.nodes, n->addr);
+  pthread_rwlock_unlock(&db.lock);
+  if (destory) {
+    node_free(n);
+  }
+  return ec_success;
+}
+
+void cfgdb_delta_free(node_t *n)
+{
+  if (n->delta) {
+    __u16list_free(&n->delta->sub_add);
+    __u16list_free(&n->delta->sub_rm);
+    SAFE_FREE(n->delta);
+  }
+}
+
+void cfgdb_node_applied_set(node_t *n)
+{
+  cfgdb_delta_free(n);
+  if (!n->applied) {
+    n->applied = malloc(sizeof(mesh_config_t));
+    ASSERT(n->applied);
+  } else {
+    __config_free(n->applied);
+  }
+  __config_copy(n->applied, &n->config);
+}
+
+void cfgdb_node_applied_clr(node_t *n)
+{
+  cfgdb_delta_free(n);
+  if (n->applied) {
+    __config_free(n->applied);
+    SAFE_FREE(n->applied);
+  }
 }
 
 provcfg_t *get_provcfg(void)
@@ -329,8 +609,8 @@ void cfgdb_remove_all_upl(void)
 {
   CHECK_VOID_RET();
   pthread_rwlock_wrlock(&db.lock);
-  g_tree_destroy(db.devdb.unprov_devs);
-  db.devdb.unprov_devs = g_tree_new_full(uuid_comp, NULL, NULL, node_free);
+  __utab_deinit(&db.devdb.unprov_devs);
+  __utab_init(&db.devdb.unprov_devs, UUIDTAB_INIT_CAP);
   pthread_rwlock_unlock(&db.lock);
 }
 
@@ -338,8 +618,8 @@ void cfgdb_remove_all_nodes(void)
 {
   CHECK_VOID_RET();
   pthread_rwlock_wrlock(&db.lock);
-  g_tree_destroy(db.devdb.nodes);
-  db.devdb.nodes = g_tree_new_full(u16_comp, NULL, NULL, node_free);
+  __ntab_deinit(&db.devdb.nodes);
+  __ntab_init(&db.devdb.nodes);
   pthread_rwlock_unlock(&db.lock);
 }
 
@@ -347,44 +627,21 @@ void set_provcfg(const provcfg_t *src)
 {
 }
 
-static int offs = 0;
-static uint8_t kind = 0;
-gboolean copy_addr_to_user(gpointer key,
-                           gpointer value,
-                           gpointer ud)
-{
-  uint16_t addr = *(uint16_t *)key;
-  ((uint16_t *)ud)[offs++] = addr;
-  return FALSE;
-}
-
-gboolean copy_light_addr_to_user(gpointer key,
-                                 gpointer value,
-                                 gpointer ud)
-{
-  node_t *n = (node_t *)value;
-  if (IS_BIT_SET(n->models.func, kind)) {
-    ((uint16_t *)ud)[offs++] = n->addr;
-  }
-  return FALSE;
-}
-
 uint16list_t *get_node_addrs(void)
 {
   uint16list_t *addr;
-  int num;
+  nodetab_t *t = &db.devdb.nodes;
 
-  num = cfgdb_get_devnum(nodes_em);
-  if (!num) {
+  CHECK_NULL_RET();
+  pthread_rwlock_rdlock(&db.lock);
+  if (!t->num) {
+    pthread_rwlock_unlock(&db.lock);
     return NULL;
   }
   addr = calloc(1, sizeof(uint16list_t));
-  addr->data = calloc(num, sizeof(uint16_t));
-
-  addr->len = num;
-  offs = 0;
-  pthread_rwlock_rdlock(&db.lock);
-  g_tree_foreach(db.devdb.nodes, copy_addr_to_user, addr->data);
+  addr->data = malloc(t->num * sizeof(uint16_t));
+  memcpy(addr->data, t->idx, t->num * sizeof(uint16_t));
+  addr->len = t->num;
   pthread_rwlock_unlock(&db.lock);
   return addr;
 }
@@ -392,29 +649,40 @@ uint16list_t *get_node_addrs(void)
 uint16list_t *get_lights_addrs(uint8_t func)
 {
   uint16list_t *addr;
-  int num;
+  nodetab_t *t = &db.devdb.nodes;
+  int offs = 0;
+
   if (!func) {
     return NULL;
   }
-
-  num = cfgdb_get_devnum(nodes_em);
-  if (!num) {
+  CHECK_NULL_RET();
+  pthread_rwlock_rdlock(&db.lock);
+  if (!t->num) {
+    pthread_rwlock_unlock(&db.lock);
     return NULL;
   }
   addr = calloc(1, sizeof(uint16list_t));
-  addr->data = calloc(num, sizeof(uint16_t));
-
-  offs = 0;
-  kind = func;
-  pthread_rwlock_rdlock(&db.lock);
-  g_tree_foreach(db.devdb.nodes, copy_light_addr_to_user, addr->data);
+  addr->data = calloc(t->num, sizeof(uint16_t));
+  for (int i = 0; i < t->num; i++) {
+    if (IS_BIT_SET(t->slots[t->idx[i]]->models.func, func)) {
+      addr->data[offs++] = t->idx[i];
+    }
+  }
   pthread_rwlock_unlock(&db.lock);
   addr->len = offs;
   return addr;
 }
 
+void cfgdb_nodes_foreach(GTraverseFunc func, gpointer data)
+{
+  CHECK_VOID_RET();
+  pthread_rwlock_rdlock(&db.lock);
+  __ntab_foreach(&db.devdb.nodes, func, data);
+  pthread_rwlock_unlock(&db.lock);
+}
+
 void cfg_load_mnglists(GTraverseFunc func)
 {
-  g_tree_foreach(db.devdb.unprov_devs, func, NULL);
-  g_tree_foreach(db.devdb.nodes, func, NULL);
+  __utab_foreach(&db.devdb.unprov_devs, func, NULL);
+  __ntab_foreach(&db.devdb.nodes, func, NULL);
 }
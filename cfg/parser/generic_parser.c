@@ -12,6 +12,7 @@
 
 #include "projconfig.h"
 #include "json_parser.h"
+#include "json_journal.h"
 #include "generic_parser.h"
 #include "cfg.h"
 #include "mng.h"
@@ -191,6 +192,7 @@ err_t nodes_rm(uint16_t addr)
   n = cfgdb_node_get(addr);
   cfgdb_nodes_remove(n, 0);
   n->addr = 0;
+  cfgdb_node_applied_clr(n);
   cfgdb_unpl_add(n);
   e = gp.write(NW_NODES_CFG_FILE, wrt_node_addr, n->uuid, (void *)&n->addr);
   elog(e);
@@ -205,6 +207,7 @@ err_t nodes_bl(uint16_t addr)
   cfgdb_nodes_remove(n, 0);
   n->addr = 0;
   n->done = 0;
+  cfgdb_node_applied_clr(n);
   cfgdb_unpl_add(n);
   e = gp.write(NW_NODES_CFG_FILE, wrt_done, (void *)n->uuid, (void *)&n->done);
   elog(e);
@@ -272,3 +275,16 @@ err_t nodes_rmblclr(void)
   elog(e);
   return e;
 }
+
+uint64_t nodes_sync_due(void)
+{
+  return json_journal_sync_due();
+}
+
+err_t nodes_sync(void)
+{
+  err_t e;
+  e = json_journal_sync();
+  elog(e);
+  return e;
+}
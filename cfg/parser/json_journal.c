@@ -0,0 +1,216 @@
+/*************************************************************************
+    > File Name: json_journal.c
+    > Author: Kevin
+    > Created Time: 2020-02-17
+    > Description: Write-ahead journal of the node field mutations
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "projconfig.h"
+#include "json_journal.h"
+#include "logging.h"
+#include "utils.h"
+
+/* Defines  *********************************************************** */
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_MAGIC 0xA5
+
+/*
+ * All bytes so no padding, the record is valid only if all the bytes sum up to
+ * 0
+ */
+typedef struct {
+  uint8_t magic;
+  uint8_t wrtype;
+  uint8_t uuid[16];
+  uint8_t val[4];
+  uint8_t sum;
+}jrec_t;
+
+/* Global Variables *************************************************** */
+
+/* Static Variables *************************************************** */
+static struct {
+  int fd;
+  char *path;
+  int records;
+  /* Records not fsync'd yet and when the first of them is appended */
+  int pending;
+  time_t first_pending;
+} jnl = { -1, NULL, 0, 0, 0 };
+
+/* Static Functions Declaractions ************************************* */
+static uint8_t __sum(const jrec_t *r)
+{
+  uint8_t s = 0;
+  const uint8_t *p = (const uint8_t *)r;
+
+  for (int i = 0; i < sizeof(jrec_t); i++) {
+    s += p[i];
+  }
+  return s;
+}
+
+err_t json_journal_open(const char *cfgpath)
+{
+  char *path;
+  off_t len;
+
+  if (!cfgpath) {
+    return err(ec_param_null);
+  }
+  path = malloc(strlen(cfgpath) + sizeof(JOURNAL_SUFFIX));
+  strcpy(path, cfgpath);
+  strcat(path, JOURNAL_SUFFIX);
+
+  if (jnl.fd >= 0 && !strcmp(path, jnl.path)) {
+    free(path);
+    return ec_success;
+  }
+  json_journal_close();
+
+  jnl.fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (jnl.fd < 0) {
+    LOGE("Open journal %s error[%s]\n", path, strerror(errno));
+    free(path);
+    return err(ec_file_ope);
+  }
+  jnl.path = path;
+  len = lseek(jnl.fd, 0, SEEK_END);
+  jnl.records = len > 0 ? len / sizeof(jrec_t) : 0;
+  jnl.pending = 0;
+  return ec_success;
+}
+
+void json_journal_close(void)
+{
+  if (jnl.fd >= 0) {
+    json_journal_sync();
+    close(jnl.fd);
+    jnl.fd = -1;
+  }
+  SAFE_FREE(jnl.path);
+  jnl.records = 0;
+  jnl.pending = 0;
+}
+
+err_t json_journal_sync(void)
+{
+  if (jnl.fd < 0) {
+    return err(ec_state);
+  }
+  if (!jnl.pending) {
+    return ec_success;
+  }
+  if (-1 == fsync(jnl.fd)) {
+    LOGE("Sync journal error[%s]\n", strerror(errno));
+    return err(ec_errno);
+  }
+  jnl.pending = 0;
+  return ec_success;
+}
+
+err_t json_journal_append(int wrtype,
+                          const uint8_t *uuid,
+                          uint32_t val)
+{
+  jrec_t r;
+
+  if (jnl.fd < 0) {
+    return err(ec_state);
+  }
+  r.magic = JOURNAL_MAGIC;
+  r.wrtype = (uint8_t)wrtype;
+  memcpy(r.uuid, uuid, 16);
+  r.val[0] = (uint8_t)val;
+  r.val[1] = (uint8_t)(val >> 8);
+  r.val[2] = (uint8_t)(val >> 16);
+  r.val[3] = (uint8_t)(val >> 24);
+  r.sum = 0;
+  r.sum = (uint8_t)(0 - __sum(&r));
+
+  /* O_APPEND, a record is either in the file or not after the write */
+  if (sizeof(jrec_t) != write(jnl.fd, &r, sizeof(jrec_t))) {
+    LOGE("Write journal error[%s]\n", strerror(errno));
+    return err(ec_errno);
+  }
+  jnl.records++;
+  if (!jnl.pending++) {
+    jnl.first_pending = time(NULL);
+  }
+
+  /* Group commit */
+  if (jnl.pending >= JOURNAL_GROUP_COMMIT_NUM
+      || time(NULL) - jnl.first_pending >= JOURNAL_GROUP_COMMIT_TIMEOUT) {
+    return json_journal_sync();
+  }
+  return ec_success;
+}
+
+uint64_t json_journal_sync_due(void)
+{
+  if (jnl.fd < 0 || !jnl.pending) {
+    return 0;
+  }
+  return (uint64_t)(jnl.first_pending + JOURNAL_GROUP_COMMIT_TIMEOUT) * 1000;
+}
+
+int json_journal_replay(journal_apply_t apply)
+{
+  jrec_t r;
+  int n = 0;
+  err_t e;
+
+  if (jnl.fd < 0 || !apply) {
+    return 0;
+  }
+  if (-1 == lseek(jnl.fd, 0, SEEK_SET)) {
+    return 0;
+  }
+  while (sizeof(jrec_t) == read(jnl.fd, &r, sizeof(jrec_t))) {
+    if (r.magic != JOURNAL_MAGIC || __sum(&r)) {
+      LOGW("Corrupted journal record dropped, stop replaying\n");
+      break;
+    }
+    e = apply(r.wrtype,
+              r.uuid,
+              r.val[0] | (r.val[1] << 8) | (r.val[2] << 16)
+              | ((uint32_t)r.val[3] << 24));
+    if (e != ec_success) {
+      /* The node may be removed in between, go on */
+      elog(e);
+      continue;
+    }
+    n++;
+  }
+  /* Appending always goes to the end due to O_APPEND */
+  LOGD("%d journal record(s) replayed\n", n);
+  return n;
+}
+
+void json_journal_reset(void)
+{
+  if (jnl.fd < 0) {
+    return;
+  }
+  if (-1 == ftruncate(jnl.fd, 0)) {
+    LOGE("Truncate journal error[%s]\n", strerror(errno));
+    return;
+  }
+  fsync(jnl.fd);
+  jnl.records = 0;
+  jnl.pending = 0;
+}
+
+int json_journal_records(void)
+{
+  return jnl.records;
+}
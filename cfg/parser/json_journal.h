@@ -0,0 +1,93 @@
+/*************************************************************************
+    > File Name: json_journal.h
+    > Author: Kevin
+    > Created Time: 2020-02-17
+    > Description: Write-ahead journal of the node field mutations
+ ************************************************************************/
+
+#ifndef JSON_JOURNAL_H
+#define JSON_JOURNAL_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdint.h>
+#include "err.h"
+
+/*
+ * Callback to apply a replayed record to the json tree
+ */
+typedef err_t (*journal_apply_t)(int wrtype,
+                                 const uint8_t *uuid,
+                                 uint32_t val);
+
+/**
+ * @brief json_journal_open - open (or create) the journal next to the json
+ * file, nothing happens if it's already opened for the same file
+ *
+ * @param cfgpath - path of the json file the journal belongs to
+ *
+ * @return @ref{err_t}
+ */
+err_t json_journal_open(const char *cfgpath);
+
+/**
+ * @brief json_journal_close - sync the pending records and close the journal
+ */
+void json_journal_close(void);
+
+/**
+ * @brief json_journal_append - append a field mutation to the journal, the
+ * records are fsync'd in groups, see JOURNAL_GROUP_COMMIT_NUM
+ *
+ * @param wrtype - write type, wrt_xxx
+ * @param uuid - the node
+ * @param val - new value of the field
+ *
+ * @return @ref{err_t}
+ */
+err_t json_journal_append(int wrtype,
+                          const uint8_t *uuid,
+                          uint32_t val);
+
+/**
+ * @brief json_journal_sync - fsync the pending records
+ *
+ * @return @ref{err_t}
+ */
+err_t json_journal_sync(void);
+
+/**
+ * @brief json_journal_sync_due - when the pending records are due to be
+ * fsync'd if no more records are appended
+ *
+ * @return absolute time in ms, the same clock as time(NULL) * 1000, 0 if
+ * nothing is pending
+ */
+uint64_t json_journal_sync_due(void);
+
+/**
+ * @brief json_journal_replay - apply all the valid records in the journal, a
+ * torn record at the tail is dropped
+ *
+ * @param apply - callback to apply each record
+ *
+ * @return number of records applied
+ */
+int json_journal_replay(journal_apply_t apply);
+
+/**
+ * @brief json_journal_reset - drop all records, MUST be called only after the
+ * json file holds all the mutations in the journal
+ */
+void json_journal_reset(void);
+
+/**
+ * @brief json_journal_records - number of records in the journal
+ */
+int json_journal_records(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //JSON_JOURNAL_H
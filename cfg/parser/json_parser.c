@@ -21,6 +21,7 @@
 #include "generic_parser.h"
 #include "json_object.h"
 #include "json_parser.h"
+#include "json_journal.h"
 #include "logging.h"
 #include "utils.h"
 #include "dev_config.h"
@@ -77,6 +78,8 @@ typedef struct {
     int subnet_num;
     sbn_t *subnets;
     json_object *backlog;
+    /* UUID -> node json object in subnets[0].nodes */
+    GHashTable *uuid_idx;
   }nw;
   struct {
     cfg_general_t gen;
@@ -113,10 +116,15 @@ DECLLOADER(txp);
 DECLLOADER(bindings);
 DECLLOADER(sublist);
 DECLLOADER(features);
+DECLLOADER(product);
 
 /* Used only for node */
 DECLLOADER(tmpl);
 
+static err_t __journal_apply(int wrtype,
+                             const uint8_t *uuid,
+                             uint32_t val);
+
 static inline cfg_general_t *gen_from_fd(int fd)
 {
   return fd == PROV_CFG_FILE ? &jcfg.prov.gen
@@ -161,12 +169,13 @@ static const __load_func_t loaders[] = {
   _load_bindings,
   _load_sublist,
   _load_features,
+  _load_product,
   /* Used only for node */
   _load_tmpl,
   /* Used only for provself */
 };
-static const int tmpl_loader_end = 7;
-static const int node_loader_end = 8;
+static const int tmpl_loader_end = 8;
+static const int node_loader_end = 9;
 
 /**
  * @defgroup single_key_load
@@ -277,6 +286,16 @@ static inline uint16list_t **psublist_from_fd(int cfg_fd, void *dest)
   ASSERT(0);
 }
 
+static inline product_t **pproduct_from_fd(int cfg_fd, void *dest)
+{
+  if (cfg_fd == NW_NODES_CFG_FILE) {
+    return (&((node_t *)dest)->config.product);
+  } else if (cfg_fd == TEMPLATE_FILE) {
+    return (&((tmpl_t *)dest)->product);
+  }
+  ASSERT(0);
+}
+
 static err_t _load_pub(json_object *obj,
                        int cfg_fd,
                        void *dest)
@@ -514,6 +533,58 @@ static err_t _load_txp(json_object *obj,
   return e;
 }
 
+static err_t _load_product(json_object *obj,
+                           int cfg_fd,
+                           void *dest)
+{
+  err_t e = ec_success;
+  product_t **p = pproduct_from_fd(cfg_fd, dest);
+  json_object *o, *tmp;
+  const char *v;
+
+  if (!json_object_object_get_ex(obj, STR_PRODUCT, &o)) {
+    goto free;
+  }
+  if (!*p) {
+    *p = calloc(sizeof(product_t), 1);
+  }
+
+#if (JSON_ECHO_DBG == 1)
+  JSON_ECHO("Product", o);
+#endif
+  /* All 3 IDs are needed to identify the DCD */
+  if (!json_object_object_get_ex(o, STR_CID, &tmp)) {
+    e = err(ec_json_format);
+    goto free;
+  }
+  v = json_object_get_string(tmp);
+  if (ec_success != (e = uint16_loader(v, &(*p)->cid))) {
+    goto free;
+  }
+  if (!json_object_object_get_ex(o, STR_PID, &tmp)) {
+    e = err(ec_json_format);
+    goto free;
+  }
+  v = json_object_get_string(tmp);
+  if (ec_success != (e = uint16_loader(v, &(*p)->pid))) {
+    goto free;
+  }
+  if (!json_object_object_get_ex(o, STR_VID, &tmp)) {
+    e = err(ec_json_format);
+    goto free;
+  }
+  v = json_object_get_string(tmp);
+  if (ec_success != (e = uint16_loader(v, &(*p)->vid))) {
+    goto free;
+  }
+  return ec_success;
+
+  free:
+  free(*p);
+  *p = NULL;
+  return e;
+}
+
 static err_t _load_timeout(json_object *obj,
                            int cfg_fd,
                            void *dest)
@@ -561,6 +632,59 @@ static err_t _load_timeout(json_object *obj,
   return e;
 }
 
+static err_t _load_limits(json_object *obj,
+                          int cfg_fd,
+                          void *dest)
+{
+  err_t e = ec_success;
+  json_object *o, *tmp;
+  provcfg_t *prov = (provcfg_t *)dest;
+  const char *v;
+
+  if (cfg_fd != PROV_CFG_FILE) {
+    e = err(ec_param_invalid);
+    goto free;
+  }
+
+  /* Optional, defaults in projconfig.h are used if not present */
+  if (!json_object_object_get_ex(obj, STR_NCP_LIMITS, &o)) {
+    goto free;
+  }
+  if (!prov->limits) {
+    prov->limits = calloc(1, sizeof(ncp_limits_t));
+  }
+
+#if (JSON_ECHO_DBG == 1)
+  JSON_ECHO("NCP Limits", o);
+#endif
+  if (json_object_object_get_ex(o, STR_CONFIG_NODES, &tmp)) {
+    v = json_object_get_string(tmp);
+    if (ec_success != (e = uint8_loader(v, &prov->limits->config_nodes))) {
+      goto free;
+    }
+  }
+  if (json_object_object_get_ex(o, STR_LPN_NODES, &tmp)) {
+    v = json_object_get_string(tmp);
+    if (ec_success != (e = uint8_loader(v, &prov->limits->lpn_nodes))) {
+      goto free;
+    }
+  }
+  if (json_object_object_get_ex(o, STR_PROV_SESSIONS, &tmp)) {
+    v = json_object_get_string(tmp);
+    if (ec_success != (e = uint8_loader(v, &prov->limits->prov_sessions))) {
+      goto free;
+    }
+  }
+  return ec_success;
+
+  free:
+  if (prov->limits) {
+    free(prov->limits);
+    prov->limits = NULL;
+  }
+  return e;
+}
+
 static err_t _load_ttl(json_object *obj,
                        int cfg_fd,
                        void *dest)
@@ -786,6 +910,9 @@ static void __copy_tmpl_to_node(const tmpl_t *t,
   if (t->bindings && !n->config.bindings) {
     alloc_copy_u16list(&n->config.bindings, t->bindings);
   }
+  if (t->product && !n->config.product) {
+    alloc_copy((uint8_t **)&n->config.product, t->product, sizeof(product_t));
+  }
 }
 
 static err_t _load_tmpl(json_object *obj,
@@ -1246,6 +1373,7 @@ static err_t load_provself(void)
   _load_ttl(jcfg.prov.gen.root, PROV_CFG_FILE, provcfg);
   _load_txp(jcfg.prov.gen.root, PROV_CFG_FILE, provcfg);
   _load_timeout(jcfg.prov.gen.root, PROV_CFG_FILE, provcfg);
+  _load_limits(jcfg.prov.gen.root, PROV_CFG_FILE, provcfg);
 
   /* Load Primary Subnet */
   if (!json_object_object_get_ex(jcfg.prov.gen.root, STR_SUBNETS, &n)) {
@@ -1294,6 +1422,253 @@ static err_t load_provself(void)
   return e;
 }
 
+/**
+ * @defgroup node_index
+ *
+ * Index from the 16-byte UUID to the node json object, the json objects are
+ * owned by the json tree, so the index MUST be cleared whenever the tree is
+ * released or reloaded
+ * @{ */
+static guint __uuid_hash(gconstpointer key)
+{
+  /* FNV-1a */
+  const uint8_t *p = (const uint8_t *)key;
+  guint h = 2166136261u;
+
+  for (int i = 0; i < 16; i++) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static gboolean __uuid_equal(gconstpointer a, gconstpointer b)
+{
+  return !memcmp(a, b, 16);
+}
+
+static void __node_index_add(const uint8_t *uuid, json_object *n)
+{
+  uint8_t *k;
+
+  if (!jcfg.nw.uuid_idx) {
+    jcfg.nw.uuid_idx = g_hash_table_new_full(__uuid_hash,
+                                             __uuid_equal,
+                                             free,
+                                             NULL);
+  }
+  if (g_hash_table_lookup(jcfg.nw.uuid_idx, uuid)) {
+    /* Keep the first one as the linear search did */
+    LOGW("Duplicated UUID in the nodes config file\n");
+    return;
+  }
+  k = malloc(16);
+  memcpy(k, uuid, 16);
+  g_hash_table_insert(jcfg.nw.uuid_idx, k, n);
+}
+
+static void __node_index_clr(void)
+{
+  if (jcfg.nw.uuid_idx) {
+    g_hash_table_remove_all(jcfg.nw.uuid_idx);
+  }
+}
+/**  @} */
+
+static inline int __u16list_len(const uint16list_t *l)
+{
+  return l ? l->len : 0;
+}
+
+static bool __u16list_eq(const uint16list_t *a, const uint16list_t *b)
+{
+  int len = __u16list_len(a);
+
+  if (len != __u16list_len(b)) {
+    return false;
+  }
+  return !len || !memcmp(a->data, b->data, len * sizeof(uint16_t));
+}
+
+static bool __u16list_has(const uint16list_t *l, uint16_t v)
+{
+  for (int i = 0; i < __u16list_len(l); i++) {
+    if (l->data[i] == v) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Items in a but not in b, NULL if none
+ */
+static uint16list_t *__u16list_minus(const uint16list_t *a,
+                                     const uint16list_t *b)
+{
+  uint16list_t *r = NULL;
+
+  for (int i = 0; i < __u16list_len(a); i++) {
+    if (__u16list_has(b, a->data[i]) || __u16list_has(r, a->data[i])) {
+      continue;
+    }
+    if (!r) {
+      r = calloc(1, sizeof(uint16list_t));
+      r->data = calloc(a->len, sizeof(uint16_t));
+    }
+    r->data[r->len++] = a->data[i];
+  }
+  return r;
+}
+
+static inline bool __u8_eq(const uint8_t *a, const uint8_t *b)
+{
+  return (!a && !b) || (a && b && *a == *b);
+}
+
+static inline bool __txp_eq(const txparam_t *a, const txparam_t *b)
+{
+  return (!a && !b) || (a && b && a->cnt == b->cnt && a->intv == b->intv);
+}
+
+static inline bool __pub_eq(const publication_t *a, const publication_t *b)
+{
+  return (!a && !b)
+         || (a && b
+             && a->addr == b->addr
+             && a->aki == b->aki
+             && a->period == b->period
+             && a->ttl == b->ttl
+             && __txp_eq(&a->txp, &b->txp));
+}
+
+static inline bool __product_eq(const product_t *a, const product_t *b)
+{
+  return (!a && !b)
+         || (a && b && a->cid == b->cid && a->pid == b->pid && a->vid == b->vid);
+}
+
+/*
+ * Check if the pending feature is the same as the applied one
+ */
+static bool __feature_eq(const mesh_config_t *a,
+                         const mesh_config_t *c,
+                         features_em w)
+{
+  switch (w) {
+    case RELAY_BITOFS:
+      return IS_BIT_SET(a->features.target, w) == IS_BIT_SET(c->features.target, w)
+             && __txp_eq(a->features.relay_txp, c->features.relay_txp);
+    case PROXY_BITOFS:
+    case FRIEND_BITOFS:
+    case SNB_BITOFS:
+      return IS_BIT_SET(a->features.target, w) == IS_BIT_SET(c->features.target, w);
+    case TTL_BITOFS:
+      return __u8_eq(a->ttl, c->ttl);
+    case NETTX_BITOFS:
+      return __txp_eq(a->net_txp, c->net_txp);
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief __node_delta - compare the configuration just loaded with the one
+ * last applied to the node, the changes are stored in {delta} of the node and
+ * the unchanged features are marked as configured
+ *
+ * @param n - the node, {applied} MUST be set
+ *
+ * @return 0 if nothing changed, 1 if the changes can be applied incrementally,
+ * -1 if the node needs to be configured from scratch
+ */
+static int __node_delta(node_t *n)
+{
+  const mesh_config_t *a = n->applied;
+  mesh_config_t *c = &n->config;
+  cfg_delta_t *d;
+  sbitmap_t pending, same = 0;
+
+  ASSERT(a);
+  cfgdb_delta_free(n);
+  /* Unbinding and clearing the publication are not supported */
+  if (!__u16list_eq(a->bindings, c->bindings)
+      || !__product_eq(a->product, c->product)
+      || (a->pub && !c->pub)) {
+    return -1;
+  }
+
+  d = calloc(1, sizeof(cfg_delta_t));
+  ASSERT(d);
+  if (!__pub_eq(a->pub, c->pub)) {
+    d->what |= DELTA_PUB_BIT;
+  }
+  d->sub_add = __u16list_minus(c->sublist, a->sublist);
+  d->sub_rm = __u16list_minus(a->sublist, c->sublist);
+  if (d->sub_add || d->sub_rm) {
+    d->what |= DELTA_SUB_BIT;
+  }
+  pending = c->features.target ^ c->features.current;
+  for (int w = 0; w < FEATURE_MAX_BITOFS; w++) {
+    if (!IS_BIT_SET(pending, w)) {
+      continue;
+    }
+    if (__feature_eq(a, c, w)) {
+      BIT_SET(same, w);
+    } else {
+      d->what |= DELTA_FEATURES_BIT;
+    }
+  }
+
+  n->delta = d;
+  if (!d->what) {
+    cfgdb_delta_free(n);
+    return 0;
+  }
+  c->features.current = (c->features.current & ~same)
+                        | (c->features.target & same);
+  return 1;
+}
+
+/*
+ * A configured node with changes in the file is set to be configured again,
+ * incrementally if possible. It's not done in the file either, so if the
+ * program restarts before it's done, it's configured from scratch.
+ */
+static void __node_delta_check(json_object *obj, node_t *n)
+{
+  char undone[] = { '0', 'x', '0', '0', 0 };
+  int ret;
+
+  if (!n->done && !n->delta) {
+    return;
+  }
+  if (!n->applied) {
+    /* The first time the configured node is loaded */
+    cfgdb_node_applied_set(n);
+    return;
+  }
+
+  ret = __node_delta(n);
+  if (ret > 0) {
+    LOGM("Node[0x%04x]: Configuration Changed,%s%s%s Update Incrementally\n",
+         n->addr,
+         n->delta->what & DELTA_PUB_BIT ? " Pub" : "",
+         n->delta->what & DELTA_SUB_BIT ? " Sub" : "",
+         n->delta->what & DELTA_FEATURES_BIT ? " Features" : "");
+  } else if (ret < 0 || !n->done) {
+    /* Partially applied delta is reverted in the file, start over as well */
+    LOGM("Node[0x%04x]: Configuration Changed, Reconfigure\n", n->addr);
+    cfgdb_node_applied_clr(n);
+  } else {
+    return;
+  }
+  if (n->done) {
+    n->done = 0;
+    __kv_replace(obj, STR_DONE, undone);
+  }
+}
+
 /**
  * @brief __load_node_arr - Load a node array in the json config file
  *
@@ -1340,6 +1715,9 @@ static void __load_node_arr(json_object *pnode, bool backlog)
       LOGE("STR to CBUF error\n");
       continue;
     }
+    if (!backlog) {
+      __node_index_add(uuid, n);
+    }
     json_object_object_get_ex(n, STR_RMORBL, &tmp);
     v = json_object_get_string(tmp);
     if (ec_success != str2uint(v, strlen(v), &rmbl, sizeof(uint8_t))) {
@@ -1387,6 +1765,9 @@ static void __load_node_arr(json_object *pnode, bool backlog)
     t->rmorbl = rmbl;
     t->err = errbits;
     t->models.func = func;
+    if (!backlog && addr && !rmbl && e == ec_success) {
+      __node_delta_check(n, t);
+    }
     if (add) {
       if (e == ec_success) {
         if (backlog) {
@@ -1417,6 +1798,7 @@ static err_t load_nodes(void)
       || !jcfg.nw.gen.root) {
     return err(ec_json_open);
   }
+  __node_index_clr();
   __load_node_arr(jcfg.nw.subnets[0].nodes, false);
   __load_node_arr(jcfg.nw.backlog, true);
   return ec_success;
@@ -1447,6 +1829,8 @@ void json_cfg_close(int cfg_fd)
   json_object_put(gen->root);
   if (cfg_fd == NW_NODES_CFG_FILE) {
     SAFE_FREE(jcfg.nw.subnets);
+    __node_index_clr();
+    json_journal_close();
   }
   gen->root = NULL;
   /* LOGM("%s file closed.\n", gen->fp); */
@@ -1528,6 +1912,16 @@ err_t json_cfg_open(int cfg_fd,
     goto finally;
   }
 
+  if (cfg_fd == NW_NODES_CFG_FILE) {
+    /* Fold the mutations not in the json file yet */
+    if (ec_success != (ret = json_journal_open(gen->fp))) {
+      goto finally;
+    }
+    if (json_journal_replay(__journal_apply)) {
+      json_cfg_flush(NW_NODES_CFG_FILE);
+    }
+  }
+
   if (ec_success != (ret = load_json_file(cfg_fd,
                                           !!(flags & FL_FORCE_RELOAD)))) {
     goto finally;
@@ -1576,6 +1970,11 @@ err_t json_cfg_flush(int cfg_fd)
 #endif
     return err(ec_json_save);
   }
+  if (cfg_fd == NW_NODES_CFG_FILE
+      && ec_success == json_journal_open(gen->fp)) {
+    /* The json file holds everything now */
+    json_journal_reset();
+  }
   return ec_success;
 }
 
@@ -1610,16 +2009,23 @@ static json_object *find_node(const uint8_t *uuid,
   if (reload) {
     load_json_file(NW_NODES_CFG_FILE, 0);
   }
-  if (!jcfg.nw.subnets[0].nodes) {
+  if (!jcfg.nw.subnets || !jcfg.nw.subnets[0].nodes) {
     return NULL;
   }
+  /* The index is built in __load_node_arr */
+  if (jcfg.nw.uuid_idx && g_hash_table_size(jcfg.nw.uuid_idx)) {
+    return g_hash_table_lookup(jcfg.nw.uuid_idx, uuid);
+  }
 
+  /* Not loaded yet, e.g. replaying the journal right after the file is opened */
   json_array_foreach(i, n, jcfg.nw.subnets[0].nodes){
     json_object *tmp, *n;
     const char *v;
     uint8_t uuid_buf[16];
     n = json_object_array_get_idx(jcfg.nw.subnets[0].nodes, i);
-    json_object_object_get_ex(n, STR_UUID, &tmp);
+    if (!json_object_object_get_ex(n, STR_UUID, &tmp)) {
+      continue;
+    }
     v = json_object_get_string(tmp);
     if (ec_success != str2cbuf(v, 0, (char *)uuid_buf, 16)) {
       LOGE("STR to CBUF error\n");
@@ -1795,11 +2201,58 @@ static err_t nodes_clrctl(void)
   return json_cfg_open(NW_NODES_CFG_FILE, NULL, FL_FORCE_RELOAD);
 }
 
+/*
+ * Get the value to journal if the write type is a single field mutation of a
+ * node
+ */
+static bool __journal_val(int wrtype,
+                          const void *data,
+                          uint32_t *val)
+{
+  switch (wrtype) {
+    case wrt_errbits:
+      *val = *(uint32_t *)data;
+      return true;
+    case wrt_node_addr:
+      *val = *(uint16_t *)data;
+      return true;
+    case wrt_node_func:
+    case wrt_done:
+      *val = *(uint8_t *)data;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static err_t __journal_apply(int wrtype,
+                             const uint8_t *uuid,
+                             uint32_t val)
+{
+  uint32_t u32 = val;
+  uint16_t u16 = (uint16_t)val;
+  uint8_t u8 = (uint8_t)val;
+
+  switch (wrtype) {
+    case wrt_errbits:
+      return set_node_errbits(uuid, &u32);
+    case wrt_node_addr:
+      return set_node_addr(uuid, &u16);
+    case wrt_node_func:
+      return set_node_func(uuid, &u8);
+    case wrt_done:
+      return set_node_done(uuid, &u8);
+    default:
+      return err(ec_param_invalid);
+  }
+}
+
 static err_t write_nodes(int wrtype,
                          const void *key,
                          void *data)
 {
   err_t e;
+  uint32_t val;
   switch (wrtype) {
     case wrt_clrctl:
       e = nodes_clrctl();
@@ -1828,10 +2281,19 @@ static err_t write_nodes(int wrtype,
     default:
       return err(ec_param_invalid);
   }
-  if (jcfg.nw.gen.autoflush && e == ec_success) {
-    return json_cfg_flush(NW_NODES_CFG_FILE);
+  if (!jcfg.nw.gen.autoflush || e != ec_success) {
+    return e;
   }
-  return e;
+  /*
+   * Single field mutations only go to the journal, the whole file is rewritten
+   * on bulk changes, journal failure or the journal is long enough to compact
+   */
+  if (__journal_val(wrtype, data, &val)
+      && ec_success == json_journal_append(wrtype, key, val)
+      && json_journal_records() < JOURNAL_COMPACT_THRESHOLD) {
+    return ec_success;
+  }
+  return json_cfg_flush(NW_NODES_CFG_FILE);
 }
 
 static inline void __provself_setappkeyid(provcfg_t *pc,
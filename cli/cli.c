@@ -46,7 +46,6 @@
 
 /* Global Variables *************************************************** */
 extern jmp_buf initjmpbuf;
-extern pthread_mutex_t qlock;
 extern err_t cmd_ret;
 
 /* Static Variables *************************************************** */
@@ -715,7 +714,10 @@ void *cli_mainloop(void *pin)
       }
     } else {
       /* Need the mng component to handle */
-      cmd_enq(str, ret);
+      if (ec_success != (e = cmd_enq(w.we_wordc, w.we_wordv, ret))) {
+        printf(COLOR_HIGHLIGHT "Command too long\n" COLOR_OFF);
+        elog(e);
+      }
     }
 
     out:
@@ -11,6 +11,9 @@
 #include "cli.h"
 #include "logging.h"
 #include "utils.h"
+#include "bgevt_hdr.h"
+#include "acc_plan.h"
+#include "breaker.h"
 /* Defines  *********************************************************** */
 #define DEV_INFO      "Dev Info:\n"
 #define DEV_PADDING   "         "
@@ -19,6 +22,8 @@
 #define UUID_INFO     "UUID   --- "
 
 #define TMP_BUF_LEN 0xff
+#define UNHANDLED_EVTS_MAX 16
+#define QUARANTINED_MAX 16
 
 /* Global Variables *************************************************** */
 
@@ -110,10 +115,17 @@ const char *loglvls[] = { "Assert", "Error", "Warning", "Message", "Debug", "Ver
 void cli_status(const mng_t *mng)
 {
   int used = 0;
-  int loglvl;
+  int loglvl, n, plans, ops;
+  bo_stat_t bo;
+  brk_stat_t brk;
+  struct gecko_queue_stat qs;
+  uint16_t qaddrs[QUARANTINED_MAX];
+  uint32_t qdue[QUARANTINED_MAX];
+  uint32_t ids[UNHANDLED_EVTS_MAX], cnts[UNHANDLED_EVTS_MAX], hits;
+  uint32_t bhandled, bfiltered;
 
-  for (int i = 0; i < MAX_PROV_SESSIONS; i++) {
-    if (mng->cache.add[i].busy) {
+  for (int i = 0; i < mng->cache.add.ceiling; i++) {
+    if (mng->cache.add.cache[i].busy) {
       used++;
     }
   }
@@ -121,8 +133,38 @@ void cli_status(const mng_t *mng)
   loglvl = get_logging_lvl_threshold();
 
   bt_shell_printf("State                 = %s\n", states[mng->state]);
-  bt_shell_printf("Used adding    caches = %d\n", used);
+  bt_shell_printf("Used adding    caches = %d, limit %d/%d\n",
+                  used,
+                  mng->cache.add.win.size,
+                  mng->cache.add.ceiling);
   bt_shell_printf("Used config/rm caches = %d\n", utils_popcount(mng->cache.config.used));
+  bt_shell_printf("Config window         = %d/%d, LPN lane %d\n",
+                  mng->cache.config.win.size,
+                  mng->cache.config.ceiling,
+                  mng->cache.config.lpn);
+  plan_stat_get(&plans, &ops, &hits);
+  bt_shell_printf("Config plans          = %d (%d ops, %u shared)\n", plans, ops, hits);
+  backoff_stat_get(&bo);
+  bt_shell_printf("OOM backoffs          = %u/%u/%u [config/add/rm], max level %d, pressure %d\n",
+                  bo.engaged[bo_config_em],
+                  bo.engaged[bo_add_em],
+                  bo.engaged[bo_rm_em],
+                  bo.max_level,
+                  bo.pressure);
+  breaker_stat_get(&brk);
+  bt_shell_printf("Quarantined nodes     = %d (%u trips, %u probes, %u recovered)\n",
+                  brk.open,
+                  brk.trips,
+                  brk.probes,
+                  brk.recovered);
+  n = breaker_open_get(qaddrs, qdue, QUARANTINED_MAX);
+  for (int i = 0; i < n; i++) {
+    if (qdue[i]) {
+      bt_shell_printf("  Node[0x%04x] probe in %us\n", qaddrs[i], qdue[i]);
+    } else {
+      bt_shell_printf("  Node[0x%04x] probe due\n", qaddrs[i]);
+    }
+  }
   bt_shell_printf("Blacklisting          = %s\n", mng->cache.bl.state == bl_idle ? "Idle" : "Busy");
   bt_shell_printf("Action Sequence       = %s\n", mng->status.seq.prios);
   bt_shell_printf("Node(s) to set state  = %d\n", g_list_length(mng->cache.model_set.nodes));
@@ -130,9 +172,23 @@ void cli_status(const mng_t *mng)
   bt_shell_printf("Logging Threshold     = %s\n", loglvls[loglvl + 1]);
   bt_shell_printf("[%d-%d-%d-%d] to be [added-configured-removed-blacklisted]\n",
                   g_list_length(mng->lists.add),
-                  g_list_length(mng->lists.config),
-                  g_list_length(mng->lists.rm),
+                  mng_config_pending(mng),
+                  mng_rm_pending(mng),
                   g_list_length(mng->lists.bl));
+  beacon_filter_stat_get(&bhandled, &bfiltered);
+  bt_shell_printf("Unprov beacons        = %u handled, %u filtered\n", bhandled, bfiltered);
+  gecko_queue_stat_get(&qs);
+  bt_shell_printf("Event queue           = peak %u/%d, %u dropped, %u coalesced, %u overflowed, %u lost\n",
+                  qs.peak,
+                  BGLIB_QUEUE_LEN - 1,
+                  qs.dropped,
+                  qs.coalesced,
+                  qs.overflowed,
+                  qs.lost);
+  n = bgevt_unhandled_get(ids, cnts, UNHANDLED_EVTS_MAX);
+  for (int i = 0; i < n; i++) {
+    bt_shell_printf("Unhandled Event [0x%08x] x %u\n", ids[i], cnts[i]);
+  }
 }
 
 void cli_print_stat(const stat_t *s)
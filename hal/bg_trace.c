@@ -0,0 +1,452 @@
+/*************************************************************************
+    > File Name: bg_trace.c
+    > Author: Kevin
+    > Created Time: 2020-02-21
+    > Description: Record the BGAPI traffic to file and replay it
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#if (__APPLE__ != 1)
+#include <sys/timerfd.h>
+#endif
+
+#include "projconfig.h"
+#include "bg_trace.h"
+#include "gecko_bglib.h"
+#include "logging.h"
+#include "utils.h"
+
+/* Defines  *********************************************************** */
+#define BGTRACE_MAGIC "BGTR"
+#define BGTRACE_VERSION 1
+#define BGTRACE_FILE_HDR_LEN 8
+/* Timestamp(8) + Direction(1) */
+#define BGTRACE_REC_HDR_LEN 9
+#define BGTRACE_FRAME_MAX (BGLIB_MSG_HEADER_LEN + BGLIB_MSG_MAX_PAYLOAD)
+
+typedef struct {
+  const uint8_t *frame;
+  uint32_t len;
+  uint64_t ts;
+}trace_frame_t;
+
+/* Global Variables *************************************************** */
+
+/* Static Variables *************************************************** */
+static struct {
+  FILE *fp;
+  pthread_mutex_t lock;
+  /* Frame from the NCP target being assembled */
+  uint8_t rx[BGTRACE_FRAME_MAX];
+  uint32_t rxlen;
+  uint32_t frames;
+  /* Frames in the stdio buffer, see bgtrace_record_flush */
+  uint32_t unflushed;
+  bool atexit_registered;
+} rec = { NULL, PTHREAD_MUTEX_INITIALIZER };
+
+static struct {
+  uint8_t *buf;
+  size_t len;
+  bool realtime;
+  bool ended;
+  int tmfd;
+  /* Offsets of the next records to look at in both directions */
+  size_t rx_off;
+  size_t tx_off;
+  /* Frame being read by BGLIB and the one after it */
+  trace_frame_t cur;
+  uint32_t pos;
+  trace_frame_t next;
+  bool next_valid;
+  /* Recorded time of the first frame to the host and when replaying starts */
+  uint64_t ts0;
+  uint64_t t0;
+  uint64_t duration;
+  uint32_t rx_frames;
+  uint32_t tx_frames;
+  uint32_t diverged;
+} rpl = { .tmfd = -1 };
+
+/* Static Functions Declaractions ************************************* */
+static uint64_t __now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint32_t __hdr(const uint8_t *frame)
+{
+  uint32_t hdr;
+  memcpy(&hdr, frame, BGLIB_MSG_HEADER_LEN);
+  return hdr;
+}
+
+static void __put_le64(uint8_t *p, uint64_t v)
+{
+  for (int i = 0; i < 8; i++) {
+    p[i] = (uint8_t)(v >> (i * 8));
+  }
+}
+
+static uint64_t __get_le64(const uint8_t *p)
+{
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+/**
+ * @defgroup record
+ * @{ */
+static void __rec_write(uint8_t dir, const uint8_t *frame, uint32_t len)
+{
+  uint8_t h[BGTRACE_REC_HDR_LEN];
+
+  __put_le64(h, __now_ns());
+  h[8] = dir;
+  if (1 != fwrite(h, sizeof(h), 1, rec.fp)
+      || 1 != fwrite(frame, len, 1, rec.fp)) {
+    LOGE("Write BGAPI trace error[%s]\n", strerror(errno));
+    return;
+  }
+  rec.frames++;
+  rec.unflushed++;
+}
+
+err_t bgtrace_record_start(const char *path)
+{
+  uint8_t h[BGTRACE_FILE_HDR_LEN] = { 0 };
+
+  if (!path) {
+    return err(ec_param_null);
+  }
+  if (rec.fp) {
+    return ec_success;
+  }
+  if (NULL == (rec.fp = fopen(path, "wb"))) {
+    LOGE("Open %s error[%s]\n", path, strerror(errno));
+    return err(ec_file_ope);
+  }
+  memcpy(h, BGTRACE_MAGIC, 4);
+  h[4] = BGTRACE_VERSION;
+  fwrite(h, sizeof(h), 1, rec.fp);
+  rec.rxlen = 0;
+  rec.frames = 0;
+  rec.unflushed = 0;
+  if (!rec.atexit_registered) {
+    /* Close the file properly on exit(), e.g. quit from the CLI */
+    atexit(bgtrace_record_stop);
+    rec.atexit_registered = true;
+  }
+  LOGM("Recording BGAPI traffic to %s\n", path);
+  return ec_success;
+}
+
+void bgtrace_record_stop(void)
+{
+  pthread_mutex_lock(&rec.lock);
+  if (rec.fp) {
+    fclose(rec.fp);
+    rec.fp = NULL;
+    LOGM("%u BGAPI frame(s) recorded\n", rec.frames);
+  }
+  pthread_mutex_unlock(&rec.lock);
+}
+
+void bgtrace_record_flush(void)
+{
+  pthread_mutex_lock(&rec.lock);
+  if (rec.fp && rec.unflushed) {
+    fflush(rec.fp);
+    rec.unflushed = 0;
+  }
+  pthread_mutex_unlock(&rec.lock);
+}
+
+void bgtrace_on_tx(uint32_t len, const uint8_t *data)
+{
+  if (len < BGLIB_MSG_HEADER_LEN || len > BGTRACE_FRAME_MAX) {
+    return;
+  }
+  pthread_mutex_lock(&rec.lock);
+  if (rec.fp) {
+    __rec_write(bgtrace_to_target, data, len);
+  }
+  pthread_mutex_unlock(&rec.lock);
+}
+
+void bgtrace_on_rx(uint32_t len, const uint8_t *data)
+{
+  uint32_t need;
+
+  pthread_mutex_lock(&rec.lock);
+  if (!rec.fp || rec.rxlen + len > BGTRACE_FRAME_MAX) {
+    rec.rxlen = 0;
+    goto out;
+  }
+  memcpy(rec.rx + rec.rxlen, data, len);
+  rec.rxlen += len;
+
+  /* BGLIB drops the byte as well if it's not a valid header start */
+  if ((rec.rx[0] & 0x78) != gecko_dev_type_gecko) {
+    rec.rxlen = 0;
+    goto out;
+  }
+  if (rec.rxlen < BGLIB_MSG_HEADER_LEN) {
+    goto out;
+  }
+  need = BGLIB_MSG_HEADER_LEN + BGLIB_MSG_LEN(__hdr(rec.rx));
+  if (need > BGTRACE_FRAME_MAX) {
+    rec.rxlen = 0;
+  } else if (rec.rxlen >= need) {
+    __rec_write(bgtrace_to_host, rec.rx, need);
+    rec.rxlen = 0;
+  }
+
+  out:
+  pthread_mutex_unlock(&rec.lock);
+}
+/**  @} */
+
+/**
+ * @defgroup replay
+ * @{ */
+static bool __rec_next(size_t *off, uint8_t dir, trace_frame_t *f)
+{
+  const uint8_t *r;
+  uint32_t len;
+
+  while (*off + BGTRACE_REC_HDR_LEN + BGLIB_MSG_HEADER_LEN <= rpl.len) {
+    r = rpl.buf + *off;
+    len = BGLIB_MSG_HEADER_LEN + BGLIB_MSG_LEN(__hdr(r + BGTRACE_REC_HDR_LEN));
+    if (*off + BGTRACE_REC_HDR_LEN + len > rpl.len) {
+      /* Torn record at the tail */
+      break;
+    }
+    *off += BGTRACE_REC_HDR_LEN + len;
+    if (r[8] == dir) {
+      f->frame = r + BGTRACE_REC_HDR_LEN;
+      f->len = len;
+      f->ts = __get_le64(r);
+      return true;
+    }
+  }
+  *off = rpl.len;
+  return false;
+}
+
+static inline uint64_t __due(const trace_frame_t *f)
+{
+  return rpl.t0 + (f->ts > rpl.ts0 ? f->ts - rpl.ts0 : 0);
+}
+
+static void __timer_arm(uint64_t due)
+{
+#if (__APPLE__ != 1)
+  struct itimerspec its;
+
+  if (rpl.tmfd < 0) {
+    return;
+  }
+  memset(&its, 0, sizeof(struct itimerspec));
+  its.it_value.tv_sec = due / 1000000000ULL;
+  its.it_value.tv_nsec = due % 1000000000ULL;
+  if (!its.it_value.tv_sec && !its.it_value.tv_nsec) {
+    its.it_value.tv_nsec = 1;
+  }
+  timerfd_settime(rpl.tmfd, TFD_TIMER_ABSTIME, &its, NULL);
+#endif
+}
+
+static void __timer_drain(void)
+{
+  uint64_t v;
+  if (rpl.tmfd >= 0) {
+    while (read(rpl.tmfd, &v, sizeof(uint64_t)) == sizeof(uint64_t)) ;
+  }
+}
+
+static void __replay_end(void)
+{
+  if (rpl.ended) {
+    return;
+  }
+  rpl.ended = true;
+  LOGM("Replay done - %u frame(s) to host, %u command(s) from host, "
+       "%u diverged, %llu ms elapsed, %llu ms recorded\n",
+       rpl.rx_frames,
+       rpl.tx_frames,
+       rpl.diverged,
+       (unsigned long long)((__now_ns() - rpl.t0) / 1000000),
+       (unsigned long long)(rpl.duration / 1000000));
+}
+
+/* Look ahead the next frame to the host, false if all are replayed */
+static bool __next_load(void)
+{
+  if (!rpl.next_valid) {
+    rpl.next_valid = __rec_next(&rpl.rx_off, bgtrace_to_host, &rpl.next);
+  }
+  return rpl.next_valid;
+}
+
+err_t bgtrace_replay_open(const char *path, bool realtime)
+{
+  FILE *fp;
+  long len;
+  size_t off;
+  trace_frame_t f;
+  bool first = true;
+
+  if (!path) {
+    return err(ec_param_null);
+  }
+  if (rpl.buf) {
+    return ec_success;
+  }
+  if (NULL == (fp = fopen(path, "rb"))) {
+    LOGE("Open %s error[%s]\n", path, strerror(errno));
+    return err(ec_file_ope);
+  }
+  fseek(fp, 0, SEEK_END);
+  len = ftell(fp);
+  rewind(fp);
+  if (len < BGTRACE_FILE_HDR_LEN) {
+    fclose(fp);
+    return err(ec_format);
+  }
+  rpl.buf = malloc(len);
+  if (1 != fread(rpl.buf, len, 1, fp)
+      || memcmp(rpl.buf, BGTRACE_MAGIC, 4)
+      || rpl.buf[4] != BGTRACE_VERSION) {
+    fclose(fp);
+    SAFE_FREE(rpl.buf);
+    LOGE("%s is not a BGAPI trace file\n", path);
+    return err(ec_format);
+  }
+  fclose(fp);
+  rpl.len = len;
+  rpl.realtime = realtime;
+
+  /* Timing is relative to the first frame to the host */
+  for (off = BGTRACE_FILE_HDR_LEN; __rec_next(&off, bgtrace_to_host, &f); ) {
+    if (first) {
+      rpl.ts0 = f.ts;
+      first = false;
+    }
+    rpl.duration = f.ts - rpl.ts0;
+  }
+  rpl.rx_off = rpl.tx_off = BGTRACE_FILE_HDR_LEN;
+  rpl.t0 = __now_ns();
+
+#if (__APPLE__ != 1)
+  if (realtime
+      && -1 == (rpl.tmfd = timerfd_create(CLOCK_MONOTONIC,
+                                          TFD_NONBLOCK | TFD_CLOEXEC))) {
+    LOGW("Create replay timer error[%s]\n", strerror(errno));
+  }
+#endif
+  LOGM("Replaying BGAPI traffic from %s at %s speed\n",
+       path, realtime ? "recorded" : "full");
+  return ec_success;
+}
+
+void bgtrace_replay_output(uint32_t len, uint8_t *data)
+{
+  trace_frame_t f;
+
+  rpl.tx_frames++;
+  if (!__rec_next(&rpl.tx_off, bgtrace_to_target, &f)) {
+    return;
+  }
+  if (len < BGLIB_MSG_HEADER_LEN
+      || BGLIB_MSG_ID(__hdr(f.frame)) != BGLIB_MSG_ID(__hdr(data))) {
+    /* Not fatal, but the responses may not match the commands afterwards */
+    if (!rpl.diverged++) {
+      LOGW("Host diverges from the recording at command #%u, "
+           "[0x%08x] sent while [0x%08x] recorded\n",
+           rpl.tx_frames,
+           len < BGLIB_MSG_HEADER_LEN ? 0 : BGLIB_MSG_ID(__hdr(data)),
+           BGLIB_MSG_ID(__hdr(f.frame)));
+    }
+  }
+}
+
+int32_t bgtrace_replay_input(uint32_t len, uint8_t *data)
+{
+  uint32_t n, total = len;
+  uint64_t now, due;
+  struct timespec ts;
+
+  while (len) {
+    if (rpl.pos == rpl.cur.len) {
+      if (!__next_load()) {
+        /* BGLIB is blocked waiting for a response that never comes */
+        __replay_end();
+        exit(EXIT_SUCCESS);
+      }
+      if (rpl.realtime) {
+        due = __due(&rpl.next);
+        if ((now = __now_ns()) < due) {
+          ts.tv_sec = (due - now) / 1000000000ULL;
+          ts.tv_nsec = (due - now) % 1000000000ULL;
+          nanosleep(&ts, NULL);
+        }
+        __timer_drain();
+      }
+      rpl.cur = rpl.next;
+      rpl.pos = 0;
+      rpl.next_valid = false;
+      rpl.rx_frames++;
+    }
+    n = rpl.cur.len - rpl.pos;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(data, rpl.cur.frame + rpl.pos, n);
+    rpl.pos += n;
+    data += n;
+    len -= n;
+  }
+  return total;
+}
+
+int32_t bgtrace_replay_peek(void)
+{
+  uint64_t due;
+
+  if (rpl.pos < rpl.cur.len) {
+    return 1;
+  }
+  if (!__next_load()) {
+    __replay_end();
+    return 0;
+  }
+  if (!rpl.realtime) {
+    return 1;
+  }
+  due = __due(&rpl.next);
+  if (__now_ns() >= due) {
+    return 1;
+  }
+  /* Wake up the event loop when it's due */
+  __timer_arm(due);
+  return 0;
+}
+
+int32_t bgtrace_replay_fd(void)
+{
+  return rpl.tmfd;
+}
+/**  @} */
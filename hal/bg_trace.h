@@ -0,0 +1,88 @@
+/*************************************************************************
+    > File Name: bg_trace.h
+    > Author: Kevin
+    > Created Time: 2020-02-21
+    > Description: Record the BGAPI traffic to file and replay it
+ ************************************************************************/
+
+#ifndef BG_TRACE_H
+#define BG_TRACE_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "err.h"
+
+/*
+ * File format - 8 bytes file header followed by the records, all little endian
+ *   File header : "BGTR" | version(1) | reserved(3)
+ *   Record      : monotonic timestamp in ns(8) | direction(1) | BGAPI frame
+ * The frame carries its own length in the BGAPI header.
+ */
+enum {
+  bgtrace_to_target,
+  bgtrace_to_host
+};
+
+/**
+ * @brief bgtrace_record_start - start recording the traffic to the file,
+ * nothing happens if it's already recording
+ *
+ * @param path - file to record to, truncated if existing
+ *
+ * @return @ref{err_t}
+ */
+err_t bgtrace_record_start(const char *path);
+
+/**
+ * @brief bgtrace_record_stop - flush and close the record file
+ */
+void bgtrace_record_stop(void);
+
+/**
+ * @brief bgtrace_record_flush - push the recorded frames to the file, called
+ * after each batch of events is dispatched so a killed session still leaves a
+ * usable trace
+ */
+void bgtrace_record_flush(void);
+
+/**
+ * @brief bgtrace_on_tx - record a frame sent to the NCP target
+ */
+void bgtrace_on_tx(uint32_t len, const uint8_t *data);
+
+/**
+ * @brief bgtrace_on_rx - record the bytes read from the NCP target, they are
+ * assembled to frames since BGLIB reads the header and the payload separately
+ */
+void bgtrace_on_rx(uint32_t len, const uint8_t *data);
+
+/**
+ * @brief bgtrace_replay_open - load a recorded session to replay, the frames
+ * from the NCP target are fed to BGLIB by the bgtrace_replay_xxx functions
+ * below instead of the UART or socket. Nothing happens if it's already loaded.
+ *
+ * @param path - recorded file
+ * @param realtime - true to deliver the frames with the recorded timing, false
+ * to deliver them as fast as the host reads
+ *
+ * @return @ref{err_t}
+ */
+err_t bgtrace_replay_open(const char *path, bool realtime);
+
+/*
+ * Implementation of the bguart_t interfaces for replaying. The commands sent
+ * by the host are only compared with the recorded ones.
+ */
+void bgtrace_replay_output(uint32_t len, uint8_t *data);
+int32_t bgtrace_replay_input(uint32_t len, uint8_t *data);
+int32_t bgtrace_replay_peek(void);
+int32_t bgtrace_replay_fd(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //BG_TRACE_H
@@ -15,13 +15,16 @@
 #include "uart.h"
 #include "socket_handler.h"
 #include "startup.h"
+#include "bg_trace.h"
 
 /* Defines  *********************************************************** */
 
 /* Global Variables *************************************************** */
 
 /* Static Variables *************************************************** */
-static bguart_t bguart = { NULL, NULL, NULL };
+static bguart_t bguart = { NULL, NULL, NULL, NULL, NULL };
+/* The real input/output when the traffic is being recorded */
+static bguart_t traced = { NULL, NULL, NULL, NULL, NULL };
 
 /* Static Functions Declaractions ************************************* */
 static void on_message_send(uint32_t msg_len, uint8_t* msg_data)
@@ -36,21 +39,65 @@ static void on_message_send(uint32_t msg_len, uint8_t* msg_data)
   }
 }
 
+static void on_message_send_traced(uint32_t msg_len, uint8_t* msg_data)
+{
+  bgtrace_on_tx(msg_len, msg_data);
+  traced.bglib_output(msg_len, msg_data);
+}
+
+static int32_t on_message_recv_traced(uint32_t msg_len, uint8_t* msg_data)
+{
+  int32_t ret = traced.bglib_input(msg_len, msg_data);
+  if (ret > 0) {
+    bgtrace_on_rx(ret, msg_data);
+  }
+  return ret;
+}
+
 void bguart_init(void)
 {
+  err_t e;
   const proj_args_t *arg = getprojargs();
   if (!arg->initialized) {
     return;
   }
 
+  if (arg->replay[0]) {
+    if (ec_success != (e = bgtrace_replay_open(arg->replay, arg->realtime))) {
+      elog(e);
+      exit(EXIT_FAILURE);
+    }
+    bguart.bglib_input = bgtrace_replay_input;
+    bguart.bglib_output = bgtrace_replay_output;
+    bguart.bglib_peek = bgtrace_replay_peek;
+    bguart.bglib_fd = bgtrace_replay_fd;
+    return;
+  }
+
   if (arg->enc) {
     bguart.bglib_input = onMessageReceive;
     bguart.bglib_output = onMessageSend;
     bguart.bglib_peek = messagePeek;
+    bguart.bglib_fd = getDomainSocketFd;
+    bguart.bglib_view = messageView;
   } else {
     bguart.bglib_input = uartRx;
     bguart.bglib_output = on_message_send;
     bguart.bglib_peek = uartRxPeek;
+    bguart.bglib_fd = uartFd;
+    bguart.bglib_view = uartRxView;
+  }
+
+  if (arg->capture[0]) {
+    if (ec_success != (e = bgtrace_record_start(arg->capture))) {
+      elog(e);
+      return;
+    }
+    traced = bguart;
+    bguart.bglib_input = on_message_recv_traced;
+    bguart.bglib_output = on_message_send_traced;
+    /* Every byte read needs to go through the trace */
+    bguart.bglib_view = NULL;
   }
 }
 
@@ -19,6 +19,9 @@ typedef struct {
   void (*bglib_output)(uint32_t len1, uint8_t * data1);
   int32_t (*bglib_input)(uint32_t len1, uint8_t* data1);
   int32_t (*bglib_peek)(void);
+  int32_t (*bglib_fd)(void);
+  /* Optional, frames the packets in the receive buffer of the input in place */
+  int32_t (*bglib_view)(uint32_t len1, uint8_t** data1);
   /* char *ser_sockpath; */
   /* char *client_sockpath; */
 }bguart_t;
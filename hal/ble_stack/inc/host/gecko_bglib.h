@@ -79,6 +79,18 @@
  *
  *       }
  *
+ *  Sending commands asynchronously:
+ *   gecko_cmd_async arms the next command helper call to return without
+ *   waiting for the response. The returned pointer then refers to a zero filled
+ *   placeholder (result == bg_err_success), the real response is delivered to
+ *   the callback from gecko_peek_event/gecko_wait_event in the order the
+ *   commands were sent. Up to BGLIB_MAX_PENDING_CMDS commands can be pending,
+ *   a synchronous command sent in between still waits for its own response.
+ *
+ *   Example:
+ *       if (!gecko_cmd_async(on_bind_rsp, ctx)) {
+ *           gecko_cmd_mesh_config_client_bind_model(...);
+ *       }
  *
  ****************************************************************************/
 
@@ -92,6 +104,66 @@
 #define BGLIB_QUEUE_LEN 30
 #endif
 
+/*
+ * Droppable events, i.e. unprovisioned beacons and scan responses, are only
+ * queued while fewer events than this are waiting, the rest of the queue is
+ * kept for the events which are never dropped
+ */
+#ifndef BGLIB_QUEUE_DROPPABLE_MAX
+#define BGLIB_QUEUE_DROPPABLE_MAX (BGLIB_QUEUE_LEN / 2)
+#endif
+
+#ifndef BGLIB_MAX_PENDING_CMDS
+#define BGLIB_MAX_PENDING_CMDS 8
+#endif
+
+/**
+ * Callback to deliver the response of an asynchronous command
+ *
+ * @param rsp response packet, only valid in the callback
+ * @param ctx context passed to gecko_cmd_async
+ */
+typedef void (*gecko_rsp_cb_t)(const struct gecko_cmd_packet *rsp, void *ctx);
+
+/**
+ * Make the next command asynchronous
+ *
+ * @param cb callback to deliver the response, NULL to disarm
+ * @param ctx context passed to the callback
+ * @return 0 if armed, -1 if the pending commands reach BGLIB_MAX_PENDING_CMDS,
+ *         the next command is sent synchronously in that case
+ */
+int gecko_cmd_async(gecko_rsp_cb_t cb, void *ctx);
+
+/**
+ * @return number of asynchronous commands whose callback is not called yet
+ */
+int gecko_cmd_pending(void);
+
+/**
+ * Drop all pending asynchronous commands without calling the callbacks, e.g.
+ * when the target is reset
+ */
+void gecko_cmd_async_reset(void);
+
+/**
+ * Statistics of the event queue
+ */
+struct gecko_queue_stat {
+  uint32_t dropped;    /**< droppable events dropped for no room */
+  uint32_t coalesced;  /**< unprovisioned beacons merged into the queued one of the same UUID */
+  uint32_t overflowed; /**< events queued in the overflow area since the queue is full */
+  uint32_t lost;       /**< events dropped since the overflow area can't grow, SHOULD be 0 */
+  uint32_t peak;       /**< most events waiting at the same time */
+};
+
+/**
+ * Get the statistics of the event queue
+ *
+ * @param s filled with the statistics
+ */
+void gecko_queue_stat_get(struct gecko_queue_stat *s);
+
 #define BGLIB_DEFINE()                                      \
   struct gecko_cmd_packet _gecko_cmd_msg;                   \
   struct gecko_cmd_packet _gecko_rsp_msg;                   \
@@ -100,6 +172,7 @@
   void (*bglib_output)(uint32_t len1, uint8_t* data1);      \
   int32_t (*bglib_input)(uint32_t len1, uint8_t* data1);    \
   int32_t (*bglib_peek)(void);                              \
+  int32_t (*bglib_view)(uint32_t len1, uint8_t** data1);    \
   struct gecko_cmd_packet gecko_queue[BGLIB_QUEUE_LEN];     \
   int    gecko_queue_w = 0;                                 \
   int    gecko_queue_r = 0;
@@ -113,7 +186,7 @@ extern int    gecko_queue_r;
  * @param OFUNC
  * @param IFUNC
  */
-#define BGLIB_INITIALIZE(OFUNC, IFUNC) bglib_output = OFUNC; bglib_input = IFUNC; bglib_peek = NULL;
+#define BGLIB_INITIALIZE(OFUNC, IFUNC) bglib_output = OFUNC; bglib_input = IFUNC; bglib_peek = NULL; bglib_view = NULL;
 
 /**
  * Initialize BGLIB to support nonblocking mode
@@ -121,10 +194,20 @@ extern int    gecko_queue_r;
  * @param IFUNC
  * @param PFUNC peek function to check if there is data to be read from UART
  */
-#define BGLIB_INITIALIZE_NONBLOCK(OFUNC, IFUNC, PFUNC) bglib_output = OFUNC; bglib_input = IFUNC; bglib_peek = PFUNC;
+#define BGLIB_INITIALIZE_NONBLOCK(OFUNC, IFUNC, PFUNC) bglib_output = OFUNC; bglib_input = IFUNC; bglib_peek = PFUNC; bglib_view = NULL;
+
+/**
+ * Let BGLIB frame the packets in the receive buffer of the input in place,
+ * MUST be called after BGLIB_INITIALIZE or BGLIB_INITIALIZE_NONBLOCK
+ * @param VFUNC view function, consumes len1 bytes and points data1 to them,
+ *        the data is valid until the next call of any input function.
+ *        NULL to read with the input function
+ */
+#define BGLIB_INITIALIZE_VIEW(VFUNC) bglib_view = VFUNC;
 
 extern void(*bglib_output)(uint32_t len1, uint8_t* data1);
 extern int32_t (*bglib_input)(uint32_t len1, uint8_t* data1);
 extern int32_t(*bglib_peek)(void);
+extern int32_t (*bglib_view)(uint32_t len1, uint8_t** data1);
 
 #endif
@@ -14,21 +14,199 @@
  *
  ******************************************************************************/
 
+#include <stdlib.h>
+#include <string.h>
 #include "gecko_bglib.h"
 
+#define PENDING_NEXT(x) (((x) + 1) % (BGLIB_MAX_PENDING_CMDS + 1))
+#define QUEUE_NEXT(x) (((x) + 1) % BGLIB_QUEUE_LEN)
+#define QUEUE_USED() ((gecko_queue_w + BGLIB_QUEUE_LEN - gecko_queue_r) % BGLIB_QUEUE_LEN)
+
+/*
+ * Asynchronous commands in the order they were sent
+ *   [pending_r, pending_a) - response received, callback not called yet
+ *   [pending_a, pending_w) - waiting for response
+ */
+static struct {
+  gecko_rsp_cb_t cb;
+  void *ctx;
+  struct gecko_cmd_packet rsp;
+} pendings[BGLIB_MAX_PENDING_CMDS + 1];
+static int pending_r = 0;
+static int pending_a = 0;
+static int pending_w = 0;
+
+static gecko_rsp_cb_t armed_cb = NULL;
+static void *armed_ctx = NULL;
+
+/*
+ * Events which are never dropped go here in order when gecko_queue is full,
+ * they are moved to gecko_queue as soon as it has room
+ */
+static struct {
+  struct gecko_cmd_packet *pcks;
+  int cap;
+  int r;
+  int n;
+} ovf;
+
+static struct gecko_queue_stat qstat;
+
+int gecko_cmd_async(gecko_rsp_cb_t cb, void *ctx)
+{
+  if (cb && PENDING_NEXT(pending_w) == pending_r) {
+    armed_cb = NULL;
+    return -1;
+  }
+  armed_cb = cb;
+  armed_ctx = ctx;
+  return 0;
+}
+
+int gecko_cmd_pending(void)
+{
+  return (pending_w + BGLIB_MAX_PENDING_CMDS + 1 - pending_r) % (BGLIB_MAX_PENDING_CMDS + 1);
+}
+
+void gecko_cmd_async_reset(void)
+{
+  armed_cb = NULL;
+  pending_r = pending_a = pending_w = 0;
+}
+
+static void gecko_dispatch_responses(void)
+{
+  gecko_rsp_cb_t cb;
+  void *ctx;
+  struct gecko_cmd_packet rsp;
+
+  while (pending_r != pending_a) {
+    /* Copy out first, the callback may send more commands */
+    cb = pendings[pending_r].cb;
+    ctx = pendings[pending_r].ctx;
+    memcpy(&rsp, &pendings[pending_r].rsp, sizeof(struct gecko_cmd_packet));
+    pending_r = PENDING_NEXT(pending_r);
+    cb(&rsp, ctx);
+  }
+}
+
+/*
+ * Read len bytes of the packet, in place if the input has a receive buffer,
+ * the data is copied to dst if it's not NULL
+ */
+static int gecko_read(uint32_t len, uint8_t *dst, uint8_t *tmp)
+{
+  uint8_t *p;
+
+  if (!bglib_view) {
+    return bglib_input(len, dst ? dst : tmp);
+  }
+  if (bglib_view(len, &p) < 0) {
+    return -1;
+  }
+  if (dst) {
+    memcpy(dst, p, len);
+  }
+  return len;
+}
+
+static int gecko_evt_droppable(uint32_t header)
+{
+  switch (BGLIB_MSG_ID(header)) {
+    case gecko_evt_mesh_prov_unprov_beacon_id:
+    case gecko_evt_le_gap_scan_response_id:
+    case gecko_evt_le_gap_extended_scan_response_id:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static void gecko_queue_peak(void)
+{
+  uint32_t used = QUEUE_USED() + ovf.n;
+  if (used > qstat.peak) {
+    qstat.peak = used;
+  }
+}
+
+//queued unprovisioned beacon from the same device, NULL if none
+static struct gecko_cmd_packet *gecko_queue_find_beacon(const struct gecko_cmd_packet *pck)
+{
+  const uint8array *uuid = &pck->data.evt_mesh_prov_unprov_beacon.uuid, *u;
+
+  for (int i = gecko_queue_r; i != gecko_queue_w; i = QUEUE_NEXT(i)) {
+    if (BGLIB_MSG_ID(gecko_queue[i].header) != gecko_evt_mesh_prov_unprov_beacon_id) {
+      continue;
+    }
+    u = &gecko_queue[i].data.evt_mesh_prov_unprov_beacon.uuid;
+    if (u->len == uuid->len && !memcmp(u->data, uuid->data, u->len)) {
+      return &gecko_queue[i];
+    }
+  }
+  return NULL;
+}
+
+//slot for the event which is never dropped, NULL if no memory
+static struct gecko_cmd_packet *gecko_queue_slot(void)
+{
+  struct gecko_cmd_packet *pck;
+  int cap, w;
+
+  if (!ovf.n && QUEUE_NEXT(gecko_queue_w) != gecko_queue_r) {
+    pck = &gecko_queue[gecko_queue_w];
+    gecko_queue_w = QUEUE_NEXT(gecko_queue_w);
+    return pck;
+  }
+  if (ovf.n == ovf.cap) {
+    cap = ovf.cap ? ovf.cap * 2 : BGLIB_QUEUE_LEN;
+    pck = realloc(ovf.pcks, cap * sizeof(struct gecko_cmd_packet));
+    if (!pck) {
+      return NULL;
+    }
+    //unwrap the packets at the front to the new room
+    for (int i = 0; i < ovf.r + ovf.n - ovf.cap; i++) {
+      memcpy(&pck[ovf.cap + i], &pck[i], sizeof(struct gecko_cmd_packet));
+    }
+    ovf.pcks = pck;
+    ovf.cap = cap;
+  }
+  w = (ovf.r + ovf.n) % ovf.cap;
+  ovf.n++;
+  qstat.overflowed++;
+  return &ovf.pcks[w];
+}
+
+//move the oldest overflowed event to gecko_queue if it has room
+static void gecko_queue_refill(void)
+{
+  if (!ovf.n || QUEUE_NEXT(gecko_queue_w) == gecko_queue_r) {
+    return;
+  }
+  memcpy(&gecko_queue[gecko_queue_w], &ovf.pcks[ovf.r], sizeof(struct gecko_cmd_packet));
+  gecko_queue_w = QUEUE_NEXT(gecko_queue_w);
+  ovf.r = (ovf.r + 1) % ovf.cap;
+  ovf.n--;
+}
+
+void gecko_queue_stat_get(struct gecko_queue_stat *s)
+{
+  memcpy(s, &qstat, sizeof(struct gecko_queue_stat));
+}
+
 struct gecko_cmd_packet* gecko_wait_message(void)//wait for event from system
 {
   uint32_t msg_length;
   uint32_t header;
   uint8_t  *payload;
-  struct gecko_cmd_packet *pck, *retVal = NULL;
-  int      ret;
+  struct gecko_cmd_packet *pck, *retVal = NULL, evt;
+  int      ret, async = 0, droppable = 0;
   //sync to header byte
-  ret = bglib_input(1, (uint8_t*)&header);
+  ret = gecko_read(1, (uint8_t*)&header, NULL);
   if (ret < 0 || (header & 0x78) != gecko_dev_type_gecko) {
     return 0;
   }
-  ret = bglib_input(BGLIB_MSG_HEADER_LEN - 1, &((uint8_t*)&header)[1]);
+  ret = gecko_read(BGLIB_MSG_HEADER_LEN - 1, &((uint8_t*)&header)[1], NULL);
   if (ret < 0) {
     return 0;
   }
@@ -41,18 +219,26 @@ struct gecko_cmd_packet* gecko_wait_message(void)//wait for event from system
 
   if ((header & 0xf8) == (gecko_dev_type_gecko | gecko_msg_type_evt)) {
     //received event
-    if ((gecko_queue_w + 1) % BGLIB_QUEUE_LEN == gecko_queue_r) {
+    if ((droppable = gecko_evt_droppable(header))) {
+      //decided after the payload is read
+      pck = &evt;
+    } else if (NULL == (pck = gecko_queue_slot())) {
       //drop packet
       if (msg_length) {
         uint8_t tmp_payload[BGLIB_MSG_MAX_PAYLOAD];
-        bglib_input(msg_length, tmp_payload);
+        gecko_read(msg_length, NULL, tmp_payload);
       }
+      qstat.lost++;
       return 0;      //NO ROOM IN QUEUE
     }
-    pck = &gecko_queue[gecko_queue_w];
-    gecko_queue_w = (gecko_queue_w + 1) % BGLIB_QUEUE_LEN;
   } else if ((header & 0xf8) == gecko_dev_type_gecko) {//response
-    retVal = pck = gecko_rsp_msg;
+    if (pending_a != pending_w) {
+      //responses come in the same order as commands, the oldest pending one
+      async = 1;
+      pck = &pendings[pending_a].rsp;
+    } else {
+      retVal = pck = gecko_rsp_msg;
+    }
   } else {
     //fail
     return 0;
@@ -63,11 +249,30 @@ struct gecko_cmd_packet* gecko_wait_message(void)//wait for event from system
    * Read the payload data if required and store it after the header.
    */
   if (msg_length) {
-    ret = bglib_input(msg_length, payload);
+    ret = gecko_read(msg_length, payload, NULL);
     if (ret < 0) {
       return 0;
     }
   }
+  if (async) {
+    pending_a = PENDING_NEXT(pending_a);
+  }
+  if (droppable) {
+    if (BGLIB_MSG_ID(header) == gecko_evt_mesh_prov_unprov_beacon_id
+        && (pck = gecko_queue_find_beacon(&evt))) {
+      qstat.coalesced++;
+    } else if (!ovf.n && QUEUE_USED() < BGLIB_QUEUE_DROPPABLE_MAX) {
+      pck = &gecko_queue[gecko_queue_w];
+      gecko_queue_w = QUEUE_NEXT(gecko_queue_w);
+    } else {
+      qstat.dropped++;
+      return 0;      //NO ROOM IN QUEUE
+    }
+    memcpy(pck, &evt, sizeof(struct gecko_cmd_packet));
+  }
+  if ((header & 0xf8) == (gecko_dev_type_gecko | gecko_msg_type_evt)) {
+    gecko_queue_peak();
+  }
 
   // Using retVal avoid double handling of event msg types in outer function
   return retVal;
@@ -79,6 +284,10 @@ int gecko_event_pending(void)
     return 1;
   }
 
+  if (pending_r != pending_a) {//response of asynchronous command to deliver
+    return 1;
+  }
+
   //something in uart waiting to be read
   if (bglib_peek && bglib_peek()) {
     return 1;
@@ -92,9 +301,11 @@ struct gecko_cmd_packet* gecko_get_event(int block)
   struct gecko_cmd_packet* p;
 
   while (1) {
+    gecko_dispatch_responses();
     if (gecko_queue_w != gecko_queue_r) {
       p = &gecko_queue[gecko_queue_r];
-      gecko_queue_r = (gecko_queue_r + 1) % BGLIB_QUEUE_LEN;
+      gecko_queue_r = QUEUE_NEXT(gecko_queue_r);
+      gecko_queue_refill();
       return p;
     }
     //if not blocking and nothing in uart -> out
@@ -132,6 +343,16 @@ struct gecko_cmd_packet* gecko_wait_response(void)
 
 void gecko_handle_command(uint32_t hdr, void* data)
 {
+  if (armed_cb) {
+    pendings[pending_w].cb = armed_cb;
+    pendings[pending_w].ctx = armed_ctx;
+    pending_w = PENDING_NEXT(pending_w);
+    armed_cb = NULL;
+    bglib_output(BGLIB_MSG_HEADER_LEN + BGLIB_MSG_LEN(gecko_cmd_msg->header), (uint8_t*)gecko_cmd_msg);
+    //placeholder for the caller, the real response goes to the callback
+    memset(&gecko_rsp_msg->data, 0, sizeof(gecko_rsp_msg->data));
+    return;
+  }
   //packet in gecko_cmd_msg is waiting for output
   bglib_output(BGLIB_MSG_HEADER_LEN + BGLIB_MSG_LEN(gecko_cmd_msg->header), (uint8_t*)gecko_cmd_msg);
   gecko_wait_response();
@@ -66,6 +66,16 @@ int32_t uartClose(void);
  **************************************************************************************************/
 int32_t uartRx(uint32_t dataLength, uint8_t* data);
 
+/***********************************************************************************************//**
+ *  \brief  Blocking read data from serial port without copying. The function will block until the
+ *          desired amount is in the receive buffer or an error occurs.
+ *  \note  The data is consumed, the pointer is only valid until the next read from serial port.
+ *  \param[in]  dataLength The amount of bytes to read, up to half of the receive buffer.
+ *  \param[out]  data Set to the data in the receive buffer.
+ *  \return  The amount of bytes read or -1 on failure.
+ **************************************************************************************************/
+int32_t uartRxView(uint32_t dataLength, uint8_t** data);
+
 /***********************************************************************************************//**
  *  \brief  Non-blocking read from serial port.
  *  \note  A truly non-blocking operation is possible only if uartOpen() is called with timeout
@@ -78,7 +88,7 @@ int32_t uartRx(uint32_t dataLength, uint8_t* data);
 int32_t uartRxNonBlocking(uint32_t dataLength, uint8_t* data);
 
 /***********************************************************************************************//**
- *  \brief  Return the number of bytes in the input buffer.
+ *  \brief  Return the number of bytes in the input buffer, the receive buffer of the driver first.
  *  \return  The number of bytes in the input buffer or -1 on failure.
  **************************************************************************************************/
 int32_t uartRxPeek(void);
@@ -92,6 +102,12 @@ int32_t uartRxPeek(void);
  **************************************************************************************************/
 int32_t uartTx(uint32_t dataLength, uint8_t* data);
 
+/***********************************************************************************************//**
+ *  \brief  Return the file descriptor of the opened serial port, used to wait for the readiness.
+ *  \return  The file descriptor or -1 if the serial port is not opened.
+ **************************************************************************************************/
+int32_t uartFd(void);
+
 /** @} (end addtogroup uart) */
 /** @} (end addtogroup platform_hw) */
 
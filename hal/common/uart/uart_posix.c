@@ -53,6 +53,16 @@ static struct {
 static int32_t serialHandle = -1;
 static struct termios origTTYAttrs;
 
+/** Size of the receive buffer, a few BGAPI packets of the maximum length. */
+#define RX_BUF_SIZE 4096
+
+/** Receive buffer, the bytes in [head, tail) are read from the port but not consumed yet. */
+static struct {
+  uint8_t data[RX_BUF_SIZE];
+  uint32_t head;
+  uint32_t tail;
+} rxBuf;
+
 /***************************************************************************************************
  * Static Function Declarations
  **************************************************************************************************/
@@ -60,6 +70,7 @@ static int32_t uartOpenSerial(int8_t* device, uint32_t bps, uint32_t dataBits, u
                               uint32_t stopBits, uint32_t rtsCts, uint32_t xOnXOff,
                               int32_t timeout);
 static int32_t uartCloseSerial(int32_t handle);
+static int32_t uartRxFill(void);
 
 /***************************************************************************************************
    Public Function Definitions
@@ -78,6 +89,7 @@ int32_t uartOpen(int8_t* port, uint32_t baudRate, uint32_t rtsCts, int32_t timeo
   usleep(50000);
   while (uartRxNonBlocking(4, buf) == 4) {
   }
+  rxBuf.head = rxBuf.tail = 0;
 
   return 0;
 }
@@ -87,42 +99,75 @@ int32_t uartClose(void)
   if (serialHandle == -1) {
     return 0;
   }
+  rxBuf.head = rxBuf.tail = 0;
   return uartCloseSerial(serialHandle);
 }
 
 int32_t uartRx(uint32_t dataLength, uint8_t* data)
 {
-  /** The amount of bytes read. */
-  size_t dataRead;
+  /** The amount of bytes copied from the receive buffer. */
+  uint32_t dataRead;
   /** The amount of bytes still needed to be read. */
-  size_t dataToRead = dataLength;
+  uint32_t dataToRead = dataLength;
 
   if (serialHandle == -1) {
     return -1;
   }
 
   while (dataToRead) {
-    dataRead = read(serialHandle, (void*)data, dataToRead);
-    if (-1 == dataRead) {
+    if (rxBuf.head == rxBuf.tail && -1 == uartRxFill()) {
       return -1;
-    } else {
-      dataToRead -= dataRead;
-      data += dataRead;
     }
+    dataRead = rxBuf.tail - rxBuf.head;
+    if (dataRead > dataToRead) {
+      dataRead = dataToRead;
+    }
+    memcpy(data, &rxBuf.data[rxBuf.head], dataRead);
+    rxBuf.head += dataRead;
+    dataToRead -= dataRead;
+    data += dataRead;
   }
 
   return (int32_t)dataLength;
 }
 
+int32_t uartRxView(uint32_t dataLength, uint8_t** data)
+{
+  if (serialHandle == -1 || dataLength > RX_BUF_SIZE / 2) {
+    return -1;
+  }
+
+  while (rxBuf.tail - rxBuf.head < dataLength) {
+    if (-1 == uartRxFill()) {
+      return -1;
+    }
+  }
+
+  *data = &rxBuf.data[rxBuf.head];
+  rxBuf.head += dataLength;
+
+  return (int32_t)dataLength;
+}
+
 int32_t uartRxNonBlocking(uint32_t dataLength, uint8_t* data)
 {
   /** The amount of bytes read. */
-  size_t dataRead;
+  ssize_t dataRead;
 
   if (serialHandle == -1) {
     return -1;
   }
 
+  if (rxBuf.head != rxBuf.tail) {
+    dataRead = rxBuf.tail - rxBuf.head;
+    if (dataRead > (ssize_t)dataLength) {
+      dataRead = dataLength;
+    }
+    memcpy(data, &rxBuf.data[rxBuf.head], dataRead);
+    rxBuf.head += dataRead;
+    return (int32_t)dataRead;
+  }
+
   dataRead = read(serialHandle, (void*)data, (size_t)dataLength);
   if (-1 == dataRead) {
     return -1;
@@ -139,6 +184,10 @@ int32_t uartRxPeek(void)
     return -1;
   }
 
+  if (rxBuf.head != rxBuf.tail) {
+    return (int32_t)(rxBuf.tail - rxBuf.head);
+  }
+
   if (-1 == ioctl(serialHandle, FIONREAD, (int*)&bytesInBuf)) {
     return -1;
   }
@@ -146,6 +195,11 @@ int32_t uartRxPeek(void)
   return bytesInBuf;
 }
 
+int32_t uartFd(void)
+{
+  return serialHandle;
+}
+
 int32_t uartTx(uint32_t dataLength, uint8_t* data)
 {
   /** The amount of bytes written. */
@@ -367,6 +421,35 @@ static int32_t uartOpenSerial(int8_t* device, uint32_t bps, uint32_t dataBits, u
   return -1;
 }
 
+/***********************************************************************************************//**
+ *  \brief  Read as many bytes as the port has into the receive buffer with a single read(). The
+ *          unconsumed bytes are moved to the start of the buffer first once they are in the
+ *          second half, so that at least RX_BUF_SIZE / 2 bytes from the head are contiguous.
+ *  \return  The amount of bytes read or -1 on failure.
+ **************************************************************************************************/
+static int32_t uartRxFill(void)
+{
+  ssize_t dataRead;
+
+  if (rxBuf.head == rxBuf.tail) {
+    rxBuf.head = rxBuf.tail = 0;
+  } else if (rxBuf.head >= RX_BUF_SIZE / 2) {
+    memmove(rxBuf.data, &rxBuf.data[rxBuf.head], rxBuf.tail - rxBuf.head);
+    rxBuf.tail -= rxBuf.head;
+    rxBuf.head = 0;
+  }
+
+  do {
+    dataRead = read(serialHandle, (void*)&rxBuf.data[rxBuf.tail], RX_BUF_SIZE - rxBuf.tail);
+  } while (-1 == dataRead && EINTR == errno);
+  if (-1 == dataRead) {
+    return -1;
+  }
+  rxBuf.tail += dataRead;
+
+  return (int32_t)dataRead;
+}
+
 /* Close a serial port. Return 0 on success, -1 on failure. */
 static int32_t uartCloseSerial(int32_t handle)
 {
@@ -30,6 +30,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <sys/un.h>
+#include <fcntl.h>
 #include <poll.h>
 #include "socket_handler.h"
 
@@ -37,13 +38,18 @@ static int enc_client_socket = -1;
 static int unenc_client_socket = -1;
 static bool encrypted = false;
 
-static uint8_t buf[MAX_PACKET_SIZE];
-static uint8_t* bufPointer;
-static uint8_t unhandledDataSize;
+/* Stream buffer, the bytes in [head, tail) are received but not consumed yet */
+static struct {
+  uint8_t data[MAX_PACKET_SIZE];
+  uint32_t head;
+  uint32_t tail;
+} rx;
 
-static struct pollfd pollStruct;
+/* The domain socket connected last, which the data is received from */
+static int rx_socket = -1;
 
-static int readDomainSocket(int fd, int revents);
+static int readDomainSocket(void);
+static int waitDomainSocket(uint32_t len);
 
 int connect_domain_socket_server(char *fnameServer, char *fnameClient, int encrypted)
 {
@@ -93,10 +99,16 @@ int connect_domain_socket_server(char *fnameServer, char *fnameClient, int encry
     return -1;
   }
 
-  /* Update poll structure with client domain socket file descriptor */
-  pollStruct.fd = *client_socket;
-  pollStruct.events = POLLIN;
-  pollStruct.revents = 0;
+  /* The stream is drained until EAGAIN, it never blocks the caller */
+  rc = fcntl(*client_socket, F_GETFL, 0);
+  if (rc == -1 || fcntl(*client_socket, F_SETFL, rc | O_NONBLOCK) == -1) {
+    printf("FCNTL ERROR = %d\n", errno);
+    close(*client_socket);
+    return -1;
+  }
+
+  rx_socket = *client_socket;
+  rx.head = rx.tail = 0;
 
   return 0;
 }
@@ -112,27 +124,35 @@ void onMessageSend(uint32_t msg_len, uint8_t* msg_data)
 
 int32_t onMessageReceive(uint32_t msg_len, uint8_t* msg_data)
 {
-  poll_update(50);
-
-  if (unhandledDataSize > 0) {
-    if (unhandledDataSize >= msg_len) {
-      unhandledDataSize -= msg_len;
-      for (int i = 0; i < msg_len; i++) {
-        *(msg_data + i) = *bufPointer;
-        bufPointer++;
-      }
-      return msg_len;
-    } else {
-      unhandledDataSize = 0;
-      return -1;
-    }
+  if (waitDomainSocket(msg_len) < 0) {
+    return -1;
+  }
+  memcpy(msg_data, &rx.data[rx.head], msg_len);
+  rx.head += msg_len;
+  return msg_len;
+}
+
+int32_t messageView(uint32_t msg_len, uint8_t** msg_data)
+{
+  if (waitDomainSocket(msg_len) < 0) {
+    return -1;
   }
-  return -1;
+  *msg_data = &rx.data[rx.head];
+  rx.head += msg_len;
+  return msg_len;
 }
 
 int32_t messagePeek()
 {
-  return unhandledDataSize > 0;
+  if (rx.head == rx.tail) {
+    readDomainSocket();
+  }
+  return rx.tail - rx.head;
+}
+
+int32_t getDomainSocketFd(void)
+{
+  return encrypted ? enc_client_socket : unenc_client_socket;
 }
 
 void turnEncryptionOn(void)
@@ -145,39 +165,68 @@ void turnEncryptionOff(void)
   encrypted = false;
 }
 
-void poll_update(int timeout)
+//receive all the data the socket has, until the buffer is full or EAGAIN
+static int readDomainSocket(void)
 {
-  poll(&pollStruct, 1, timeout == 0 ? -1 : timeout);
-  if (pollStruct.revents != 0) {
-    readDomainSocket(pollStruct.fd, pollStruct.revents);
-  }
-}
+  int len, total = 0;
 
-//this callback is called when file descriptor has an event
-static int readDomainSocket(int fd, int revents)
-{
-  if ((!unhandledDataSize) && ((revents & POLLIN) && ((fd == enc_client_socket) || (fd == unenc_client_socket)))) {
-    //receive data after the packet
-    bufPointer = buf;
-    int len = recv(fd, buf, sizeof(buf), 0);
+  if (rx_socket < 0) {
+    return -1;
+  }
+  if (rx.head == rx.tail) {
+    rx.head = rx.tail = 0;
+  } else if (rx.head) {
+    //keep the unconsumed data contiguous at the start
+    memmove(rx.data, &rx.data[rx.head], rx.tail - rx.head);
+    rx.tail -= rx.head;
+    rx.head = 0;
+  }
 
+  while (rx.tail < sizeof(rx.data)) {
+    len = recv(rx_socket, &rx.data[rx.tail], sizeof(rx.data) - rx.tail, 0);
     if (len == 0) {
       //socket closed
       printf("Host unencrypted disconnected\n");
-      close(fd);
-      if (fd == enc_client_socket) {
+      close(rx_socket);
+      if (rx_socket == enc_client_socket) {
         enc_client_socket = -1;
       } else {
         unenc_client_socket = -1;
       }
-      unhandledDataSize = 0;
+      rx_socket = -1;
       return -1;
     } else if (len < 0) {
-      unhandledDataSize = 0;
-      return 0;
-    } else {
-      unhandledDataSize = len;
-      return len;
+      if (errno == EINTR) {
+        continue;
+      }
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? total : -1;
+    }
+    rx.tail += len;
+    total += len;
+  }
+  return total;
+}
+
+//block until len bytes are in the buffer
+static int waitDomainSocket(uint32_t len)
+{
+  struct pollfd pfd;
+
+  if (len > sizeof(rx.data)) {
+    return -1;
+  }
+  while (rx.tail - rx.head < len) {
+    if (readDomainSocket() < 0) {
+      return -1;
+    }
+    if (rx.tail - rx.head >= len) {
+      break;
+    }
+    pfd.fd = rx_socket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+      return -1;
     }
   }
   return 0;
@@ -18,8 +18,8 @@
 #ifndef SOCKET_HANDLER_H
 #define SOCKET_HANDLER_H
 
-/* Max number of bytes in receive buffer */
-#define MAX_PACKET_SIZE 512
+/* Max number of bytes in receive buffer, a few BGAPI packets of the maximum length */
+#define MAX_PACKET_SIZE 4096
 
 /**
  * Function to connect to a server domain socket.
@@ -38,18 +38,34 @@ int connect_domain_socket_server(char *fnameServer, char *fnameClient, int encry
 void onMessageSend(uint32_t msg_len, uint8_t* msg_data);
 
 /**
- * Function to be called when a BGAPI message is to be received from a domain socket.
+ * Function to be called when a BGAPI message is to be received from a domain socket, blocks
+ * until the bytes are received.
  * @param msg_len Name Number of bytes to received.
  * @param msg_data Pointer to bytes to receive.
+ *  \return  msg_len on success, -1 on failure.
  */
 int32_t onMessageReceive(uint32_t msg_len, uint8_t* msg_data);
 
 /**
- * Function to determine whether there is new data in a socket.
- *  \return  0 if there is no data, any other value indicates the number of sockets with new data
+ * Same as onMessageReceive, but without copying.
+ * @param msg_len Name Number of bytes to received.
+ * @param msg_data Set to the bytes in the receive buffer, valid until the next receive.
+ *  \return  msg_len on success, -1 on failure.
+ */
+int32_t messageView(uint32_t msg_len, uint8_t** msg_data);
+
+/**
+ * Function to determine whether there is new data in a socket, never blocks.
+ *  \return  number of bytes received but not read yet, 0 if there is no data
  */
 int32_t messagePeek(void);
 
+/**
+ * Function to get the file descriptor of the connected domain socket.
+ *  \return  the file descriptor, -1 if not connected
+ */
+int32_t getDomainSocketFd(void);
+
 /**
  * Function to turn on encryption.
  *  \return  0 if there is no data, any other value indicates the number of sockets with new data
@@ -62,10 +78,4 @@ void turnEncryptionOn(void);
  */
 void turnEncryptionOff(void);
 
-/**
- * Function to read data from the domain socket if there is any.
- * @param timeout timeout to wait for data to become available, if there isn't any.
- */
-void poll_update(int timeout);
-
 #endif
@@ -36,6 +36,10 @@ extern "C"
 #define STR_TIMEOUT                       "Config Timeout"
 #define STR_TIMEOUT_NORMAL                "Normal"
 #define STR_TIMEOUT_LPN                   "LPN"
+#define STR_NCP_LIMITS                    "NCP Limits"
+#define STR_CONFIG_NODES                  "Config Nodes"
+#define STR_LPN_NODES                     "LPN Nodes"
+#define STR_PROV_SESSIONS                 "Prov Sessions"
 
 /*
  * String keys only in the network & nodes config file
@@ -59,6 +63,10 @@ extern "C"
 #define STR_BIND                          "Bind Appkeys"
 #define STR_SUB                           "Subscribe from"
 #define STR_PERIOD                        "Period"
+#define STR_PRODUCT                       "Product"
+#define STR_CID                           "CID"
+#define STR_PID                           "PID"
+#define STR_VID                           "VID"
 
 /*
  * String keys only in the network & nodes config file
@@ -48,6 +48,29 @@ typedef struct {
   uint32_t lpn;
 }timeout_t;
 
+/*
+ * Capacities of the NCP target firmware, the counterpart of the memory
+ * configuration on the target side
+ */
+typedef struct {
+  /* Ceiling of the concurrent config/rm caches, MAX_FOUNDATION_CLIENT_CMDS */
+  uint8_t config_nodes;
+  /* Caches reserved for the Low Power Nodes, on top of config_nodes */
+  uint8_t lpn_nodes;
+  /* Concurrent provisioning sessions, MAX_PROV_SESSIONS */
+  uint8_t prov_sessions;
+}ncp_limits_t;
+
+/*
+ * Identity of the product, DCD page 0 of the nodes with the same identity are
+ * expected to be identical
+ */
+typedef struct {
+  uint16_t cid;
+  uint16_t pid;
+  uint16_t vid;
+}product_t;
+
 typedef struct publication{
   uint16_t addr;
   uint16_t aki;
@@ -86,6 +109,7 @@ typedef struct {
   uint16list_t *bindings;
   uint16list_t *sublist;
   features_t features;
+  product_t *product;
 } tmpl_t;
 
 typedef struct {
@@ -96,8 +120,26 @@ typedef struct {
   publication_t *pub;
   uint16list_t *bindings;
   uint16list_t *sublist;
+  product_t *product;
 }mesh_config_t;
 
+/* Bits of cfg_delta_t.what */
+#define DELTA_PUB_BIT (1UL << 0)
+#define DELTA_SUB_BIT (1UL << 1)
+#define DELTA_FEATURES_BIT  (1UL << 2)
+
+/*
+ * Changes in the node configuration file against the configuration last
+ * applied to a configured node, only these are sent to the node. The changed
+ * features are left pending in {features} of the node configuration.
+ */
+typedef struct {
+  uint8_t what;
+  /* Subscription addresses to add and to remove, NULL if none */
+  uint16list_t *sub_add;
+  uint16list_t *sub_rm;
+}cfg_delta_t;
+
 /**
  * @brief Node structure, all the configuration of a node will be loaded to the
  * structure, all fields with pointer type are optional to present, the others
@@ -111,6 +153,10 @@ typedef struct {
   lbitmap_t err;
   uint8_t *tmpl;
   mesh_config_t config;
+  /* Configuration last applied to the node, NULL if not known */
+  mesh_config_t *applied;
+  /* Pending incremental reconfiguration, NULL if none */
+  cfg_delta_t *delta;
   struct {
     /* enum value - see {CTL_SV_BIT} */
     uint8_t func;
@@ -150,13 +196,41 @@ typedef struct {
   uint8_t *ttl;
   txparam_t *net_txp;
   timeout_t *timeout;
+  ncp_limits_t *limits;
 }provcfg_t;
 
+/*
+ * Provisioned nodes, {slots} is indexed by the unicast address directly and
+ * {idx} keeps the addresses in use in ascending order for the traversal
+ */
+typedef struct {
+  node_t **slots;
+  uint16_t *idx;
+  int num;
+  int cap;
+}nodetab_t;
+
+typedef struct {
+  uint32_t hash;
+  node_t *n;
+}uuidslot_t;
+
+/*
+ * Devices keyed by UUID, open addressing with linear probing, {used} counts
+ * the deleted slots as well
+ */
+typedef struct {
+  uuidslot_t *slots;
+  int cap;
+  int num;
+  int used;
+}uuidtab_t;
+
 typedef struct {
   GTree *templates;
-  GTree *unprov_devs;
-  GTree *nodes;
-  GTree *backlog;
+  uuidtab_t unprov_devs;
+  nodetab_t nodes;
+  uuidtab_t backlog;
   /* TODO: Below 2 lists are not used yet */
   /* Ideas are to keep them as "set" and add node list to each group entry */
   GList *pubgroups;
@@ -235,6 +309,29 @@ err_t cfgdb_tmpl_remove(tmpl_t *n);
 
 provcfg_t *get_provcfg(void);
 
+/**
+ * @brief cfgdb_node_applied_set - the node is configured, keep a copy of its
+ * configuration as the base of the later incremental reconfigurations, the
+ * pending delta is dropped
+ *
+ * @param n - the node
+ */
+void cfgdb_node_applied_set(node_t *n);
+
+/**
+ * @brief cfgdb_node_applied_clr - forget the configuration applied to the
+ * node and the pending delta, e.g. the node is removed, or it needs to be
+ * configured from scratch
+ *
+ * @param n - the node
+ */
+void cfgdb_node_applied_clr(node_t *n);
+
+/**
+ * @brief cfgdb_delta_free - free the pending delta of the node
+ */
+void cfgdb_delta_free(node_t *n);
+
 void cfg_load_mnglists(GTraverseFunc func);
 
 /**
@@ -253,6 +350,15 @@ uint16list_t *get_node_addrs(void);
  * @return list of nodes, or NULL if empty
  */
 uint16list_t *get_lights_addrs(uint8_t func);
+
+/**
+ * @brief cfgdb_nodes_foreach - traverse the provisioned nodes with the read
+ * lock held, {func} MUST NOT modify the database.
+ *
+ * @param func - called with key = address, value = node_t
+ * @param data - user data
+ */
+void cfgdb_nodes_foreach(GTraverseFunc func, gpointer data);
 #ifdef __cplusplus
 }
 #endif
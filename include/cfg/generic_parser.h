@@ -119,6 +119,12 @@ err_t nodes_bl(uint16_t addr);
 const char *nodeget_cfgstr(uint16_t addr);
 err_t nodes_rmall(void);
 err_t nodes_rmblclr(void);
+/*
+ * The pending node mutations are fsync'd when nodes_sync_due() comes, 0 if
+ * nothing is pending
+ */
+uint64_t nodes_sync_due(void);
+err_t nodes_sync(void);
 #ifdef __cplusplus
 }
 #endif
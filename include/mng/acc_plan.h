@@ -0,0 +1,113 @@
+/*************************************************************************
+    > File Name: acc_plan.h
+    > Author: Kevin
+    > Created Time: 2020-02-20
+    > Description:
+ ************************************************************************/
+
+#ifndef ACC_PLAN_H
+#define ACC_PLAN_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "mng.h"
+
+typedef enum {
+  plan_bind_em,
+  plan_pub_em,
+  plan_sub_em,
+  plan_type_max_em
+}plan_type_em;
+
+/* Sub only, what to do with the address */
+typedef enum {
+  sub_set_em, /* Overwrite the existing ones */
+  sub_add_em,
+  sub_del_em
+}sub_act_em;
+
+typedef struct {
+  uint8_t elem;
+  /* Sub only, true if it's the first operation of the model */
+  uint8_t first;
+  /* Sub only, @ref{sub_act_em} */
+  uint8_t act;
+  uint16_t vd;
+  uint16_t md;
+  /* Bind - appkey refid, Sub - address, Pub - not used */
+  uint16_t arg;
+}plan_op_t;
+
+/*
+ * Flat vector of the config operations compiled from the DCD and the
+ * configuration of a node, grouped by type. Nodes with identical DCD and
+ * identical bindings/sublist share one plan. For the incremental
+ * reconfiguration, the Sub operations come from the delta of the node.
+ */
+typedef struct acc_plan {
+  uint32_t hash;
+  /* Number of the caches using the plan */
+  int ref;
+  int ofs[plan_type_max_em];
+  int cnt[plan_type_max_em];
+  int num;
+  plan_op_t *ops;
+  /* Serialized DCD and configuration the plan is compiled from */
+  int keylen;
+  uint8_t *key;
+}acc_plan_t;
+
+/**
+ * @brief plan_op_first - get the first operation of the type in the plan of
+ * the cache, the plan is compiled or shared on the first call after the DCD is
+ * known
+ *
+ * @param cache - the config cache
+ * @param type - @ref{plan_type_em}
+ *
+ * @return the operation, NULL if no operation of the type
+ */
+const plan_op_t *plan_op_first(config_cache_t *cache, plan_type_em type);
+
+/**
+ * @brief plan_op_next - advance to the next operation of the same type
+ *
+ * @return the operation, NULL if all operations of the type are done
+ */
+const plan_op_t *plan_op_next(config_cache_t *cache);
+
+/**
+ * @brief plan_op_cur - get the current operation of the cache
+ */
+const plan_op_t *plan_op_cur(const config_cache_t *cache);
+
+/**
+ * @brief plan_op_skip_model - Sub only, skip the remaining operations of the
+ * model in the current operation, the next plan_op_next returns the first
+ * operation of the next model
+ */
+void plan_op_skip_model(config_cache_t *cache);
+
+/**
+ * @brief plan_put - release the plan of the cache, MUST be called before the
+ * cache is reset
+ */
+void plan_put(config_cache_t *cache);
+
+/**
+ * @brief plan_stat_get - get the statistics of the compiled plans
+ *
+ * @param plans - number of the plans cached
+ * @param ops - total number of the operations in the cached plans
+ * @param hits - number of the times a plan is shared instead of compiled
+ */
+void plan_stat_get(int *plans, int *ops, uint32_t *hits);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //ACC_PLAN_H
@@ -0,0 +1,70 @@
+/*************************************************************************
+    > File Name: backoff.h
+    > Author: Kevin
+    > Created Time: 2020-02-22
+    > Description:
+ ************************************************************************/
+
+#ifndef BACKOFF_H
+#define BACKOFF_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Paths sharing the backoff scheduler */
+typedef enum {
+  bo_config_em,
+  bo_add_em,
+  bo_rm_em,
+  bo_path_max_em
+}bo_path_em;
+
+/* Per-slot backoff, all zero means not backing off */
+typedef struct {
+  uint8_t level;
+  /* Absolute time in ms the slot may retry, @ref{evloop_now_ms} */
+  uint64_t due;
+}backoff_t;
+
+typedef struct {
+  /* Number of OOM backoffs engaged per path */
+  uint32_t engaged[bo_path_max_em];
+  /* Highest level any slot reached */
+  uint8_t max_level;
+  /* Current global pressure */
+  uint8_t pressure;
+}bo_stat_t;
+
+/**
+ * @brief backoff_engage - the slot hits OOM, push its retry time back
+ * exponentially with jitter, stretched by the global pressure
+ *
+ * @param b - the slot
+ * @param path - @ref{bo_path_em}
+ */
+void backoff_engage(backoff_t *b, bo_path_em path);
+
+/**
+ * @brief backoff_reset - the NCP target accepts the slot again, the next OOM
+ * starts from the base delay
+ */
+static inline void backoff_reset(backoff_t *b)
+{
+  b->level = 0;
+  b->due = 0;
+}
+
+/**
+ * @brief backoff_ready - check if the slot may retry now
+ */
+bool backoff_ready(const backoff_t *b);
+
+void backoff_stat_get(bo_stat_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //BACKOFF_H
@@ -13,11 +13,41 @@ extern "C"
 #endif
 #include "gecko_bglib.h"
 
+/*
+ * Return non-zero if the event is handled
+ */
 typedef int (*bgevt_hdr)(const struct gecko_cmd_packet *evt);
 
 void conn_ncptarget(void);
 void sync_host_and_ncp_target(void);
 void bgevt_dispenser(void);
+
+/**
+ * @brief bgevt_register - route the events to the handler, each event has
+ * only one handler, the latest registration wins
+ *
+ * @param hdr - the handler
+ * @param ids - event IDs, gecko_evt_xxx_id
+ * @param num - number of the IDs
+ */
+void bgevt_register(bgevt_hdr hdr, const uint32_t *ids, int num);
+
+/**
+ * @brief bgevt_hdrs_init - build the dispatch table of all the event handlers
+ */
+void bgevt_hdrs_init(void);
+
+/**
+ * @brief bgevt_unhandled_get - get the events which are not handled and how
+ * many times each of them is received
+ *
+ * @param ids - filled with the event IDs
+ * @param cnts - filled with the counts
+ * @param max - capacity of both arrays
+ *
+ * @return number of the events filled
+ */
+int bgevt_unhandled_get(uint32_t *ids, uint32_t *cnts, int max);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,84 @@
+/*************************************************************************
+    > File Name: breaker.h
+    > Author: Kevin
+    > Created Time: 2020-02-24
+    > Description:
+ ************************************************************************/
+
+#ifndef BREAKER_H
+#define BREAKER_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cfg.h"
+
+typedef struct {
+  /* Nodes in quarantine, including the ones being probed */
+  int open;
+  /* Number of the times any node is quarantined */
+  uint32_t trips;
+  uint32_t probes;
+  /* Number of the probes answered by the node */
+  uint32_t recovered;
+}brk_stat_t;
+
+/**
+ * @brief breaker_admit - check if the node may take a config/rm cache now
+ *
+ * @param n - the node
+ *
+ * @return true if the node is not quarantined, or its probe is due, in which
+ * case the node is being probed until @ref{breaker_report}
+ */
+bool breaker_admit(const node_t *n);
+
+/**
+ * @brief breaker_probing - check if the node is loaded as a probe, a probe
+ * gives up on the first timeout instead of burning all the retries
+ */
+bool breaker_probing(const node_t *n);
+
+/**
+ * @brief breaker_report - a config/rm round of the node ends
+ *
+ * @param n - the node
+ * @param timeout - true if the round ends with no response from the node
+ *
+ * @return true if the node is quarantined after the round
+ */
+bool breaker_report(const node_t *n, bool timeout);
+
+/**
+ * @brief breaker_due - get when the quarantined node is probed
+ *
+ * @return absolute time in ms, @ref{evloop_now_ms}, 0 if the node is not
+ * waiting for a probe
+ */
+uint64_t breaker_due(const node_t *n);
+
+/**
+ * @brief breaker_open_get - get the quarantined nodes
+ *
+ * @param addrs - addresses of the nodes
+ * @param due - seconds to the next probe of the nodes
+ * @param max - capacity of the arrays
+ *
+ * @return number of the nodes filled
+ */
+int breaker_open_get(uint16_t *addrs, uint32_t *due, int max);
+
+void breaker_stat_get(brk_stat_t *s);
+
+/**
+ * @brief breaker_clr - forget all the nodes, e.g. when the network is cleared
+ */
+void breaker_clr(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //BREAKER_H
@@ -0,0 +1,54 @@
+/*************************************************************************
+    > File Name: dcd_cache.h
+    > Author: Kevin
+    > Created Time: 2020-02-14
+    > Description:
+ ************************************************************************/
+
+#ifndef DCD_CACHE_H
+#define DCD_CACHE_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdint.h>
+#include "err.h"
+
+/**
+ * @brief dcd_cache_init - load the DCD page 0 cached in previous runs, keyed
+ * by the CID/PID/VID at the beginning of the page. Calling it more than once
+ * has no effect.
+ *
+ * @return @ref{err_t}
+ */
+err_t dcd_cache_init(void);
+void dcd_cache_deinit(void);
+
+/**
+ * @brief dcd_cache_get - get the raw DCD page 0 of the product
+ *
+ * @param cid - company ID
+ * @param pid - product ID
+ * @param vid - version ID
+ * @param len - length of the page on return
+ *
+ * @return the page if cached, NULL otherwise
+ */
+const uint8_t *dcd_cache_get(uint16_t cid,
+                             uint16_t pid,
+                             uint16_t vid,
+                             uint8_t *len);
+
+/**
+ * @brief dcd_cache_put - cache the raw DCD page 0 reported by a node and
+ * write it back to the cache file if it's new or changed
+ *
+ * @param data - raw DCD page 0
+ * @param len - length of the page
+ */
+void dcd_cache_put(const uint8_t *data, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //DCD_CACHE_H
@@ -86,6 +86,9 @@ typedef enum {
   rmend_em
 }acc_state_emt;
 
+/* Room for the custom states after rmend_em, MUST fit in a lbitmap_t */
+#define ACC_STATES_MAX  32
+
 typedef enum {
   on_timeout_em,
   on_oom_em,
@@ -107,7 +110,14 @@ typedef struct acc_state{
 typedef struct {
   bool started;
   int state_num;
+  /* Insertion order, the table below is compiled from it on every change */
   acc_state_t *states;
+  struct {
+    /* NULL if the state is not in the list */
+    const acc_state_t *as[ACC_STATES_MAX];
+    /* The first state with valid entry after it in the list, -1 if none */
+    int8_t succ[ACC_STATES_MAX];
+  }tbl;
 }acc_t;
 
 enum {
@@ -165,15 +175,89 @@ static inline void err_set_to_rm_end(config_cache_t *cache,
 
 void timer_set(config_cache_t *cache, bool enable);
 extern const char *state_names[];
-static inline void oom_set(config_cache_t *cache)
+/*
+ * The path is passed in by the caller, the state of the cache is still the
+ * previous one if OOM happens in the entry of a state
+ */
+static inline void oom_set(config_cache_t *cache, bo_path_em path)
 {
   BIT_SET(cache->flags, OOM_BIT_OFFSET);
+  backoff_engage(&cache->bo, path);
   LOGW(OOM_SET_MSG, cache->node->addr, state_names[cache->state]);
 }
 
+/**
+ * @brief acc_cmd_async - make the next config client command of the cache
+ * asynchronous. The sender goes on as if the command is accepted, if the
+ * response turns out to be an error, the cache is set to OOM or error state
+ * when the response is delivered.
+ *
+ * It MUST be called right before the gecko_cmd_mesh_config_client_xxx call.
+ *
+ * @param cache - the cache to send the command for
+ */
+void acc_cmd_async(config_cache_t *cache);
+
+/**
+ * @brief acc_handle_set - record the config client handle returned by the
+ * gecko_cmd_mesh_config_client_xxx call, the events carrying the handle are
+ * routed to the cache in constant time afterwards. It does nothing while the
+ * response of an async command is pending, the handle is bound when the
+ * response is delivered.
+ *
+ * @param cache - the cache which sends the command
+ * @param handle - handle in the response
+ */
+void acc_handle_set(config_cache_t *cache, uint32_t handle);
+
+/**
+ * @brief add_state_after - insert a state into the auto-config state graph
+ *
+ * @param ps - the state to insert, copied
+ * @param state - insert after it, -1 to insert to the head
+ *
+ * @return @ref{err_t}
+ */
+err_t add_state_after(const acc_state_t *ps, acc_state_emt state);
+
 int dev_config_hdr(const struct gecko_cmd_packet *e);
+void dev_config_hdr_init(void);
 bool acc_loop(void *p);
 void acc_init(bool use_default);
+
+/**
+ * @brief acc_window_init - allocate the config/rm caches up to the ceiling
+ * (NCP Limits in the provisioner config file or MAX_CONCURRENT_CONFIG_NODES)
+ * and reset the adaptive concurrency window
+ *
+ * @param mng - the manager, its cfg MUST be set
+ */
+void acc_window_init(mng_t *mng);
+void acc_window_deinit(mng_t *mng);
+
+/**
+ * @brief acc_node_is_lpn - check if the node is a Low Power Node, by the
+ * config file or by the cached DCD of its product
+ */
+bool acc_node_is_lpn(const node_t *n);
+
+/**
+ * @brief acc_list_add - queue the node to be configured or removed, the Low
+ * Power Nodes go to the LPN lane if it has any cache
+ *
+ * @param mng - the manager
+ * @param n - the node
+ * @param rm - true to remove the node, false to configure it
+ */
+void acc_list_add(mng_t *mng, node_t *n, bool rm);
+
+/**
+ * @brief acc_quar_release - move the quarantined nodes whose probes are due
+ * back to the config/rm lists
+ *
+ * @return number of the nodes moved
+ */
+int acc_quar_release(mng_t *mng);
 /******************************************************************
  * State functions
  * ***************************************************************/
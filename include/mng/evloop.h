@@ -0,0 +1,60 @@
+/*************************************************************************
+    > File Name: evloop.h
+    > Author: Kevin
+    > Created Time: 2020-02-10
+    > Description:
+ ************************************************************************/
+
+#ifndef EVLOOP_H
+#define EVLOOP_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdint.h>
+#include <time.h>
+#include "err.h"
+
+/**
+ * @brief evloop_now_ms - current time in milliseconds, in the same clock as
+ * time(NULL), i.e. time(NULL) * 1000 is comparable with it
+ */
+static inline uint64_t evloop_now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief evloop_init - (re)build the event set of the manager thread, it
+ * contains the file descriptor connected to the NCP target, the doorbell for
+ * other threads and the guard timer.
+ *
+ * @param ncpfd - file descriptor of the UART or the domain socket, negative
+ * value if not available
+ *
+ * @return @ref{err_t}
+ */
+err_t evloop_init(int ncpfd);
+void evloop_deinit(void);
+
+/**
+ * @brief evloop_notify - wake up the manager thread, it's safe to be called
+ * from any thread
+ */
+void evloop_notify(void);
+
+/**
+ * @brief evloop_wait - block the manager thread until the NCP target has
+ * something to read, evloop_notify is called or the deadline is reached
+ *
+ * @param deadline - absolute time in milliseconds, @ref{evloop_now_ms}, 0
+ * means no deadline
+ */
+void evloop_wait(uint64_t deadline);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //EVLOOP_H
@@ -17,6 +17,7 @@ extern "C"
 #include "projconfig.h"
 #include "host_gecko.h"
 #include "cfg.h"
+#include "backoff.h"
 
 typedef struct {
   bool busy;
@@ -27,6 +28,8 @@ typedef struct {
 #define EVER_RETRIED_BIT_OFFSET 7
 #define WAITING_RESPONSE_BIT_OFFSET 6
 #define OOM_BIT_OFFSET  5
+#define RSP_PENDING_BIT_OFFSET  4
+#define RETRY_BO_BIT_OFFSET  3
 
 #define WAITING_RESPONSE_BIT_MASK  (1 << WAITING_RESPONSE_BIT_OFFSET)
 #define EVER_RETRIED_BIT_MASK  (1 << EVER_RETRIED_BIT_OFFSET)
@@ -43,6 +46,16 @@ typedef struct {
 
 #define OOM(x) IS_BIT_SET((x)->flags, OOM_BIT_OFFSET)
 
+/* Config client command sent asynchronously, response not received yet */
+#define RSP_PENDING(x)  IS_BIT_SET((x)->flags, RSP_PENDING_BIT_OFFSET)
+#define RSP_PENDING_SET(x)  BIT_SET((x)->flags, RSP_PENDING_BIT_OFFSET)
+#define RSP_PENDING_CLEAR(x)  BIT_CLR((x)->flags, RSP_PENDING_BIT_OFFSET)
+
+/* Retry on timeout is backing off, it's sent when the backoff is ready */
+#define RETRY_BO(x)  IS_BIT_SET((x)->flags, RETRY_BO_BIT_OFFSET)
+#define RETRY_BO_SET(x)  BIT_SET((x)->flags, RETRY_BO_BIT_OFFSET)
+#define RETRY_BO_CLEAR(x)  BIT_CLR((x)->flags, RETRY_BO_BIT_OFFSET)
+
 #define OOM_CLEAR(x)                     \
   do {                                   \
     BIT_CLR((x)->flags, OOM_BIT_OFFSET); \
@@ -54,6 +67,10 @@ typedef struct {
     (x)->remaining_retry = 0;                     \
   } while (0)
 
+/* Bits of node_t.rmorbl */
+#define BL_BITMASK  0x01
+#define RM_BITMASK  0x10
+
 typedef struct {
   uint16_t vid;
   uint16_t mid;
@@ -73,6 +90,7 @@ typedef struct {
 }dcd_t;
 
 #define ITERATOR_NUM  3
+struct acc_plan;
 typedef struct {
   int state;
   int next_state;
@@ -83,6 +101,12 @@ typedef struct {
   time_t expired;
   bbitmap_t flags;
   uint8_t remaining_retry;
+  /* Loaded to the LPN lane */
+  bool lpn;
+  /* Loaded as a probe of the quarantined node, no retry on timeout */
+  bool probe;
+  /* Retry on OOM not before bo.due */
+  backoff_t bo;
   struct {
     uint32_t bgcall;
     uint32_t bgevt;
@@ -90,11 +114,19 @@ typedef struct {
   }err_cache;
   dcd_t dcd;
   uint32_t cc_handle; /* Config Client Handle returned by bgcall */
-  struct {
-    uint16_t vd;
-    uint16_t md;
-  }vnm;
   int iterators[ITERATOR_NUM];
+  /* Config plan of the node, and the operation in progress, see acc_plan.h */
+  struct {
+    struct acc_plan *p;
+    int op;
+    int end;
+  }plan;
+  /* Guard results of the states, bit in passed is valid only if the same bit
+   * in evaluated is set */
+  struct {
+    lbitmap_t evaluated;
+    lbitmap_t passed;
+  }guards;
 }config_cache_t;
 
 enum {
@@ -155,14 +187,34 @@ typedef struct {
     int free_mode;
     seqprio_t seq;
     bool oom;
-    time_t oom_expired;
+    /* Scanning stopped on provisioning OOM, resumes after oom_bo.due */
+    backoff_t oom_bo;
   }status;
 
   struct {
-    add_cache_t add[MAX_PROV_SESSIONS];
+    struct {
+      /* Number of the provisioning sessions */
+      int ceiling;
+      /* Adaptive limit, no more than {size} sessions in use */
+      struct {
+        int size;
+        int acked;
+      }win;
+      add_cache_t *cache;
+    }add;
     struct {
       lbitmap_t used;
-      config_cache_t cache[MAX_CONCURRENT_CONFIG_NODES];
+      /* Number of the caches for the normal nodes, the first ones */
+      int ceiling;
+      /* Number of the caches for the LPNs, right after the normal ones */
+      int lpn;
+      /* Adaptive concurrency window, no more than {size} caches in use */
+      struct {
+        int size;
+        int acked;
+        bool recovering;
+      }win;
+      config_cache_t *cache;
     }config;
     bl_cache_t bl;
     struct {
@@ -178,9 +230,26 @@ typedef struct {
     GList *bl;
     GList *rm;
     GList *fail;
+    /* Quarantined nodes waiting for the next probe, see breaker.h */
+    GList *quar;
+    /* Low Power Nodes to config/rm, served by the LPN lane */
+    struct {
+      GList *config;
+      GList *rm;
+    }lpn;
   }lists;
 }mng_t;
 
+static inline int mng_config_pending(const mng_t *m)
+{
+  return g_list_length(m->lists.config) + g_list_length(m->lists.lpn.config);
+}
+
+static inline int mng_rm_pending(const mng_t *m)
+{
+  return g_list_length(m->lists.rm) + g_list_length(m->lists.lpn.rm);
+}
+
 err_t mng_init(void *p);
 err_t init_ncp(void *p);
 err_t clr_all(void *p);
@@ -190,11 +259,40 @@ mng_t *get_mng(void);
 
 err_t ipc_get_provcfg(void *p);
 
-void cmd_enq(const char *str, int offs);
-wordexp_t *cmd_deq(int *offs);
+/**
+ * @brief cmd_enq - queue a tokenized command to the manager thread, the tokens
+ * are copied. MUST be called only from the CLI thread, blocks if the queue is
+ * full.
+ *
+ * @param argc - number of the tokens
+ * @param argv - the tokens
+ * @param offs - index of the command in the command table
+ *
+ * @return @ref{err_t}
+ */
+err_t cmd_enq(int argc, char *const argv[], int offs);
 
 int dev_add_hdr(const struct gecko_cmd_packet *evt);
 int bl_hdr(const struct gecko_cmd_packet *e);
+void dev_add_hdr_init(void);
+void bl_hdr_init(void);
+
+/**
+ * @brief add_window_init - allocate the provisioning sessions up to the
+ * ceiling (NCP Limits in the provisioner config file or MAX_PROV_SESSIONS)
+ * and reset the adaptive limit
+ *
+ * @param mng - the manager, its cfg MUST be set
+ */
+void add_window_init(mng_t *mng);
+void add_window_deinit(mng_t *mng);
+
+/**
+ * @brief beacon_filter_clr - forget the recently seen unprovisioned devices,
+ * the next beacon of every device is handled
+ */
+void beacon_filter_clr(void);
+void beacon_filter_stat_get(uint32_t *handled, uint32_t *filtered);
 
 void mng_load_lists(void);
 void on_lists_changed(void);
@@ -228,6 +326,7 @@ uint16_t send_ctl(uint16_t addr, uint8_t ctl);
 
 void demo_run(void);
 void demo_start(int en);
+time_t demo_next_run(void);
 #ifdef __cplusplus
 }
 #endif
@@ -16,6 +16,7 @@ extern "C"
 
 err_t nwk_init(void *p);
 int bgevt_dflt_hdr(const struct gecko_cmd_packet *evt);
+void bgevt_dflt_hdr_init(void);
 #ifdef __cplusplus
 }
 #endif
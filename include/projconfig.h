@@ -48,19 +48,41 @@ extern "C"
 #endif
 
 #define CONFIG_CACHE_FILE_PATH  PROJ_DIR ".config"
+#define DCD_CACHE_FILE_PATH  PROJ_DIR ".dcd"
 #define TMPLATE_FILE_PATH PROJ_DIR "tools/mesh_config/templates.json"
 #define CLI_LOG_FILE_PATH PROJ_DIR "logs/cli.log"
 
 /*
  * NOTE: Make sure this value is NOT greater than the Max Prov Sessions
  * definition on the NCP target side
+ *
+ * It's the default number of the provisioning sessions, which can be
+ * overridden by "NCP Limits"/"Prov Sessions" in the provisioner config file.
+ * The sessions actually in use are controlled by an adaptive limit which
+ * starts from all of them, halves on OOM and grows by one after a full limit
+ * of devices are provisioned.
  */
 #define MAX_PROV_SESSIONS 2
 /*
  * NOTE: Make sure this value is NOT greater than the Max Foundation Client Cmds
  * definition on the NCP target side
+ *
+ * It's the default ceiling of the concurrent config/rm caches, which can be
+ * overridden by "NCP Limits"/"Config Nodes" in the provisioner config file.
+ * The caches actually in use are controlled by an adaptive window which starts
+ * from CONFIG_WINDOW_INIT, grows by one after a full window of config client
+ * commands completes and halves on OOM or guard timer expiry.
  */
 #define MAX_CONCURRENT_CONFIG_NODES 2
+#define CONFIG_WINDOW_INIT 2
+/*
+ * Low Power Nodes hold a cache for up to the LPN config client timeout on
+ * every command, they are served by a separate lane of caches so the normal
+ * nodes keep flowing. Overridden by "NCP Limits"/"LPN Nodes".
+ */
+#define LPN_CONCURRENT_CONFIG_NODES 1
+/* Used caches of both lanes are tracked by a lbitmap_t */
+#define CONFIG_NODES_HARD_LIMIT 32
 
 /*
  * Typically, each config client bg call will have an event raised no matter
@@ -82,6 +104,44 @@ extern "C"
  */
 #define OOM_DELAY_TIMEOUT 5
 
+/*
+ * Unprovisioned beacons from the same device are handled at most once every
+ * BEACON_RATE_MS, and only once every BEACON_IGNORE_MS if it's not a device to
+ * provision. The recently seen devices are kept in a table of
+ * BEACON_FILTER_SIZE entries, MUST be a power of 2.
+ */
+#define BEACON_RATE_MS  1000
+#define BEACON_IGNORE_MS  (10 * 1000)
+#define BEACON_FILTER_SIZE  64
+
+/*
+ * Backoff on OOM of the config/add/rm paths, the delay of a slot doubles on
+ * every consecutive OOM from BACKOFF_BASE_MS up to OOM_DELAY_TIMEOUT seconds,
+ * half of it is randomized. When OOM keeps hitting several slots within
+ * BACKOFF_PRESSURE_WINDOW_MS, the delays are stretched by 1/4 per hit.
+ */
+#define BACKOFF_BASE_MS 100
+#define BACKOFF_MAX_MS  (OOM_DELAY_TIMEOUT * 1000)
+#define BACKOFF_PRESSURE_WINDOW_MS  1000
+#define BACKOFF_PRESSURE_MAX  8
+
+/*
+ * Circuit breaker of the unresponsive nodes. A node which times out all the
+ * retries in BREAKER_FAIL_BUDGET rounds in a row is quarantined and only
+ * probed, with a single try per state, every BREAKER_PROBE_INTERVAL_MS. The
+ * interval doubles on every failed probe up to BREAKER_PROBE_MAX_MS.
+ */
+#define BREAKER_FAIL_BUDGET 2
+#define BREAKER_PROBE_INTERVAL_MS (60 * 1000)
+#define BREAKER_PROBE_MAX_MS  (30 * 60 * 1000)
+
+/*
+ * The manager thread sleeps until the NCP target or the CLI has something for
+ * it, or the nearest guard timer expires. While syncing, it wakes up at least
+ * every MNG_LOOP_MAX_IDLE seconds anyway.
+ */
+#define MNG_LOOP_MAX_IDLE 1
+
 /*
  * Retry times - each config client commands may fail with reasons, retry is
  * implemented, this definitions decide how many times to retry before failure
@@ -94,6 +154,24 @@ extern "C"
 #define SET_CONFIGS_RETRY_TIMES 5
 #define REMOVE_NODE_RETRY_TIMES 3
 
+/*
+ * Single field mutations of the nodes are appended to a journal next to the
+ * nodes config file instead of rewriting the whole file. The journal is
+ * fsync'd every JOURNAL_GROUP_COMMIT_NUM records, or by the manager loop
+ * JOURNAL_GROUP_COMMIT_TIMEOUT seconds after the first pending one, and folded back to the json file when
+ * it reaches JOURNAL_COMPACT_THRESHOLD records or on any bulk change.
+ */
+#define JOURNAL_GROUP_COMMIT_NUM 16
+#define JOURNAL_GROUP_COMMIT_TIMEOUT 1
+#define JOURNAL_COMPACT_THRESHOLD 512
+
+/*
+ * Model set to many lights - a group address is used instead of the unicast
+ * addresses only if it covers at least MODEL_SET_GROUP_MIN targets and no
+ * light outside the targets subscribes to it
+ */
+#define MODEL_SET_GROUP_MIN 2
+
 #ifdef __cplusplus
 }
 #endif
@@ -120,7 +120,12 @@ err_t __log(const char *file_name,
             ...);
 
 void log_n(void);
-#define LOG(lvl, fmt, ...) __log(__FILE__, __LINE__, (lvl), (fmt), ##__VA_ARGS__)
+/* __FILENAME__ is defined per source by the build, relative to the root */
+#ifndef __FILENAME__
+#define __FILENAME__ __FILE__
+#endif
+#define LOG(lvl, fmt, ...) \
+  __log(__FILENAME__, __LINE__, (lvl), (fmt), ##__VA_ARGS__)
 #define LOGN() log_n()
 
 /*
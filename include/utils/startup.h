@@ -55,6 +55,10 @@ typedef struct {
       char clt[FILE_PATH_MAX];
     }sock;
   };
+  /* Below are for the current run only, not cached */
+  char capture[FILE_PATH_MAX];
+  char replay[FILE_PATH_MAX];
+  bool realtime;
 }proj_args_t;
 
 typedef err_t (*init_func_t)(void *p);
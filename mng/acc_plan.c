@@ -0,0 +1,407 @@
+/*************************************************************************
+    > File Name: acc_plan.c
+    > Author: Kevin
+    > Created Time: 2020-02-20
+    > Description: Per-node config plan compiled from the DCD and the
+    > configuration, shared by the nodes with identical input
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "projconfig.h"
+#include "dev_config.h"
+#include "acc_plan.h"
+#include "logging.h"
+#include "utils.h"
+
+/* Defines  *********************************************************** */
+/* Unused plans kept for the nodes to come, the oldest one is freed first */
+#define PLAN_IDLE_MAX 16
+
+#define FNV_OFFSET  2166136261u
+#define FNV_PRIME 16777619u
+
+/* Global Variables *************************************************** */
+
+/* Static Variables *************************************************** */
+static struct {
+  GList *plans;
+  int idle;
+  uint32_t hits;
+} pc = { 0 };
+
+/*
+ * Models don't support publishing shouldn't be configured the publication
+ */
+static const uint16_t not_pub_models[] = {
+  0x1007, /* Generic Power OnOff Setup Server */
+  0x100A,  /* Generic Power Level Setup Server */
+  0x100F,  /* Generic Location Setup Server */
+
+  0x1201, /* Time Setup Server */
+  0x1204, /* Scene Setup Server */
+  0x1207, /* Scheduler Setup Server */
+
+  0x1301, /* Light Lightness Setup Server */
+  0x1304, /* Light CTL Setup Server */
+  0x1308,  /* Light HSL Setup Server */
+  0x130D,  /* Light xyL Setup Server */
+};
+
+static const uint16_t not_sub_models[] = {
+  0x1201, /* Time Setup Server */
+};
+
+/* Static Functions Declaractions ************************************* */
+static inline bool __supported(const uint16_t *nspt, int num, uint16_t md)
+{
+  for (int i = 0; i < num; i++) {
+    if (nspt[i] == md) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline void __model_of(const elem_t *e, int m, uint16_t *vd, uint16_t *md)
+{
+  if (m >= e->sigm_cnt) {
+    *vd = e->vm[m - e->sigm_cnt].vid;
+    *md = e->vm[m - e->sigm_cnt].mid;
+  } else {
+    *vd = SIG_VENDOR_ID;
+    *md = e->sig_models[m];
+  }
+}
+
+static inline int __u16list_len(const uint16list_t *l)
+{
+  return l ? l->len : 0;
+}
+
+static inline uint8_t *__put16(uint8_t *p, uint16_t v)
+{
+  memcpy(p, &v, sizeof(uint16_t));
+  return p + sizeof(uint16_t);
+}
+
+static inline uint8_t *__put16list(uint8_t *p, const uint16list_t *l)
+{
+  p = __put16(p, __u16list_len(l));
+  for (int i = 0; i < __u16list_len(l); i++) {
+    p = __put16(p, l->data[i]);
+  }
+  return p;
+}
+
+/*
+ * Serialize everything the plan depends on, so that identical inputs produce
+ * identical keys
+ */
+static uint8_t *__key_build(const dcd_t *dcd,
+                            const node_t *node,
+                            int *len)
+{
+  uint8_t *key, *p;
+  const elem_t *e;
+  const mesh_config_t *config = &node->config;
+  const cfg_delta_t *d = node->delta;
+  int n = 3 * sizeof(uint16_t) + 1;
+  int bn = __u16list_len(config->bindings);
+  int sn = __u16list_len(config->sublist);
+
+  for (int i = 0; i < dcd->element_cnt; i++) {
+    e = &dcd->elems[i];
+    n += 2 + sizeof(uint16_t) * (e->sigm_cnt + 2 * e->vm_cnt);
+  }
+  n += sizeof(uint16_t) * (bn + sn);
+  if (d) {
+    n += sizeof(uint16_t) * (2 + __u16list_len(d->sub_add)
+                             + __u16list_len(d->sub_rm));
+  }
+
+  p = key = malloc(n);
+  p = __put16(p, dcd->element_cnt);
+  for (int i = 0; i < dcd->element_cnt; i++) {
+    e = &dcd->elems[i];
+    *p++ = e->sigm_cnt;
+    *p++ = e->vm_cnt;
+    for (int m = 0; m < e->sigm_cnt; m++) {
+      p = __put16(p, e->sig_models[m]);
+    }
+    for (int m = 0; m < e->vm_cnt; m++) {
+      p = __put16(p, e->vm[m].vid);
+      p = __put16(p, e->vm[m].mid);
+    }
+  }
+  p = __put16list(p, config->bindings);
+  p = __put16list(p, config->sublist);
+  *p++ = !!d;
+  if (d) {
+    p = __put16list(p, d->sub_add);
+    p = __put16list(p, d->sub_rm);
+  }
+  ASSERT(p - key == n);
+  *len = n;
+  return key;
+}
+
+static uint32_t __hash(const uint8_t *key, int len)
+{
+  uint32_t h = FNV_OFFSET;
+  for (int i = 0; i < len; i++) {
+    h = (h ^ key[i]) * FNV_PRIME;
+  }
+  return h;
+}
+
+static inline void __op_add(acc_plan_t *p,
+                            uint8_t elem,
+                            uint16_t vd,
+                            uint16_t md,
+                            uint16_t arg,
+                            bool first)
+{
+  plan_op_t *op = &p->ops[p->num++];
+  op->elem = elem;
+  op->first = first;
+  op->act = first ? sub_set_em : sub_add_em;
+  op->vd = vd;
+  op->md = md;
+  op->arg = arg;
+}
+
+/*
+ * Sub operations of the incremental reconfiguration, remove the addresses not
+ * in the file anymore and add the new ones, nothing is overwritten
+ */
+static void __delta_sub_add(acc_plan_t *p,
+                            uint8_t elem,
+                            uint16_t vd,
+                            uint16_t md,
+                            const cfg_delta_t *d)
+{
+  int first = p->num;
+
+  for (int s = 0; s < __u16list_len(d->sub_rm); s++) {
+    __op_add(p, elem, vd, md, d->sub_rm->data[s], false);
+    p->ops[p->num - 1].act = sub_del_em;
+  }
+  for (int s = 0; s < __u16list_len(d->sub_add); s++) {
+    __op_add(p, elem, vd, md, d->sub_add->data[s], false);
+  }
+  if (p->num > first) {
+    p->ops[first].first = true;
+  }
+}
+
+static acc_plan_t *__compile(const dcd_t *dcd,
+                             const node_t *node,
+                             uint8_t *key,
+                             int keylen,
+                             uint32_t hash)
+{
+  acc_plan_t *p;
+  const elem_t *e;
+  const mesh_config_t *config = &node->config;
+  const cfg_delta_t *d = node->delta;
+  uint16_t vd, md;
+  int models = 0;
+  int bn = __u16list_len(config->bindings);
+  int sn = __u16list_len(config->sublist);
+
+  if (d) {
+    sn = MAX(sn, __u16list_len(d->sub_add) + __u16list_len(d->sub_rm));
+  }
+
+  for (int i = 0; i < dcd->element_cnt; i++) {
+    models += dcd->elems[i].sigm_cnt + dcd->elems[i].vm_cnt;
+  }
+
+  p = calloc(1, sizeof(acc_plan_t));
+  p->hash = hash;
+  p->key = key;
+  p->keylen = keylen;
+  p->ops = calloc(MAX(1, models * (bn + 1 + sn)), sizeof(plan_op_t));
+
+  /* Bind every appkey to every model */
+  p->ofs[plan_bind_em] = p->num;
+  for (int i = 0; i < dcd->element_cnt; i++) {
+    e = &dcd->elems[i];
+    for (int m = 0; m < e->sigm_cnt + e->vm_cnt; m++) {
+      __model_of(e, m, &vd, &md);
+      for (int b = 0; b < bn; b++) {
+        __op_add(p, i, vd, md, config->bindings->data[b], false);
+      }
+    }
+  }
+  p->cnt[plan_bind_em] = p->num - p->ofs[plan_bind_em];
+
+  /* Publication of every model supports it */
+  p->ofs[plan_pub_em] = p->num;
+  for (int i = 0; i < dcd->element_cnt; i++) {
+    e = &dcd->elems[i];
+    for (int m = 0; m < e->sigm_cnt + e->vm_cnt; m++) {
+      __model_of(e, m, &vd, &md);
+      if (!__supported(not_pub_models, ARR_LEN(not_pub_models), md)) {
+        LOGV("Model - 0x%04x doesn't support Pub, pass.\n", md);
+        continue;
+      }
+      __op_add(p, i, vd, md, 0, false);
+    }
+  }
+  p->cnt[plan_pub_em] = p->num - p->ofs[plan_pub_em];
+
+  /* Set the first address, add the others */
+  p->ofs[plan_sub_em] = p->num;
+  for (int i = 0; i < dcd->element_cnt; i++) {
+    e = &dcd->elems[i];
+    for (int m = 0; m < e->sigm_cnt + e->vm_cnt; m++) {
+      __model_of(e, m, &vd, &md);
+      if (!__supported(not_sub_models, ARR_LEN(not_sub_models), md)) {
+        LOGV("Model - 0x%04x doesn't support Sub, pass.\n", md);
+        continue;
+      }
+      if (d) {
+        __delta_sub_add(p, i, vd, md, d);
+        continue;
+      }
+      for (int s = 0; s < sn; s++) {
+        __op_add(p, i, vd, md, config->sublist->data[s], s == 0);
+      }
+    }
+  }
+  p->cnt[plan_sub_em] = p->num - p->ofs[plan_sub_em];
+
+  LOGD("Config Plan Compiled - %d Bind, %d Pub, %d Sub\n",
+       p->cnt[plan_bind_em],
+       p->cnt[plan_pub_em],
+       p->cnt[plan_sub_em]);
+  return p;
+}
+
+static void __plan_free(acc_plan_t *p)
+{
+  free(p->ops);
+  free(p->key);
+  free(p);
+}
+
+static acc_plan_t *__plan_get(const dcd_t *dcd, const node_t *node)
+{
+  GList *l;
+  acc_plan_t *p;
+  int keylen;
+  uint8_t *key = __key_build(dcd, node, &keylen);
+  uint32_t hash = __hash(key, keylen);
+
+  for (l = pc.plans; l; l = l->next) {
+    p = (acc_plan_t *)l->data;
+    if (p->hash == hash
+        && p->keylen == keylen
+        && !memcmp(p->key, key, keylen)) {
+      free(key);
+      if (!p->ref++) {
+        pc.idle--;
+      }
+      pc.hits++;
+      return p;
+    }
+  }
+
+  p = __compile(dcd, node, key, keylen, hash);
+  p->ref = 1;
+  pc.plans = g_list_append(pc.plans, p);
+  return p;
+}
+
+static void __idle_trim(void)
+{
+  GList *l;
+  acc_plan_t *p;
+
+  for (l = pc.plans; l && pc.idle > PLAN_IDLE_MAX; l = l->next) {
+    p = (acc_plan_t *)l->data;
+    if (!p->ref) {
+      pc.plans = g_list_delete_link(pc.plans, l);
+      __plan_free(p);
+      pc.idle--;
+      return;
+    }
+  }
+}
+
+const plan_op_t *plan_op_first(config_cache_t *cache, plan_type_em type)
+{
+  acc_plan_t *p;
+
+  ASSERT(type < plan_type_max_em);
+  if (!cache->plan.p) {
+    cache->plan.p = __plan_get(&cache->dcd, cache->node);
+  }
+  p = cache->plan.p;
+  cache->plan.op = p->ofs[type];
+  cache->plan.end = p->ofs[type] + p->cnt[type];
+  return plan_op_cur(cache);
+}
+
+const plan_op_t *plan_op_next(config_cache_t *cache)
+{
+  if (cache->plan.op < cache->plan.end) {
+    cache->plan.op++;
+  }
+  return plan_op_cur(cache);
+}
+
+const plan_op_t *plan_op_cur(const config_cache_t *cache)
+{
+  if (!cache->plan.p || cache->plan.op >= cache->plan.end) {
+    return NULL;
+  }
+  return &cache->plan.p->ops[cache->plan.op];
+}
+
+void plan_op_skip_model(config_cache_t *cache)
+{
+  const plan_op_t *ops;
+
+  if (!plan_op_cur(cache)) {
+    return;
+  }
+  ops = cache->plan.p->ops;
+  while (cache->plan.op + 1 < cache->plan.end && !ops[cache->plan.op + 1].first) {
+    cache->plan.op++;
+  }
+}
+
+void plan_put(config_cache_t *cache)
+{
+  acc_plan_t *p = cache->plan.p;
+
+  if (!p) {
+    return;
+  }
+  cache->plan.p = NULL;
+  cache->plan.op = cache->plan.end = 0;
+  ASSERT(p->ref > 0);
+  if (!--p->ref) {
+    pc.idle++;
+    __idle_trim();
+  }
+}
+
+void plan_stat_get(int *plans, int *ops, uint32_t *hits)
+{
+  GList *l;
+  int n = 0;
+
+  for (l = pc.plans; l; l = l->next) {
+    n += ((acc_plan_t *)l->data)->num;
+  }
+  *plans = g_list_length(pc.plans);
+  *ops = n;
+  *hits = pc.hits;
+}
@@ -0,0 +1,95 @@
+/*************************************************************************
+    > File Name: backoff.c
+    > Author: Kevin
+    > Created Time: 2020-02-22
+    > Description: Exponential backoff with jitter on OOM of the NCP target
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <string.h>
+
+#include "projconfig.h"
+#include "backoff.h"
+#include "evloop.h"
+#include "logging.h"
+#include "utils.h"
+
+/* Defines  *********************************************************** */
+/* BACKOFF_BASE_MS << BACKOFF_LEVEL_MAX is far beyond BACKOFF_MAX_MS */
+#define BACKOFF_LEVEL_MAX 16
+
+/* Global Variables *************************************************** */
+
+/* Static Variables *************************************************** */
+static struct {
+  uint32_t seed;
+  /* Time of the last OOM on any slot */
+  uint64_t last;
+  bo_stat_t stat;
+} bo = { 0 };
+
+/* Static Functions Declaractions ************************************* */
+/* xorshift32, good enough for spreading the retries */
+static uint32_t __rand(void)
+{
+  uint32_t x = bo.seed;
+
+  if (!x) {
+    x = (uint32_t)evloop_now_ms() | 1;
+  }
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  bo.seed = x;
+  return x;
+}
+
+void backoff_engage(backoff_t *b, bo_path_em path)
+{
+  uint64_t now = evloop_now_ms();
+  uint32_t delay;
+
+  ASSERT(path < bo_path_max_em);
+  /* Several slots hitting OOM close together means the NCP target as a whole
+   * is saturated, not just one node is slow */
+  if (bo.last && now - bo.last < BACKOFF_PRESSURE_WINDOW_MS) {
+    if (bo.stat.pressure < BACKOFF_PRESSURE_MAX) {
+      bo.stat.pressure++;
+    }
+  } else {
+    bo.stat.pressure = 0;
+  }
+  bo.last = now;
+
+  if (b->level < BACKOFF_LEVEL_MAX) {
+    b->level++;
+  }
+  delay = MIN(BACKOFF_MAX_MS, (uint64_t)BACKOFF_BASE_MS << (b->level - 1));
+  delay += delay * bo.stat.pressure / 4;
+  delay = MIN(BACKOFF_MAX_MS, delay);
+  /* Equal jitter - keep half, randomize the other half */
+  delay = delay / 2 + __rand() % (delay / 2 + 1);
+  b->due = now + delay;
+
+  bo.stat.engaged[path]++;
+  if (b->level > bo.stat.max_level) {
+    bo.stat.max_level = b->level;
+  }
+  LOGV("Backoff Level %d, Pressure %d, Retry in %ums\n",
+       b->level,
+       bo.stat.pressure,
+       delay);
+}
+
+bool backoff_ready(const backoff_t *b)
+{
+  return !b->due || evloop_now_ms() >= b->due;
+}
+
+void backoff_stat_get(bo_stat_t *s)
+{
+  memcpy(s, &bo.stat, sizeof(bo_stat_t));
+  if (!bo.last || evloop_now_ms() - bo.last >= BACKOFF_PRESSURE_WINDOW_MS) {
+    s->pressure = 0;
+  }
+}
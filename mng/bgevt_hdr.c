@@ -12,6 +12,7 @@
 
 #include "projconfig.h"
 #include "bg_uart_cbs.h"
+#include "bg_trace.h"
 #include "uart.h"
 #include "bgevt_hdr.h"
 #include "socket_handler.h"
@@ -25,18 +26,27 @@
 /* Defines  *********************************************************** */
 BGLIB_DEFINE();
 
+/* Event ID - [msg id | class | length | type] */
+#define EVT_CLASS(id) (((id) >> 16) & 0xff)
+#define EVT_MSG(id) (((id) >> 24) & 0xff)
+#define EVT_ID(cls, msg) \
+  (((uint32_t)(msg) << 24) | ((uint32_t)(cls) << 16) \
+   | gecko_dev_type_gecko | gecko_msg_type_evt)
+#define EVT_CLASS_NUM 256
+#define EVT_MSG_NUM 256
+
+/* Allocated only for the classes in use */
+typedef struct {
+  bgevt_hdr hdrs[EVT_MSG_NUM];
+  uint32_t unhandled[EVT_MSG_NUM];
+}evt_class_t;
+
 /* Global Variables *************************************************** */
 
 /* Static Variables *************************************************** */
 static volatile int ncp_sync = false;
 
-static bgevt_hdr hdrs[] = {
-  dev_add_hdr,
-  dev_config_hdr,
-  bl_hdr,
-  bgevt_dflt_hdr,
-  NULL
-};
+static evt_class_t *evt_classes[EVT_CLASS_NUM] = { 0 };
 
 /* Static Functions Declaractions ************************************* */
 void conn_ncptarget(void)
@@ -48,7 +58,11 @@ void conn_ncptarget(void)
   proj_args_t *arg = (proj_args_t *)getprojargs();
 
   BGLIB_INITIALIZE_NONBLOCK(u->bglib_output, u->bglib_input, u->bglib_peek);
-  if (arg->enc) {
+  BGLIB_INITIALIZE_VIEW(u->bglib_view);
+  gecko_cmd_async_reset();
+  if (arg->replay[0]) {
+    return;
+  } else if (arg->enc) {
     if (connect_domain_socket_server(arg->sock.srv, arg->sock.clt, arg->sock.enc)) {
       LOGE("Connection to domain socket unsuccessful. Exiting..\n");
       exit(EXIT_FAILURE);
@@ -73,9 +87,6 @@ void sync_host_and_ncp_target(void)
   ncp_sync = false;
   LOGM("Syncing NCP Host and Target\n");
   while (timeout < MAXSLEEP && !ncp_sync) {
-    if (getprojargs()->enc) {
-      poll_update(50);
-    }
     struct gecko_cmd_packet *p = gecko_peek_event();
 
     if (p && BGLIB_MSG_ID(p->header) == gecko_evt_system_boot_id) {
@@ -96,9 +107,57 @@ void sync_host_and_ncp_target(void)
   }
 }
 
+static evt_class_t *__class_get(uint32_t evtid)
+{
+  evt_class_t **c = &evt_classes[EVT_CLASS(evtid)];
+  if (!*c) {
+    *c = calloc(1, sizeof(evt_class_t));
+    ASSERT(*c);
+  }
+  return *c;
+}
+
+void bgevt_register(bgevt_hdr hdr, const uint32_t *ids, int num)
+{
+  evt_class_t *c;
+
+  for (int i = 0; i < num; i++) {
+    c = __class_get(ids[i]);
+    if (c->hdrs[EVT_MSG(ids[i])] && c->hdrs[EVT_MSG(ids[i])] != hdr) {
+      LOGW("Handler of event [0x%08x] replaced\n", ids[i]);
+    }
+    c->hdrs[EVT_MSG(ids[i])] = hdr;
+  }
+}
+
+void bgevt_hdrs_init(void)
+{
+  dev_add_hdr_init();
+  dev_config_hdr_init();
+  bl_hdr_init();
+  bgevt_dflt_hdr_init();
+}
+
+static inline void __dispatch(const struct gecko_cmd_packet *evt)
+{
+  uint32_t evtid = BGLIB_MSG_ID(evt->header);
+  evt_class_t *c = evt_classes[EVT_CLASS(evtid)];
+  bgevt_hdr h = c ? c->hdrs[EVT_MSG(evtid)] : NULL;
+
+  if (h && h(evt)) {
+    return;
+  }
+  if (!c) {
+    c = __class_get(evtid);
+  }
+  /* Only the first one is logged, the rest are counted */
+  if (!c->unhandled[EVT_MSG(evtid)]++) {
+    LOGW("NCP Target Event [0x%08x] Not Handled\n", evtid);
+  }
+}
+
 void bgevt_dispenser(void)
 {
-  bool handled;
   struct gecko_cmd_packet *evt = NULL;
   if (!ncp_sync) {
     sync_host_and_ncp_target();
@@ -106,20 +165,31 @@ void bgevt_dispenser(void)
   }
 
   do {
-    handled = false;
-    if (getprojargs()->enc) {
-      poll_update(50);
-    }
     evt = gecko_peek_event();
     if (evt) {
-      bgevt_hdr *h = hdrs;
-      while (*h && !handled) {
-        handled = (*h)(evt);
-        h++;
-      }
-      if (!handled) {
-        LOGW("NCP Target Event [0x%08x] Not Handled\n", BGLIB_MSG_ID(evt->header));
-      }
+      __dispatch(evt);
     }
   } while (evt);
+  /* No-op if not recording */
+  bgtrace_record_flush();
+}
+
+int bgevt_unhandled_get(uint32_t *ids, uint32_t *cnts, int max)
+{
+  int n = 0;
+  evt_class_t *c;
+
+  for (int i = 0; i < EVT_CLASS_NUM && n < max; i++) {
+    if (NULL == (c = evt_classes[i])) {
+      continue;
+    }
+    for (int j = 0; j < EVT_MSG_NUM && n < max; j++) {
+      if (!c->unhandled[j]) {
+        continue;
+      }
+      ids[n] = EVT_ID(i, j);
+      cnts[n++] = c->unhandled[j];
+    }
+  }
+  return n;
 }
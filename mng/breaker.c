@@ -0,0 +1,175 @@
+/*************************************************************************
+    > File Name: breaker.c
+    > Author: Kevin
+    > Created Time: 2020-02-24
+    > Description: Circuit breaker of the unresponsive nodes, a node failing
+    > BREAKER_FAIL_BUDGET rounds in a row is quarantined and only probed once
+    > in a while
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "projconfig.h"
+#include "breaker.h"
+#include "evloop.h"
+#include "logging.h"
+#include "utils.h"
+
+/* Defines  *********************************************************** */
+typedef enum {
+  brk_closed_em,
+  brk_open_em,
+  brk_probing_em
+}brk_state_em;
+
+/* Nodes without any failure have no record */
+typedef struct {
+  uint8_t state;
+  uint8_t fails;
+  uint32_t interval;
+  /* Absolute time in ms the node is probed, @ref{evloop_now_ms} */
+  uint64_t due;
+}brk_t;
+
+/* Global Variables *************************************************** */
+
+/* Static Variables *************************************************** */
+static struct {
+  /* Unicast address -> brk_t */
+  GHashTable *nodes;
+  brk_stat_t stat;
+} bk = { 0 };
+
+/* Static Functions Declaractions ************************************* */
+static brk_t *__get(uint16_t addr, bool create)
+{
+  brk_t *b;
+
+  if (!bk.nodes) {
+    if (!create) {
+      return NULL;
+    }
+    bk.nodes = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                      NULL, free);
+  }
+  b = g_hash_table_lookup(bk.nodes, GUINT_TO_POINTER(addr));
+  if (!b && create) {
+    b = calloc(1, sizeof(brk_t));
+    ASSERT(b);
+    g_hash_table_insert(bk.nodes, GUINT_TO_POINTER(addr), b);
+  }
+  return b;
+}
+
+static inline void __del(uint16_t addr)
+{
+  if (bk.nodes) {
+    g_hash_table_remove(bk.nodes, GUINT_TO_POINTER(addr));
+  }
+}
+
+bool breaker_admit(const node_t *n)
+{
+  brk_t *b = __get(n->addr, false);
+
+  if (!b || b->state != brk_open_em) {
+    return true;
+  }
+  if (evloop_now_ms() < b->due) {
+    return false;
+  }
+  b->state = brk_probing_em;
+  bk.stat.probes++;
+  LOGM("Node[0x%04x]: Probing the Quarantined Node\n", n->addr);
+  return true;
+}
+
+uint64_t breaker_due(const node_t *n)
+{
+  brk_t *b = __get(n->addr, false);
+  return (b && b->state == brk_open_em) ? b->due : 0;
+}
+
+bool breaker_probing(const node_t *n)
+{
+  brk_t *b = __get(n->addr, false);
+  return b && b->state == brk_probing_em;
+}
+
+bool breaker_report(const node_t *n, bool timeout)
+{
+  brk_t *b = __get(n->addr, timeout);
+
+  if (!timeout) {
+    /* The node answers, whatever the result is */
+    if (b && b->state != brk_closed_em) {
+      bk.stat.open--;
+      bk.stat.recovered++;
+      LOGM("Node[0x%04x]: Back From Quarantine\n", n->addr);
+    }
+    __del(n->addr);
+    return false;
+  }
+
+  if (b->fails < UINT8_MAX) {
+    b->fails++;
+  }
+  if (b->state == brk_probing_em) {
+    b->interval = MIN(BREAKER_PROBE_MAX_MS, b->interval * 2);
+  } else if (b->fails >= BREAKER_FAIL_BUDGET) {
+    b->interval = BREAKER_PROBE_INTERVAL_MS;
+    bk.stat.open++;
+    bk.stat.trips++;
+  } else {
+    return false;
+  }
+  b->state = brk_open_em;
+  b->due = evloop_now_ms() + b->interval;
+  LOGW("Node[0x%04x]: Quarantined After %d Failed Rounds, Probe in %us\n",
+       n->addr,
+       b->fails,
+       b->interval / 1000);
+  return true;
+}
+
+int breaker_open_get(uint16_t *addrs, uint32_t *due, int max)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  brk_t *b;
+  uint64_t now = evloop_now_ms();
+  int n = 0;
+
+  if (!bk.nodes) {
+    return 0;
+  }
+  g_hash_table_iter_init(&iter, bk.nodes);
+  while (n < max && g_hash_table_iter_next(&iter, &key, &value)) {
+    b = (brk_t *)value;
+    if (b->state == brk_closed_em) {
+      continue;
+    }
+    addrs[n] = GPOINTER_TO_UINT(key);
+    due[n] = (b->state == brk_probing_em || b->due <= now)
+             ? 0 : (uint32_t)((b->due - now + 999) / 1000);
+    n++;
+  }
+  return n;
+}
+
+void breaker_stat_get(brk_stat_t *s)
+{
+  memcpy(s, &bk.stat, sizeof(brk_stat_t));
+}
+
+void breaker_clr(void)
+{
+  if (bk.nodes) {
+    g_hash_table_destroy(bk.nodes);
+    bk.nodes = NULL;
+  }
+  bk.stat.open = 0;
+}
@@ -0,0 +1,192 @@
+/*************************************************************************
+    > File Name: dcd_cache.c
+    > Author: Kevin
+    > Created Time: 2020-02-14
+    > Description: Persistent DCD page 0 cache keyed by CID/PID/VID
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "projconfig.h"
+#include "dcd_cache.h"
+#include "logging.h"
+#include "utils.h"
+
+/* Defines  *********************************************************** */
+/* CID(2) PID(2) VID(2) CRPL(2) Features(2) */
+#define DCD_PAGE0_HDR_LEN 10
+/* "cccc pppp vvvv " + hex of the page + '\n' + '\0' */
+#define DCD_LINE_MAX_LENGTH (15 + 255 * 2 + 2)
+#define DCD_CACHE_COMMENT \
+  "# Cached DCD page 0 - CID PID VID Raw, delete the file to refresh\n"
+
+typedef struct {
+  uint16_t cid;
+  uint16_t pid;
+  uint16_t vid;
+  uint8_t len;
+  uint8_t data[];
+}dcd_item_t;
+
+/* Global Variables *************************************************** */
+
+/* Static Variables *************************************************** */
+static struct {
+  bool loaded;
+  GList *items;
+} dc = { 0 };
+
+/* Static Functions Declaractions ************************************* */
+static dcd_item_t *__find(uint16_t cid, uint16_t pid, uint16_t vid)
+{
+  GList *l;
+  dcd_item_t *it;
+
+  for (l = dc.items; l; l = l->next) {
+    it = (dcd_item_t *)l->data;
+    if (it->cid == cid && it->pid == pid && it->vid == vid) {
+      return it;
+    }
+  }
+  return NULL;
+}
+
+static dcd_item_t *__item_new(const uint8_t *data, uint8_t len)
+{
+  dcd_item_t *it = malloc(sizeof(dcd_item_t) + len);
+
+  it->cid = BUILD_UINT16(data[0], data[1]);
+  it->pid = BUILD_UINT16(data[2], data[3]);
+  it->vid = BUILD_UINT16(data[4], data[5]);
+  it->len = len;
+  memcpy(it->data, data, len);
+  return it;
+}
+
+static err_t __save(void)
+{
+  FILE *fp;
+  GList *l;
+  dcd_item_t *it;
+  char line[DCD_LINE_MAX_LENGTH];
+
+  if (NULL == (fp = fopen(DCD_CACHE_FILE_PATH, "w"))) {
+    return err(ec_file_ope);
+  }
+  fwrite(DCD_CACHE_COMMENT, strlen(DCD_CACHE_COMMENT), 1, fp);
+  for (l = dc.items; l; l = l->next) {
+    it = (dcd_item_t *)l->data;
+    memset(line, 0, DCD_LINE_MAX_LENGTH);
+    sprintf(line, "%04x %04x %04x ", it->cid, it->pid, it->vid);
+    cbuf2str((const char *)it->data, it->len, 0, line + 15,
+             DCD_LINE_MAX_LENGTH - 15 - 2);
+    strcat(line, "\n");
+    fwrite(line, strlen(line), 1, fp);
+  }
+  fclose(fp);
+  return ec_success;
+}
+
+err_t dcd_cache_init(void)
+{
+  FILE *fp;
+  char line[DCD_LINE_MAX_LENGTH];
+  uint8_t buf[255];
+  unsigned int cid, pid, vid;
+  char *raw, *r;
+  size_t len;
+
+  if (dc.loaded) {
+    return ec_success;
+  }
+  dc.loaded = true;
+  if (NULL == (fp = fopen(DCD_CACHE_FILE_PATH, "r"))) {
+    /* Not created yet */
+    return ec_success;
+  }
+
+  while (NULL != fgets(line, DCD_LINE_MAX_LENGTH, fp)) {
+    if (line[0] == '#') {
+      continue;
+    }
+    if (NULL != (r = strrchr(line, '\n'))) {
+      *r = '\0';
+    }
+    if (3 != sscanf(line, "%x %x %x ", &cid, &pid, &vid)
+        || strlen(line) <= 15) {
+      continue;
+    }
+    raw = line + 15;
+    len = strlen(raw) / 2;
+    if (len < DCD_PAGE0_HDR_LEN || len > sizeof(buf)
+        || ec_success != str2cbuf(raw, 0, (char *)buf, sizeof(buf))) {
+      LOGW("Invalid DCD cache line dropped\n");
+      continue;
+    }
+    if (cid != BUILD_UINT16(buf[0], buf[1])
+        || pid != BUILD_UINT16(buf[2], buf[3])
+        || vid != BUILD_UINT16(buf[4], buf[5])
+        || __find(cid, pid, vid)) {
+      LOGW("Inconsistent DCD cache line dropped\n");
+      continue;
+    }
+    dc.items = g_list_append(dc.items, __item_new(buf, len));
+  }
+  fclose(fp);
+  LOGD("%d DCD(s) loaded from cache\n", g_list_length(dc.items));
+  return ec_success;
+}
+
+void dcd_cache_deinit(void)
+{
+  g_list_free_full(dc.items, free);
+  dc.items = NULL;
+  dc.loaded = false;
+}
+
+const uint8_t *dcd_cache_get(uint16_t cid,
+                             uint16_t pid,
+                             uint16_t vid,
+                             uint8_t *len)
+{
+  dcd_item_t *it = __find(cid, pid, vid);
+
+  if (!it) {
+    return NULL;
+  }
+  *len = it->len;
+  return it->data;
+}
+
+void dcd_cache_put(const uint8_t *data, uint8_t len)
+{
+  dcd_item_t *it;
+  GList *l;
+  err_t e;
+
+  if (len < DCD_PAGE0_HDR_LEN) {
+    return;
+  }
+  it = __find(BUILD_UINT16(data[0], data[1]),
+              BUILD_UINT16(data[2], data[3]),
+              BUILD_UINT16(data[4], data[5]));
+  if (it) {
+    if (it->len == len && !memcmp(it->data, data, len)) {
+      return;
+    }
+    /* Same identity but different composition, the latest one wins */
+    LOGW("DCD of product %04x-%04x-%04x changed\n", it->cid, it->pid, it->vid);
+    l = g_list_find(dc.items, it);
+    l->data = __item_new(data, len);
+    free(it);
+  } else {
+    dc.items = g_list_append(dc.items, __item_new(data, len));
+  }
+  if (ec_success != (e = __save())) {
+    elog(e);
+  }
+}
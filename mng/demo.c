@@ -75,6 +75,11 @@ void demo_start(int en)
   }
 }
 
+time_t demo_next_run(void)
+{
+  return demo.expired;
+}
+
 void demo_run(void)
 {
   char p1[] = "lightness";
@@ -7,6 +7,7 @@
 
 /* Includes *********************************************************** */
 /* #include "dev_add.h" */
+#include <stdlib.h>
 #include <glib.h>
 
 #include "host_gecko.h"
@@ -19,8 +20,13 @@
 #include "cli.h"
 #include "generic_parser.h"
 #include "stat.h"
+#include "bgevt_hdr.h"
+#include "dev_config.h"
+#include "evloop.h"
 
 /* Defines  *********************************************************** */
+/* Slots to look at from the hashed one */
+#define BEACON_FILTER_PROBES  4
 
 /* Global Variables *************************************************** */
 
@@ -32,19 +38,36 @@
  */
 static bool scan_need_recover = false;
 
+/*
+ * Recently seen devices, a beacon from the device is dropped before any lookup
+ * until the hold time of the last handled one passes
+ */
+static struct {
+  struct {
+    uint8_t uuid[16];
+    /* Absolute time in ms, @ref{evloop_now_ms}, 0 means the slot is free */
+    uint64_t until;
+  }seen[BEACON_FILTER_SIZE];
+  uint32_t handled;
+  uint32_t filtered;
+} bf = { 0 };
+
 /* Static Functions Declaractions ************************************* */
 static void on_beacon_recv(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t *evt);
+static uint32_t __beacon_handle(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t *evt);
 static void on_prov_failed(const struct gecko_msg_mesh_prov_provisioning_failed_evt_t *evt);
 static void on_prov_success(const struct gecko_msg_mesh_prov_device_provisioned_evt_t *evt);
 
+/* The sessions in use reach the adaptive limit */
 static inline bool is_cache_full(const mng_t *mng)
 {
-  for (int i = 0; i < MAX_PROV_SESSIONS; i++) {
-    if (!mng->cache.add[i].busy) {
-      return false;
+  int used = 0;
+  for (int i = 0; i < mng->cache.add.ceiling; i++) {
+    if (mng->cache.add.cache[i].busy) {
+      used++;
     }
   }
-  return true;
+  return used >= mng->cache.add.win.size;
 }
 static inline int iscached(const mng_t *mng,
                            const uint8_t *uuid,
@@ -53,9 +76,9 @@ static inline int iscached(const mng_t *mng,
   if (free) {
     *free = -1;
   }
-  for (int i = 0; i < MAX_PROV_SESSIONS; i++) {
-    if (mng->cache.add[i].busy) {
-      if (!memcmp(mng->cache.add[i].uuid, uuid, 16)) {
+  for (int i = 0; i < mng->cache.add.ceiling; i++) {
+    if (mng->cache.add.cache[i].busy) {
+      if (!memcmp(mng->cache.add.cache[i].uuid, uuid, 16)) {
         return i;
       }
       continue;
@@ -64,27 +87,102 @@ static inline int iscached(const mng_t *mng,
       *free = i;
     }
   }
+  if (free && *free != -1 && is_cache_full(mng)) {
+    *free = -1;
+  }
   return -1;
 }
 
 static inline void rmcached(mng_t *mng,
                             const uint8_t *uuid)
 {
-  for (int i = 0; i < MAX_PROV_SESSIONS; i++) {
-    if (!mng->cache.add[i].busy
-        || memcmp(mng->cache.add[i].uuid, uuid, 16)) {
+  for (int i = 0; i < mng->cache.add.ceiling; i++) {
+    if (!mng->cache.add.cache[i].busy
+        || memcmp(mng->cache.add.cache[i].uuid, uuid, 16)) {
       continue;
     }
-    memset(&mng->cache.add[i], 0, sizeof(add_cache_t));
+    memset(&mng->cache.add.cache[i], 0, sizeof(add_cache_t));
+  }
+}
+
+/*
+ * Scanning is stopped when the sessions are full or on OOM, resume it once
+ * there is room again
+ */
+static void __scan_resume(mng_t *mng)
+{
+  uint16_t ret;
+
+  if (!scan_need_recover || mng->status.oom || is_cache_full(mng)) {
+    return;
   }
+  scan_need_recover = false;
+  ret = gecko_cmd_mesh_prov_scan_unprov_beacons()->result;
+  if (bg_err_success != ret) {
+    LOGBGE("scan unprov beacon", ret);
+  }
+}
+
+void add_window_init(mng_t *mng)
+{
+  int ceiling = MAX_PROV_SESSIONS;
+
+  if (mng->cfg && mng->cfg->limits && mng->cfg->limits->prov_sessions) {
+    ceiling = mng->cfg->limits->prov_sessions;
+  }
+
+  SAFE_FREE(mng->cache.add.cache);
+  mng->cache.add.cache = calloc(ceiling, sizeof(add_cache_t));
+  ASSERT(mng->cache.add.cache);
+  mng->cache.add.ceiling = ceiling;
+  mng->cache.add.win.size = ceiling;
+  mng->cache.add.win.acked = 0;
+  LOGD("Provisioning sessions %d\n", ceiling);
 }
 
-/* only pass the prov class events */
-static inline bool is_add_events(const struct gecko_cmd_packet *e)
+void add_window_deinit(mng_t *mng)
 {
-  uint32_t evt_id = BGLIB_MSG_ID(e->header);
-  return ((evt_id & 0x000000ff) == 0x000000a0
-          && (evt_id & 0x00ff0000) == 0x00150000);
+  SAFE_FREE(mng->cache.add.cache);
+  mng->cache.add.ceiling = 0;
+  mng->cache.add.win.size = 0;
+}
+
+/*
+ * Additive increase - one more session after a full limit of devices are
+ * provisioned
+ */
+static void add_window_inc(mng_t *mng)
+{
+  if (++mng->cache.add.win.acked < mng->cache.add.win.size) {
+    return;
+  }
+  mng->cache.add.win.acked = 0;
+  if (mng->cache.add.win.size < mng->cache.add.ceiling) {
+    mng->cache.add.win.size++;
+    LOGD("Provisioning limit grows to %d\n", mng->cache.add.win.size);
+  }
+}
+
+/*
+ * Multiplicative decrease - halve the limit on OOM, the sessions already
+ * started go on
+ */
+static void add_window_dec(mng_t *mng)
+{
+  mng->cache.add.win.acked = 0;
+  mng->cache.add.win.size = MAX(1, mng->cache.add.win.size / 2);
+  LOGD("Provisioning limit shrinks to %d\n", mng->cache.add.win.size);
+}
+
+static const uint32_t add_evts[] = {
+  gecko_evt_mesh_prov_unprov_beacon_id,
+  gecko_evt_mesh_prov_device_provisioned_id,
+  gecko_evt_mesh_prov_provisioning_failed_id,
+};
+
+void dev_add_hdr_init(void)
+{
+  bgevt_register(dev_add_hdr, add_evts, ARR_LEN(add_evts));
 }
 
 int dev_add_hdr(const struct gecko_cmd_packet *evt)
@@ -93,9 +191,6 @@ int dev_add_hdr(const struct gecko_cmd_packet *evt)
   mng_t *mng = get_mng();
   ASSERT(evt);
 
-  if (!is_add_events(evt)) {
-    return 0;
-  }
   if (mng->state != adding_devices_em && mng->status.free_mode != 2) {
     return 0;
   }
@@ -117,12 +212,21 @@ int dev_add_hdr(const struct gecko_cmd_packet *evt)
   return 1;
 }
 
+static inline uint32_t __uuid_hash(const uint8_t *uuid)
+{
+  /* FNV-1a */
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < 16; i++) {
+    h = (h ^ uuid[i]) * 16777619u;
+  }
+  return h;
+}
+
 static void on_beacon_recv(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t *evt)
 {
-  int freeid;
-  uint16_t ret;
-  mng_t *mng = get_mng();
-  node_t *n;
+  uint64_t now;
+  uint32_t h;
+  int i, slot = -1;
 
   ASSERT(evt);
 
@@ -131,12 +235,57 @@ static void on_beacon_recv(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t
     return;
   }
 
+  now = evloop_now_ms();
+  h = __uuid_hash(evt->uuid.data);
+  for (int p = 0; p < BEACON_FILTER_PROBES; p++) {
+    i = (h + p) & (BEACON_FILTER_SIZE - 1);
+    if (bf.seen[i].until && !memcmp(bf.seen[i].uuid, evt->uuid.data, 16)) {
+      if (now < bf.seen[i].until) {
+        bf.filtered++;
+        return;
+      }
+      slot = i;
+      break;
+    }
+    /* Take the free or expired slot, or the one expiring first */
+    if (slot == -1 || bf.seen[i].until < bf.seen[slot].until) {
+      slot = i;
+    }
+  }
+
+  bf.handled++;
+  memcpy(bf.seen[slot].uuid, evt->uuid.data, 16);
+  bf.seen[slot].until = now + __beacon_handle(evt);
+}
+
+void beacon_filter_clr(void)
+{
+  memset(bf.seen, 0, sizeof(bf.seen));
+}
+
+void beacon_filter_stat_get(uint32_t *handled, uint32_t *filtered)
+{
+  *handled = bf.handled;
+  *filtered = bf.filtered;
+}
+
+/*
+ * Handle the beacon, return how long in ms to hold off the next one from the
+ * same device
+ */
+static uint32_t __beacon_handle(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t *evt)
+{
+  int freeid;
+  uint16_t ret;
+  mng_t *mng = get_mng();
+  node_t *n;
+
   if (-1 != iscached(mng, evt->uuid.data, &freeid)) {
-    return;
+    return BEACON_RATE_MS;
   }
 
   if (freeid == -1) {
-    return;
+    return BEACON_RATE_MS;
   }
 
   n = cfgdb_unprov_dev_get(evt->uuid.data);
@@ -152,9 +301,9 @@ static void on_beacon_recv(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t
         elog(e);
       }
     }
-    return;
+    return BEACON_IGNORE_MS;
   } else if (n->rmorbl) {
-    return;
+    return BEACON_IGNORE_MS;
   }
 
   LOGM("Unprovisioned beacon match. Start provisioning it\n");
@@ -164,7 +313,8 @@ static void on_beacon_recv(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t
   if (bg_err_out_of_memory == ret) {
     LOGW("Provision Device OOM\n");
     mng->status.oom = 1;
-    mng->status.oom_expired = time(NULL) + OOM_DELAY_TIMEOUT;
+    backoff_engage(&mng->status.oom_bo, bo_add_em);
+    add_window_dec(mng);
     if (!scan_need_recover) {
       scan_need_recover = true;
       ret = gecko_cmd_mesh_prov_stop_scan_unprov_beacons()->result;
@@ -172,15 +322,17 @@ static void on_beacon_recv(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t
         LOGBGE("stop unprov beacon scanning", ret);
       }
     }
-    return;
+    return BEACON_RATE_MS;
   } else if (bg_err_success != ret) {
     LOGBGE("provision device", ret);
-    return;
+    return BEACON_RATE_MS;
   }
 
-  mng->cache.add[freeid].busy = 1;
-  mng->cache.add[freeid].expired = time(NULL) + ADD_NO_RSP_TIMEOUT;
-  memcpy(mng->cache.add[freeid].uuid, evt->uuid.data, 16);
+  /* Accepted by the NCP target, the next OOM starts from the base delay */
+  backoff_reset(&mng->status.oom_bo);
+  mng->cache.add.cache[freeid].busy = 1;
+  mng->cache.add.cache[freeid].expired = time(NULL) + ADD_NO_RSP_TIMEOUT;
+  memcpy(mng->cache.add.cache[freeid].uuid, evt->uuid.data, 16);
 
   if (is_cache_full(mng)) {
     scan_need_recover = true;
@@ -189,6 +341,7 @@ static void on_beacon_recv(const struct gecko_msg_mesh_prov_unprov_beacon_evt_t
       LOGBGE("stop unprov beacon scanning", ret);
     }
   }
+  return BEACON_RATE_MS;
 }
 
 static void on_prov_success(const struct gecko_msg_mesh_prov_device_provisioned_evt_t *evt)
@@ -210,18 +363,13 @@ static void on_prov_success(const struct gecko_msg_mesh_prov_device_provisioned_
   n = cfgdb_node_get(evt->address);
   ASSERT(n);
   mng->lists.add = g_list_remove(mng->lists.add, n);
-  mng->lists.config = g_list_append(mng->lists.config, n);
+  acc_list_add(mng, n, false);
 
   stat_add_one_dev();
+  add_window_inc(mng);
   /* Remove from cache. */
   rmcached(mng, evt->uuid.data);
-  if (scan_need_recover) {
-    scan_need_recover = false;
-    uint16_t ret = gecko_cmd_mesh_prov_scan_unprov_beacons()->result;
-    if (bg_err_success != ret) {
-      LOGBGE("scan unprov beacon", ret);
-    }
-  }
+  __scan_resume(mng);
 }
 
 #if !defined(UID_458729_FIX) || (UID_458729_FIX == 0)
@@ -332,35 +480,23 @@ static void on_prov_failed(const struct gecko_msg_mesh_prov_provisioning_failed_
   stat_add_failed();
   /* Remove from cache. */
   rmcached(get_mng(), evt->uuid.data);
-  if (scan_need_recover) {
-    scan_need_recover = false;
-    uint16_t ret = gecko_cmd_mesh_prov_scan_unprov_beacons()->result;
-    if (bg_err_success != ret) {
-      LOGBGE("scan unprov beacon", ret);
-    }
-  }
+  __scan_resume(get_mng());
 }
 
 bool add_loop(void *p)
 {
   mng_t *mng = (mng_t *)p;
-  if (mng->status.oom && time(NULL) > mng->status.oom_expired) {
+  if (mng->status.oom && backoff_ready(&mng->status.oom_bo)) {
     mng->status.oom = 0;
-    if (scan_need_recover) {
-      scan_need_recover = false;
-      uint16_t ret = gecko_cmd_mesh_prov_scan_unprov_beacons()->result;
-      if (bg_err_success != ret) {
-        LOGBGE("scan unprov beacon", ret);
-      }
-    }
   }
-  for (int i = 0; i < MAX_PROV_SESSIONS; i++) {
-    if (!mng->cache.add[i].busy || time(NULL) < mng->cache.add[i].expired) {
+  for (int i = 0; i < mng->cache.add.ceiling; i++) {
+    if (!mng->cache.add.cache[i].busy || time(NULL) < mng->cache.add.cache[i].expired) {
       continue;
     }
     /* Remove from cache. */
     LOGE("Adding expired, clear cache.\n");
-    memset(&mng->cache.add[i], 0, sizeof(add_cache_t));
+    memset(&mng->cache.add.cache[i], 0, sizeof(add_cache_t));
   }
+  __scan_resume(mng);
   return false;
 }
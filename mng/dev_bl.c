@@ -13,6 +13,7 @@
 #include "cli.h"
 #include "cfg.h"
 #include "stat.h"
+#include "bgevt_hdr.h"
 
 /* Defines  *********************************************************** */
 
@@ -146,6 +147,17 @@ bool bl_loop(void *p)
   return busy;
 }
 
+static const uint32_t bl_evts[] = {
+  gecko_evt_mesh_prov_key_refresh_node_update_id,
+  gecko_evt_mesh_prov_key_refresh_phase_update_id,
+  gecko_evt_mesh_prov_key_refresh_complete_id,
+};
+
+void bl_hdr_init(void)
+{
+  bgevt_register(bl_hdr, bl_evts, ARR_LEN(bl_evts));
+}
+
 int bl_hdr(const struct gecko_cmd_packet *e)
 {
   ASSERT(e);
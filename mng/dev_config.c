@@ -13,16 +13,38 @@
 #include "cli.h"
 #include "utils.h"
 #include "stat.h"
+#include "bgevt_hdr.h"
+#include "acc_plan.h"
+#include "dcd_cache.h"
+#include "breaker.h"
 /* Defines  *********************************************************** */
 enum {
   type_config,
   type_rm,
 };
 
+/*
+ * Config client handle -> cache index, open addressing with linear probing.
+ * At least twice the number of caches to keep the probes short.
+ */
+#define HMAP_SLOTS 64
+#define HMAP_MASK (HMAP_SLOTS - 1)
+#define HMAP_EMPTY 0
+#if (HMAP_SLOTS < 2 * CONFIG_NODES_HARD_LIMIT)
+#error "HMAP_SLOTS too small"
+#endif
+
+typedef struct {
+  uint32_t handle;
+  /* Index of the cache + 1, HMAP_EMPTY if not in use */
+  int idx;
+}hslot_t;
+
 /* Global Variables *************************************************** */
 
 /* Static Variables *************************************************** */
 static acc_t acc = { 0 };
+static hslot_t hmap[HMAP_SLOTS];
 
 static const acc_state_t as_get_dcd = {
   get_dcd_em,
@@ -140,8 +162,90 @@ const char *state_names[] = {
 #define MAX_STATE_NAME_LEN  sizeof("Set TTL/Proxy/Friend/Relay/Nettx")
 /* Static Functions Declaractions ************************************* */
 static int config_engine(mng_t *mng);
+
+static inline int __hmap_pos(uint32_t handle)
+{
+  /* Handles are mostly sequential, scramble them anyway */
+  return (handle * 2654435761u) >> 26;
+}
+
+static inline void __hmap_clr(void)
+{
+  memset(hmap, 0, sizeof(hmap));
+}
+
+static int __hmap_find(uint32_t handle)
+{
+  int pos = __hmap_pos(handle);
+
+  for (int n = 0; n < HMAP_SLOTS && hmap[pos].idx != HMAP_EMPTY; n++) {
+    if (hmap[pos].handle == handle) {
+      return pos;
+    }
+    pos = (pos + 1) & HMAP_MASK;
+  }
+  return -1;
+}
+
+/* Backward shift deletion, no tombstones */
+static void __hmap_del(int pos)
+{
+  int next = pos, home;
+
+  while (1) {
+    hmap[pos].idx = HMAP_EMPTY;
+    while (1) {
+      next = (next + 1) & HMAP_MASK;
+      if (hmap[next].idx == HMAP_EMPTY) {
+        return;
+      }
+      home = __hmap_pos(hmap[next].handle);
+      /* Move it back only if pos is within [home, next) cyclically */
+      if (((next - home) & HMAP_MASK) >= ((next - pos) & HMAP_MASK)) {
+        break;
+      }
+    }
+    hmap[pos] = hmap[next];
+    pos = next;
+  }
+}
+
+/* Unbind the handle from the cache if it's bound to it */
+static void __handle_unbind(const config_cache_t *c)
+{
+  config_cache_t *base = get_mng()->cache.config.cache;
+  int pos = __hmap_find(c->cc_handle);
+
+  if (pos != -1 && base && hmap[pos].idx == c - base + 1) {
+    __hmap_del(pos);
+  }
+}
+
+void acc_handle_set(config_cache_t *cache, uint32_t handle)
+{
+  int pos;
+
+  if (RSP_PENDING(cache)) {
+    /* Placeholder response of an async command, acc_async_rsp binds the real
+     * handle */
+    return;
+  }
+  __handle_unbind(cache);
+  cache->cc_handle = handle;
+  if (-1 == (pos = __hmap_find(handle))) {
+    pos = __hmap_pos(handle);
+    while (hmap[pos].idx != HMAP_EMPTY) {
+      pos = (pos + 1) & HMAP_MASK;
+    }
+  }
+  hmap[pos].handle = handle;
+  hmap[pos].idx = cache - get_mng()->cache.config.cache + 1;
+}
+
 static inline void __cache_reset(config_cache_t *c)
 {
+  __handle_unbind(c);
+  plan_put(c);
   memset(c, 0, sizeof(config_cache_t));
   c->state = provisioned_em;
   c->next_state = get_dcd_em;
@@ -153,11 +257,61 @@ static inline void __cache_reset_idx(int i)
   __cache_reset(&get_mng()->cache.config.cache[i]);
 }
 
+static inline bo_path_em __bo_path(const config_cache_t *c)
+{
+  return (c->node->rmorbl & RM_BITMASK) ? bo_rm_em : bo_config_em;
+}
+
+/*
+ * Compile the list into the table, so that the hot path never walks the list.
+ * Only the first occurrence of a state counts, same as the old lookup.
+ */
+static void __acc_compile(void)
+{
+  acc_state_t *p, *n;
+
+  memset(acc.tbl.as, 0, sizeof(acc.tbl.as));
+  memset(acc.tbl.succ, -1, sizeof(acc.tbl.succ));
+
+  for (p = acc.states; p; p = p->next) {
+    if (acc.tbl.as[p->state]) {
+      continue;
+    }
+    acc.tbl.as[p->state] = p;
+    n = p->next;
+    while (n && !n->entry) {
+      n = n->next;
+    }
+    if (n) {
+      acc.tbl.succ[p->state] = n->state;
+    }
+  }
+}
+
+static inline const acc_state_t *__as(int state)
+{
+  if (state < 0 || state >= ACC_STATES_MAX) {
+    return NULL;
+  }
+  return acc.tbl.as[state];
+}
+
+static inline const acc_state_t *__as_succ(int state)
+{
+  if (state < 0 || state >= ACC_STATES_MAX || acc.tbl.succ[state] == -1) {
+    return NULL;
+  }
+  return acc.tbl.as[acc.tbl.succ[state]];
+}
+
 err_t add_state_after(const acc_state_t *ps, acc_state_emt state)
 {
-  bool found = false;
   acc_state_t *p = acc.states;
-  acc_state_t *pi, *pn;
+  acc_state_t *pi;
+
+  if (ps->state < 0 || ps->state >= ACC_STATES_MAX) {
+    return err(ec_param_invalid);
+  }
   /* Add to the head */
   if (state == -1) {
     pi = (acc_state_t *)calloc(1, sizeof(acc_state_t));
@@ -165,27 +319,20 @@ err_t add_state_after(const acc_state_t *ps, acc_state_emt state)
     pi->next = acc.states;
     acc.states = pi;
     acc.state_num++;
+    __acc_compile();
     return ec_success;
   }
 
-  while (p) {
-    if (p->state == state) {
-      found = true;
-      break;
-    }
-    p = p->next;
-  }
-
-  if (!found) {
+  if (state < 0 || state >= ACC_STATES_MAX || !(p = (acc_state_t *)acc.tbl.as[state])) {
     return err(ec_not_exist);
   }
 
   pi = (acc_state_t *)calloc(1, sizeof(acc_state_t));
   memcpy(pi, ps, sizeof(acc_state_t));
-  pn = p->next;
+  pi->next = p->next;
   p->next = pi;
-  pi->next = pn;
   acc.state_num++;
+  __acc_compile();
 
   return ec_success;
 }
@@ -205,11 +352,16 @@ static void __acc_reset(bool use_default)
   mng_t *mng = get_mng();
 
   if (mng->lists.fail) {
-    mng->lists.config = g_list_concat(mng->lists.config, mng->lists.fail);
+    for (GList *l = mng->lists.fail; l; l = l->next) {
+      acc_list_add(mng, (node_t *)l->data, false);
+    }
+    g_list_free(mng->lists.fail);
     mng->lists.fail = NULL;
   }
 
-  for (int i = 0; i < MAX_CONCURRENT_CONFIG_NODES; i++) {
+  for (int i = 0;
+       mng->cache.config.cache && i < mng->cache.config.ceiling + mng->cache.config.lpn;
+       i++) {
     __cache_reset(&mng->cache.config.cache[i]);
   }
   mng->cache.config.used = 0;
@@ -224,6 +376,7 @@ static void __acc_reset(bool use_default)
     p = pn;
   }
   acc.states = NULL;
+  __acc_compile();
 
   add_state_after(&as_get_dcd, -1);
   add_state_after(&as_end, get_dcd_em);
@@ -233,6 +386,134 @@ static void __acc_reset(bool use_default)
   }
 }
 
+void acc_window_init(mng_t *mng)
+{
+  int ceiling = MAX_CONCURRENT_CONFIG_NODES;
+  int lpn = LPN_CONCURRENT_CONFIG_NODES;
+
+  if (mng->cfg && mng->cfg->limits && mng->cfg->limits->config_nodes) {
+    ceiling = mng->cfg->limits->config_nodes;
+  }
+  if (mng->cfg && mng->cfg->limits && mng->cfg->limits->lpn_nodes) {
+    lpn = mng->cfg->limits->lpn_nodes;
+  }
+  ceiling = MIN(ceiling, CONFIG_NODES_HARD_LIMIT);
+  lpn = MIN(lpn, CONFIG_NODES_HARD_LIMIT - ceiling);
+
+  __hmap_clr();
+  SAFE_FREE(mng->cache.config.cache);
+  mng->cache.config.cache = calloc(ceiling + lpn, sizeof(config_cache_t));
+  ASSERT(mng->cache.config.cache);
+  for (int i = 0; i < ceiling + lpn; i++) {
+    __cache_reset(&mng->cache.config.cache[i]);
+  }
+  mng->cache.config.used = 0;
+  mng->cache.config.ceiling = ceiling;
+  mng->cache.config.lpn = lpn;
+  mng->cache.config.win.size = MIN(CONFIG_WINDOW_INIT, ceiling);
+  mng->cache.config.win.acked = 0;
+  mng->cache.config.win.recovering = false;
+  LOGD("Config window %d, ceiling %d, LPN %d\n",
+       mng->cache.config.win.size,
+       ceiling,
+       lpn);
+}
+
+void acc_window_deinit(mng_t *mng)
+{
+  SAFE_FREE(mng->cache.config.cache);
+  mng->cache.config.ceiling = 0;
+  mng->cache.config.lpn = 0;
+  mng->cache.config.used = 0;
+}
+
+bool acc_node_is_lpn(const node_t *n)
+{
+  const product_t *p = n->config.product;
+  const uint8_t *data;
+  uint8_t len;
+
+  if (IS_BIT_SET(n->config.features.target, LPN_BITOFS)) {
+    return true;
+  }
+  if (!p || NULL == (data = dcd_cache_get(p->cid, p->pid, p->vid, &len))
+      || len < 10) {
+    return false;
+  }
+  /* Features of DCD page 0 follow CID, PID, VID and CRPL */
+  return IS_BIT_SET(BUILD_UINT16(data[8], data[9]), LPN_BITOFS);
+}
+
+void acc_list_add(mng_t *mng, node_t *n, bool rm)
+{
+  GList **l;
+  bool lpn = mng->cache.config.lpn && acc_node_is_lpn(n);
+
+  if (!breaker_admit(n)) {
+    /* Parked until the next probe, doesn't hold the sync */
+    mng->lists.quar = g_list_append(mng->lists.quar, n);
+    return;
+  }
+  if (rm) {
+    l = lpn ? &mng->lists.lpn.rm : &mng->lists.rm;
+  } else {
+    l = lpn ? &mng->lists.lpn.config : &mng->lists.config;
+  }
+  *l = g_list_append(*l, n);
+}
+
+int acc_quar_release(mng_t *mng)
+{
+  GList *l, *next;
+  node_t *n;
+  int cnt = 0;
+
+  for (l = mng->lists.quar; l; l = next) {
+    next = l->next;
+    n = (node_t *)l->data;
+    if (!breaker_admit(n)) {
+      continue;
+    }
+    mng->lists.quar = g_list_delete_link(mng->lists.quar, l);
+    acc_list_add(mng, n, !!(n->rmorbl & RM_BITMASK));
+    cnt++;
+  }
+  return cnt;
+}
+
+/*
+ * Additive increase - one more cache after a full window of commands are
+ * answered by the nodes
+ */
+static void acc_window_inc(mng_t *mng)
+{
+  mng->cache.config.win.recovering = false;
+  if (++mng->cache.config.win.acked < mng->cache.config.win.size) {
+    return;
+  }
+  mng->cache.config.win.acked = 0;
+  if (mng->cache.config.win.size < mng->cache.config.ceiling) {
+    mng->cache.config.win.size++;
+    LOGD("Config window grows to %d\n", mng->cache.config.win.size);
+  }
+}
+
+/*
+ * Multiplicative decrease - halve the window on OOM or no response, only once
+ * until the next command is answered, since all the in-flight caches may
+ * suffer from the same congestion
+ */
+static void acc_window_dec(mng_t *mng)
+{
+  if (mng->cache.config.win.recovering) {
+    return;
+  }
+  mng->cache.config.win.recovering = true;
+  mng->cache.config.win.acked = 0;
+  mng->cache.config.win.size = MAX(1, mng->cache.config.win.size / 2);
+  LOGD("Config window shrinks to %d\n", mng->cache.config.win.size);
+}
+
 void acc_init(bool use_default)
 {
   if (acc.started) {
@@ -253,6 +534,8 @@ static inline void __cache_item_load(mng_t *mng,
 {
   config_cache_t * cache = &mng->cache.config.cache[ofs];
   cache->node = node;
+  cache->lpn = (ofs >= mng->cache.config.ceiling);
+  cache->probe = breaker_probing(node);
   if (type == type_config) {
     cache->state = provisioned_em;
     cache->next_state = get_dcd_em;
@@ -260,40 +543,69 @@ static inline void __cache_item_load(mng_t *mng,
     cache->state = end_em;
     cache->next_state = rm_em;
   }
-  LOGM("Node[0x%04x]: %s Started\n",
+  LOGM("Node[0x%04x]: %s Started%s%s\n",
        node->addr,
-       type == type_config ? "Configuring" : "Removing");
+       type == type_config ? "Configuring" : "Removing",
+       cache->lpn ? " (LPN)" : "",
+       cache->probe ? " (Probe)" : "");
   BIT_SET(mng->cache.config.used, ofs);
 }
 
-static int __caches_load(mng_t *mng, int type)
+static inline lbitmap_t __lane_mask(int base, int num)
 {
-  int loaded = 0, ofs;
-
-  if (MAX_CONCURRENT_CONFIG_NODES == utils_popcount(mng->cache.config.used)
-      || g_list_length((type == type_config)
-                       ? mng->lists.config : mng->lists.rm) == 0) {
-    /* No nodes to config or no room for config for now */
+  if (!num) {
     return 0;
   }
+  return (num >= 32 ? 0xffffffff : (1u << num) - 1) << base;
+}
 
-  while ((ofs = utils_frz(mng->cache.config.used)) < MAX_CONCURRENT_CONFIG_NODES) {
-    GList *item = g_list_first((type == type_config) ? mng->lists.config : mng->lists.rm);
-    if (!item) {
-      break;
-    }
+/*
+ * Load the nodes in the list to the caches [base, base + num) while less than
+ * limit of them are in use
+ */
+static int __lane_load(mng_t *mng,
+                       GList **list,
+                       int type,
+                       int base,
+                       int num,
+                       int limit)
+{
+  int loaded = 0, ofs;
+  GList *item;
+  lbitmap_t mask = __lane_mask(base, num);
+
+  while (*list && utils_popcount(mng->cache.config.used & mask) < limit) {
+    ofs = utils_frz(mng->cache.config.used | ~mask);
+    item = g_list_first(*list);
     __cache_item_load(mng, ofs, item->data, type);
     loaded++;
-    if (type == type_config) {
-      mng->lists.config = g_list_remove_link(mng->lists.config, item);
-    } else {
-      mng->lists.rm = g_list_remove_link(mng->lists.rm, item);
-    }
+    *list = g_list_remove_link(*list, item);
     g_list_free(item);
   }
   return loaded;
 }
 
+static int __caches_load(mng_t *mng, int type)
+{
+  int loaded;
+
+  /* The normal lane is limited by the adaptive window, the LPN lane only by
+   * its size as the LPNs are slow anyway */
+  loaded = __lane_load(mng,
+                       type == type_config ? &mng->lists.config : &mng->lists.rm,
+                       type,
+                       0,
+                       mng->cache.config.ceiling,
+                       mng->cache.config.win.size);
+  loaded += __lane_load(mng,
+                        type == type_config ? &mng->lists.lpn.config : &mng->lists.lpn.rm,
+                        type,
+                        mng->cache.config.ceiling,
+                        mng->cache.config.lpn,
+                        mng->cache.config.lpn);
+  return loaded;
+}
+
 bool acc_loop(void *p)
 {
   int cnt;
@@ -301,6 +613,9 @@ bool acc_loop(void *p)
     return false;
   }
   mng_t *mng = (mng_t *)p;
+  if (mng->lists.quar) {
+    acc_quar_release(mng);
+  }
   if (mng->state == removing_devices_em) {
     cnt = __caches_load(mng, type_rm);
     stat_rm_start();
@@ -320,33 +635,88 @@ bool acc_loop(void *p)
   return config_engine(mng);
 }
 
-static acc_state_t *as_get(int state)
+/*
+ * Check if the state is needed by the incremental reconfiguration, the
+ * features are left to the guard of setconfig state
+ */
+static bool __delta_wants(const cfg_delta_t *d, int state)
 {
-  acc_state_t *p = acc.states;
-  while (p) {
-    if (p->state == state) {
-      break;
+  switch (state) {
+    case get_dcd_em:
+      /* Pub and Sub iterate the models */
+      return d->what & (DELTA_PUB_BIT | DELTA_SUB_BIT);
+    case addappkey_em:
+    case bindappkey_em:
+      return false;
+    case setpub_em:
+      return d->what & DELTA_PUB_BIT;
+    case addsub_em:
+      return d->what & DELTA_SUB_BIT;
+    default:
+      return true;
+  }
+}
+
+/*
+ * Enter the state, the guard is evaluated once per node and the result is
+ * cached in the config cache
+ */
+static int __as_enter(config_cache_t *cache, const acc_state_t *as)
+{
+  if (cache->node->delta && !__delta_wants(cache->node->delta, as->state)) {
+    LOGD("Node[0x%04x]: State[%s] Not Changed\n",
+         cache->node->addr,
+         state_names[as->state]);
+    return asr_tonext;
+  }
+  if (as->guard) {
+    if (!IS_BIT_SET(cache->guards.evaluated, as->state)) {
+      BIT_SET(cache->guards.evaluated, as->state);
+      if (as->guard(cache)) {
+        BIT_SET(cache->guards.passed, as->state);
+      }
+    }
+    if (!IS_BIT_SET(cache->guards.passed, as->state)) {
+      LOGD("Node[0x%04x]: State[%s] Guard Not Passed\n",
+           cache->node->addr,
+           state_names[as->state]);
+      return asr_tonext;
     }
-    p = p->next;
   }
-  return p;
+  return as->entry(cache, NULL);
+}
+
+/*
+ * The quarantined node gets a single try per state, the first timeout ends the
+ * probe and the node stays in quarantine
+ */
+static void __probe_fail(config_cache_t *cache)
+{
+  LOGW("Node[0x%04x]: Probe Failed in %s\n",
+       cache->node->addr,
+       state_names[cache->state]);
+  RETRY_CLEAR(cache);
+  if (cache->state == rm_em) {
+    err_set_to_rm_end(cache, bg_err_timeout, bgevent_em);
+  } else {
+    err_set_to_end(cache, bg_err_timeout, bgevent_em);
+  }
 }
 
 static bool to_next_state(config_cache_t *cache)
 {
-  acc_state_t *as, *nas;
+  const acc_state_t *as, *nas;
 
-  as = as_get(cache->state);
-  nas = (cache->next_state == -1) ? as->next : as_get(cache->next_state);
+  as = __as(cache->state);
+  nas = __as(cache->next_state);
 
   if (!nas) {
     /* If specified next state doesn't exist, load the next of the current */
     /* state */
-    nas = as->next;
-  }
-  /* Find next state with valid entry */
-  while (nas && !nas->entry) {
-    nas = nas->next;
+    nas = __as_succ(cache->state);
+  } else if (!nas->entry) {
+    /* Find next state with valid entry */
+    nas = __as_succ(nas->state);
   }
 
   /* If current state exit callback exist, exist first */
@@ -361,7 +731,7 @@ static bool to_next_state(config_cache_t *cache)
     LOGV("Node[0x%04x]: Try to Enter %s State\n",
          cache->node->addr,
          state_names[nas->state]);
-    switch (nas->entry(cache, nas->guard)) {
+    switch (__as_enter(cache, nas)) {
       case asr_suc:
       case asr_oom:
         cache->state = nas->state;
@@ -373,10 +743,10 @@ static bool to_next_state(config_cache_t *cache)
       /* Implementation of the callback should make sure that won't return this
        * if not more states to load */
       case asr_tonext:
-        nas = nas->next;
+        nas = __as_succ(nas->state);
         break;
       default:
-        nas = as_get(end_em);
+        nas = __as(end_em);
         break;
     }
   }
@@ -388,33 +758,50 @@ static int config_engine(mng_t *mng)
 {
   int i, busy = 0;
   int ret = 0;
-  acc_state_t *as = NULL;
+  const acc_state_t *as = NULL;
   config_cache_t *cache = NULL;
   lbitmap_t usedmap;
 
   usedmap = mng->cache.config.used;
   while (usedmap) {
     i = utils_ctz(usedmap);
-    ASSERT(i < MAX_CONCURRENT_CONFIG_NODES);
+    ASSERT(i < mng->cache.config.ceiling + mng->cache.config.lpn);
     BIT_CLR(usedmap, i);
     cache = &mng->cache.config.cache[i];
-    as = as_get(cache->state);
+    as = __as(cache->state);
 
     /*
      * Check if any **Exception** (OOM | Guard timer expired) happened in last round
      */
-    if (cache->expired && (time(NULL) > cache->expired) && as->retry) {
-      ret = as->retry(cache, on_guard_timer_expired_em);
+    if (cache->expired && (time(NULL) > cache->expired) && cache->probe) {
+      __probe_fail(cache);
+    } else if (cache->expired && (time(NULL) > cache->expired) && as->retry
+               && !RETRY_BO(cache)) {
+      /* A slow LPN tells nothing about the load of the NCP target */
+      if (!cache->lpn) {
+        acc_window_dec(mng);
+      }
+      /* Don't hammer a congested network, retry when the backoff is ready */
+      RETRY_BO_SET(cache);
+      backoff_engage(&cache->bo, __bo_path(cache));
+    } else if (RETRY_BO(cache) && as->retry && backoff_ready(&cache->bo)) {
+      RETRY_BO_CLEAR(cache);
+      if (cache->expired) {
+        ret = as->retry(cache, on_guard_timer_expired_em);
+      } else {
+        ret = as->retry(cache, on_timeout_em);
+      }
       if (mng->state == removing_devices_em) {
         stat_rm_retry();
       } else {
         stat_config_retry();
       }
-      if (ret != asr_suc) {
-        LOGE("Retry on Expired Returns %d\n", ret);
+      if (ret != asr_suc && ret != asr_oom) {
+        LOGE("Retry on Timeout Returns %d\n", ret);
       }
-    } else if (OOM(cache) && as->retry) {
+    } else if (OOM(cache) && as->retry && backoff_ready(&cache->bo)) {
       ASSERT(!WAIT_RESPONSE(cache));
+      acc_window_dec(mng);
       ret = as->retry(cache, on_oom_em);
       if (mng->state == removing_devices_em) {
         stat_rm_retry();
@@ -422,7 +809,9 @@ static int config_engine(mng_t *mng)
         stat_config_retry();
       }
       if (ret == asr_oom) {
-        LOGE("OOM Once Again, **NEED BACKOFF MECHANISM**\n");
+        LOGW("Node[0x%04x]: OOM Once Again, Backoff Level %d\n",
+             cache->node->addr,
+             cache->bo.level);
       } else if (ret != asr_suc) {
         LOGE("Retry on OOM Returns %d\n", ret);
       } else {
@@ -440,8 +829,16 @@ static int config_engine(mng_t *mng)
     busy |= to_next_state(cache);
     if (cache->state == end_em || cache->state == rmend_em) {
       if (cache->err_cache.bgcall || cache->err_cache.bgevt) {
-        /* Error happens, add the node to fail list */
-        mng->lists.fail = g_list_append(mng->lists.fail, cache->node);
+        if (breaker_report(cache->node,
+                           cache->err_cache.general == bg_err_timeout)) {
+          /* Quarantined, released by acc_quar_release when the probe is due */
+          mng->lists.quar = g_list_append(mng->lists.quar, cache->node);
+        } else {
+          /* Error happens, add the node to fail list */
+          mng->lists.fail = g_list_append(mng->lists.fail, cache->node);
+        }
+      } else {
+        breaker_report(cache->node, false);
       }
       __cache_reset_idx(i);
     }
@@ -450,80 +847,102 @@ static int config_engine(mng_t *mng)
   return busy;
 }
 
-static inline bool is_config_device_events(const struct gecko_cmd_packet *e)
+static void acc_async_rsp(const struct gecko_cmd_packet *rsp, void *ctx)
 {
-  uint32_t evt_id = BGLIB_MSG_ID(e->header);
-  return ((evt_id & 0x000000ff) == 0x000000a0
-          && (evt_id & 0x00ff0000) == 0x00270000);
+  config_cache_t *cache = (config_cache_t *)ctx;
+  /* All the config client command responses are {result, handle} */
+  const struct gecko_msg_mesh_config_client_bind_model_rsp_t *r
+    = &rsp->data.rsp_mesh_config_client_bind_model;
+
+  if (!cache->node || !RSP_PENDING(cache)) {
+    /* The cache is reset in between */
+    return;
+  }
+  RSP_PENDING_CLEAR(cache);
+
+  if (r->result == bg_err_success) {
+    acc_handle_set(cache, r->handle);
+    return;
+  }
+
+  WAIT_RESPONSE_CLEAR(cache);
+  timer_set(cache, 0);
+  if (r->result == bg_err_out_of_memory) {
+    oom_set(cache, __bo_path(cache));
+    return;
+  }
+  LOGE("Node[0x%04x]: %s Command Failed, Err <0x%04x>\n",
+       cache->node->addr,
+       state_names[cache->state],
+       r->result);
+  if (cache->state == rm_em) {
+    err_set_to_rm_end(cache, r->result, bgapi_em);
+  } else {
+    err_set_to_end(cache, r->result, bgapi_em);
+  }
 }
 
-static config_cache_t *cache_from_cchandle(const struct gecko_cmd_packet *e)
+void acc_cmd_async(config_cache_t *cache)
 {
-  int i;
-  uint32_t handle;
-  lbitmap_t usedmap;
-  mng_t *mng = get_mng();
+  if (0 == gecko_cmd_async(acc_async_rsp, cache)) {
+    RSP_PENDING_SET(cache);
+  }
+}
 
-  switch (BGLIB_MSG_ID(e->header)) {
-    case gecko_evt_mesh_config_client_dcd_data_id:
-      handle = e->data.evt_mesh_config_client_dcd_data.handle;
-      break;
-    case gecko_evt_mesh_config_client_dcd_data_end_id:
-      handle = e->data.evt_mesh_config_client_dcd_data_end.handle;
-      break;
-    case gecko_evt_mesh_config_client_appkey_status_id:
-      handle = e->data.evt_mesh_config_client_appkey_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_binding_status_id:
-      handle = e->data.evt_mesh_config_client_binding_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_model_pub_status_id:
-      handle = e->data.evt_mesh_config_client_model_pub_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_model_sub_status_id:
-      handle = e->data.evt_mesh_config_client_model_sub_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_relay_status_id:
-      handle = e->data.evt_mesh_config_client_relay_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_friend_status_id:
-      handle = e->data.evt_mesh_config_client_friend_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_gatt_proxy_status_id:
-      handle = e->data.evt_mesh_config_client_gatt_proxy_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_default_ttl_status_id:
-      handle = e->data.evt_mesh_config_client_default_ttl_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_network_transmit_status_id:
-      handle = e->data.evt_mesh_config_client_network_transmit_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_reset_status_id:
-      handle = e->data.evt_mesh_config_client_reset_status.handle;
-      break;
-    case gecko_evt_mesh_config_client_beacon_status_id:
-      handle = e->data.evt_mesh_config_client_beacon_status.handle;
-      break;
+static const uint32_t config_evts[] = {
+  gecko_evt_mesh_config_client_dcd_data_id,
+  gecko_evt_mesh_config_client_dcd_data_end_id,
+  gecko_evt_mesh_config_client_appkey_status_id,
+  gecko_evt_mesh_config_client_binding_status_id,
+  gecko_evt_mesh_config_client_model_pub_status_id,
+  gecko_evt_mesh_config_client_model_sub_status_id,
+  gecko_evt_mesh_config_client_relay_status_id,
+  gecko_evt_mesh_config_client_friend_status_id,
+  gecko_evt_mesh_config_client_gatt_proxy_status_id,
+  gecko_evt_mesh_config_client_default_ttl_status_id,
+  gecko_evt_mesh_config_client_network_transmit_status_id,
+  gecko_evt_mesh_config_client_reset_status_id,
+  gecko_evt_mesh_config_client_beacon_status_id,
+};
 
-    default:
-      LOGA("NEED ADD a case[0x%08x] to %s\n",
-           BGLIB_MSG_ID(e->header),
-           __FUNCTION__);
-      break;
-  }
+void dev_config_hdr_init(void)
+{
+  bgevt_register(dev_config_hdr, config_evts, ARR_LEN(config_evts));
+}
 
-  usedmap = mng->cache.config.used;
-  while (usedmap) {
-    i = utils_ctz(usedmap);
-    ASSERT(i < MAX_CONCURRENT_CONFIG_NODES);
-    BIT_CLR(usedmap, i);
-    if (mng->cache.config.cache[i].node && mng->cache.config.cache[i].cc_handle == handle) {
-      return &mng->cache.config.cache[i];
-    }
+/*
+ * All config client events start with {result, handle} except dcd_data, which
+ * starts with the handle
+ */
+static inline uint32_t __cc_handle(const struct gecko_cmd_packet *e)
+{
+  uint32_t handle;
+  const uint8_t *p = (const uint8_t *)&e->data.payload;
+
+  if (BGLIB_MSG_ID(e->header) != gecko_evt_mesh_config_client_dcd_data_id) {
+    p += sizeof(uint16_t);
   }
+  memcpy(&handle, p, sizeof(uint32_t));
+  return handle;
+}
 
-  LOGA("No Cache Found by handle\n");
-  return NULL;
+static config_cache_t *cache_from_cchandle(const struct gecko_cmd_packet *e)
+{
+  config_cache_t *c;
+  mng_t *mng = get_mng();
+  int pos = __hmap_find(__cc_handle(e));
+
+  if (pos == -1) {
+    LOGA("No Cache Found by handle\n");
+    return NULL;
+  }
+  ASSERT(hmap[pos].idx <= mng->cache.config.ceiling + mng->cache.config.lpn);
+  c = &mng->cache.config.cache[hmap[pos].idx - 1];
+  if (!c->node || RSP_PENDING(c)) {
+    LOGA("No Cache Found by handle\n");
+    return NULL;
+  }
+  return c;
 }
 
 int dev_config_hdr(const struct gecko_cmd_packet *e)
@@ -531,28 +950,31 @@ int dev_config_hdr(const struct gecko_cmd_packet *e)
   int ret = 0;
   ASSERT(e);
   config_cache_t *cache;
-  acc_state_t *state;
-
-  if (!is_config_device_events(e)) {
-    return 0;
-  }
+  const acc_state_t *state;
 
   cache = cache_from_cchandle(e);
-  state = as_get(cache->state);
+  state = __as(cache->state);
   ASSERT(state);
 
   if (WAIT_RESPONSE(cache) && state->inpg) {
+    /* The NCP target took the command, no more backing off */
+    backoff_reset(&cache->bo);
+    RETRY_BO_CLEAR(cache);
     ret = state->inpg(e, cache);
+    /* Count the command once when it completes, e.g. Get DCD has several
+     * events before the end one */
+    if (!WAIT_RESPONSE(cache) && !cache->lpn) {
+      acc_window_inc(get_mng());
+    }
   }
 
   /* Drived by timeout event */
-  if (!ret && !WAIT_RESPONSE(cache) && EVER_RETRIED(cache) && state->retry) {
-    ret |= state->retry(cache, on_timeout_em);
-    if (get_mng()->state == removing_devices_em) {
-      stat_rm_retry();
-    } else {
-      stat_config_retry();
-    }
+  if (!ret && !WAIT_RESPONSE(cache) && EVER_RETRIED(cache) && cache->probe) {
+    __probe_fail(cache);
+  } else if (!ret && !WAIT_RESPONSE(cache) && EVER_RETRIED(cache) && state->retry) {
+    /* Retried by config_engine when the backoff is ready */
+    RETRY_BO_SET(cache);
+    backoff_engage(&cache->bo, __bo_path(cache));
   } else if (ret == asr_unspec) {
     return 0;
   }
@@ -567,7 +989,8 @@ void timer_set(config_cache_t *cache, bool enable)
     return;
   }
   cache->expired = time(NULL) + CONFIG_NO_RSP_TIMEOUT;
-  if (!cache->dcd.elems || cache->dcd.feature & LPN_BITOFS) {
+  if (!cache->dcd.elems || cache->lpn
+      || IS_BIT_SET(cache->dcd.feature, LPN_BITOFS)) {
     /* Not able to figure out if the node is a LPN or normal node, always add
      * longest possible value to it, this also applies if the node is LPN */
     cache->expired += mng->cfg->timeout
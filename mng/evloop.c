@@ -0,0 +1,191 @@
+/*************************************************************************
+    > File Name: evloop.c
+    > Author: Kevin
+    > Created Time: 2020-02-10
+    > Description:
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if (__APPLE__ != 1)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#include "projconfig.h"
+#include "evloop.h"
+#include "logging.h"
+#include "utils.h"
+
+/* Defines  *********************************************************** */
+#define EVLOOP_MAX_EVENTS 4
+
+/* Global Variables *************************************************** */
+
+/* Static Variables *************************************************** */
+static struct {
+  int epfd;
+  int evfd;
+  int tmfd;
+  int ncpfd;
+  uint64_t armed;
+} evl = { -1, -1, -1, -1, 0 };
+
+/* Static Functions Declaractions ************************************* */
+#if (__APPLE__ == 1)
+/*
+ * epoll/eventfd/timerfd are not supported by macOS, fall back to the
+ * polling way
+ */
+err_t evloop_init(int ncpfd)
+{
+  evl.ncpfd = ncpfd;
+  return ec_success;
+}
+
+void evloop_deinit(void)
+{
+  evl.ncpfd = -1;
+}
+
+void evloop_notify(void)
+{
+}
+
+void evloop_wait(uint64_t deadline)
+{
+  usleep(10 * 1000);
+}
+#else
+static inline void __close(int *fd)
+{
+  if (*fd >= 0) {
+    close(*fd);
+    *fd = -1;
+  }
+}
+
+static int __epoll_add(int fd)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(struct epoll_event));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  return epoll_ctl(evl.epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void __drain(int fd)
+{
+  uint64_t v;
+  while (read(fd, &v, sizeof(uint64_t)) == sizeof(uint64_t)) ;
+}
+
+void evloop_deinit(void)
+{
+  __close(&evl.tmfd);
+  __close(&evl.evfd);
+  __close(&evl.epfd);
+  evl.ncpfd = -1;
+  evl.armed = 0;
+}
+
+err_t evloop_init(int ncpfd)
+{
+  evloop_deinit();
+
+  if (-1 == (evl.epfd = epoll_create1(EPOLL_CLOEXEC))
+      || -1 == (evl.evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+      || -1 == (evl.tmfd = timerfd_create(CLOCK_REALTIME,
+                                          TFD_NONBLOCK | TFD_CLOEXEC))) {
+    LOGE("Create event loop fds error[%s]\n", strerror(errno));
+    goto fail;
+  }
+
+  if (-1 == __epoll_add(evl.evfd) || -1 == __epoll_add(evl.tmfd)) {
+    LOGE("Register event loop fds error[%s]\n", strerror(errno));
+    goto fail;
+  }
+
+  if (ncpfd >= 0) {
+    if (-1 == __epoll_add(ncpfd)) {
+      LOGE("Register NCP fd[%d] error[%s]\n", ncpfd, strerror(errno));
+      goto fail;
+    }
+    evl.ncpfd = ncpfd;
+  }
+  LOGD("Event loop initialized, NCP fd[%d]\n", ncpfd);
+  return ec_success;
+
+  fail:
+  evloop_deinit();
+  return err(ec_errno);
+}
+
+void evloop_notify(void)
+{
+  uint64_t one = 1;
+  if (evl.evfd < 0) {
+    return;
+  }
+  if (write(evl.evfd, &one, sizeof(uint64_t)) != sizeof(uint64_t)
+      && errno != EAGAIN) {
+    LOGE("Event loop notify error[%s]\n", strerror(errno));
+  }
+}
+
+static void timer_arm(uint64_t deadline)
+{
+  struct itimerspec its;
+
+  if (deadline == evl.armed) {
+    return;
+  }
+  memset(&its, 0, sizeof(struct itimerspec));
+  /* All zero disarms the timer */
+  its.it_value.tv_sec = deadline / 1000;
+  its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+  if (-1 == timerfd_settime(evl.tmfd, TFD_TIMER_ABSTIME, &its, NULL)) {
+    LOGE("Arm guard timer error[%s]\n", strerror(errno));
+    return;
+  }
+  evl.armed = deadline;
+}
+
+void evloop_wait(uint64_t deadline)
+{
+  int n;
+  struct epoll_event evs[EVLOOP_MAX_EVENTS];
+
+  if (evl.epfd < 0) {
+    usleep(10 * 1000);
+    return;
+  }
+  if (deadline && deadline <= evloop_now_ms()) {
+    return;
+  }
+
+  timer_arm(deadline);
+  n = epoll_wait(evl.epfd, evs, EVLOOP_MAX_EVENTS, -1);
+  if (n < 0) {
+    if (errno != EINTR) {
+      LOGE("epoll_wait error[%s]\n", strerror(errno));
+    }
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (evs[i].data.fd == evl.evfd) {
+      __drain(evl.evfd);
+    } else if (evs[i].data.fd == evl.tmfd) {
+      __drain(evl.tmfd);
+      evl.armed = 0;
+    }
+    /* NCP fd is left to the bgevt_dispenser to read */
+  }
+}
+#endif
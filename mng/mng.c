@@ -10,6 +10,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <string.h>
+#include <unistd.h>
 /* #include <sys/prctl.h> */
 
 #include "hal/bg_uart_cbs.h"
@@ -27,10 +29,12 @@
 #include "cfg.h"
 #include "startup.h"
 #include "glib.h"
-#include "socket_handler.h"
 #include "gecko_bglib.h"
 #include "dev_config.h"
+#include "evloop.h"
+#include "dcd_cache.h"
 #include "stat.h"
+#include "breaker.h"
 /* Defines  *********************************************************** */
 /*
  * Default priority for taking actions: Adding > Removing > Blacklisting
@@ -39,18 +43,31 @@
 
 #define INVALID_CONN_HANDLE 0xff
 
-#define BL_BITMASK  0x01
-#define RM_BITMASK  0x10
+#define SEC_MS(s) ((uint64_t)(s) * 1000)
 
-typedef struct qitem{
+/*
+ * Single producer (CLI thread) single consumer (manager thread) command ring,
+ * CMDQ_SLOTS MUST be power of 2
+ */
+#define CMDQ_SLOTS 64
+#define CMDQ_MASK (CMDQ_SLOTS - 1)
+#define CMDQ_MAX_ARGS 32
+#define CMDQ_BUF_LEN 512
+
+/* Pre-tokenized command, argv points into buf */
+typedef struct {
   int offs;
-  wordexp_t *cmd;
-  struct qitem *next;
-}qitem_t;
+  int argc;
+  char *argv[CMDQ_MAX_ARGS + 1];
+  char buf[CMDQ_BUF_LEN];
+}cmdslot_t;
 
 typedef struct {
-  qitem_t *head;
-  qitem_t *tail;
+  cmdslot_t slots[CMDQ_SLOTS];
+  /* Written only by the producer */
+  size_t head;
+  /* Written only by the consumer */
+  size_t tail;
 }cmdq_t;
 
 typedef struct {
@@ -60,14 +77,13 @@ typedef struct {
 
 /* Global Variables *************************************************** */
 extern const command_t commands[];
-extern pthread_mutex_t qlock;
 err_t cmd_ret = ec_success;
-cmdq_t cmdq = { 0 };
 
 /* Static Variables *************************************************** */
 static mng_t mng = {
   .conn = 0xff
 };
+static cmdq_t cmdq = { 0 };
 
 /* Static Functions Declaractions ************************************* */
 static err_t clm_set_scan(int status);
@@ -76,53 +92,53 @@ static gboolean load_lists(gpointer key, gpointer value, gpointer data);
 /******************************************************************
  * Command queue
  * ***************************************************************/
-void cmd_enq(const char *str, int offs)
+err_t cmd_enq(int argc, char *const argv[], int offs)
 {
-  wordexp_t *w = NULL;
-  if (!str) {
-    return;
+  cmdslot_t *s;
+  size_t head, len, used = 0;
+
+  if (!argc || !argv) {
+    return err(ec_param_null);
   }
-  w = malloc(sizeof(wordexp_t));
-  if (wordexp(str, w, WRDE_NOCMD)) {
-    free(w);
-    return;
+  if (argc > CMDQ_MAX_ARGS) {
+    return err(ec_length_leak);
   }
-  qitem_t *qi = malloc(sizeof(qitem_t));
-  qi->cmd = w;
-  qi->offs = offs;
-  qi->next = NULL;
-  PTMTX_LOCK(&qlock);
-  if (cmdq.tail) {
-    cmdq.tail->next = qi;
-    cmdq.tail = qi;
-  } else {
-    cmdq.tail = cmdq.head = qi;
+  head = cmdq.head;
+  /* Back pressure - the manager drains all commands on each wakeup */
+  while (head - __atomic_load_n(&cmdq.tail, __ATOMIC_ACQUIRE) >= CMDQ_SLOTS) {
+    evloop_notify();
+    usleep(1000);
   }
-  PTMTX_UNLOCK(&qlock);
+
+  s = &cmdq.slots[head & CMDQ_MASK];
+  for (int i = 0; i < argc; i++) {
+    len = strlen(argv[i]) + 1;
+    if (used + len > CMDQ_BUF_LEN) {
+      return err(ec_length_leak);
+    }
+    memcpy(s->buf + used, argv[i], len);
+    s->argv[i] = s->buf + used;
+    used += len;
+  }
+  s->argv[argc] = NULL;
+  s->argc = argc;
+  s->offs = offs;
+  __atomic_store_n(&cmdq.head, head + 1, __ATOMIC_RELEASE);
+  evloop_notify();
+  return ec_success;
 }
 
-wordexp_t *cmd_deq(int *offs)
+static cmdslot_t *cmd_peek(void)
 {
-  wordexp_t *w = NULL;
-  qitem_t *qi;
-
-  PTMTX_LOCK(&qlock);
-  if (!cmdq.head) {
-    goto out;
-  }
-
-  w = cmdq.head->cmd;
-  *offs = cmdq.head->offs;
-  qi = cmdq.head;
-  cmdq.head = cmdq.head->next;
-  if (!cmdq.head) {
-    cmdq.tail = NULL;
+  if (cmdq.tail == __atomic_load_n(&cmdq.head, __ATOMIC_ACQUIRE)) {
+    return NULL;
   }
-  free(qi);
+  return &cmdq.slots[cmdq.tail & CMDQ_MASK];
+}
 
-  out:
-  PTMTX_UNLOCK(&qlock);
-  return w;
+static void cmd_release(void)
+{
+  __atomic_store_n(&cmdq.tail, cmdq.tail + 1, __ATOMIC_RELEASE);
 }
 
 mng_t *get_mng(void)
@@ -156,6 +172,7 @@ err_t clr_all(void *p)
     return err(ec_bgrsp);
   }
   usleep(300 * 1000);
+  breaker_clr();
   return ec_success;
 }
 
@@ -191,19 +208,19 @@ static void set_mng_state(void)
     }
     stat_add_end();
 
-    if (g_list_length(mng.lists.config) || mng.cache.config.used) {
+    if (mng_config_pending(&mng) || mng.cache.config.used) {
       /* configuring in progress after adding devices, switch directly */
       mng.state = configuring_devices_em;
       return;
     }
   } else if (mng.state == configuring_devices_em) {
-    if (g_list_length(mng.lists.config) || mng.cache.config.used) {
+    if (mng_config_pending(&mng) || mng.cache.config.used) {
       return;
     }
     /* All nodes have been configured properly */
     stat_config_end();
   } else if (mng.state == removing_devices_em) {
-    if (g_list_length(mng.lists.rm) || mng.cache.config.used) {
+    if (mng_rm_pending(&mng) || mng.cache.config.used) {
       return;
     }
     /* All RM set nodes have been removed properly */
@@ -228,12 +245,12 @@ static void set_mng_state(void)
         stat_add_start();
         mng.state = adding_devices_em;
         loaded = true;
-      } else if (g_list_length(mng.lists.config)) {
+      } else if (mng_config_pending(&mng)) {
         mng.state = configuring_devices_em;
         loaded = true;
       }
     } else if (mng.status.seq.prios[mng.status.seq.offs] == 'r') {
-      if (!g_list_length(mng.lists.rm)) {
+      if (!mng_rm_pending(&mng)) {
         continue;
       }
       mng.state = removing_devices_em;
@@ -261,11 +278,82 @@ static void set_mng_state(void)
   }
 }
 
+static inline void __deadline_update(uint64_t *dl, uint64_t t)
+{
+  if (t && (!*dl || t < *dl)) {
+    *dl = t;
+  }
+}
+
+/*
+ * Find out when the loops need to run again if neither NCP target nor CLI
+ * raises anything.
+ *
+ * Return 0 if nothing is pending, otherwise the absolute time in ms to wake up.
+ * The guard timers are checked with "now > expired", so one more second is
+ * added.
+ */
+static uint64_t next_deadline(void)
+{
+  int i;
+  uint64_t dl = 0, now = evloop_now_ms();
+  lbitmap_t usedmap = mng.cache.config.used;
+
+  if (g_list_length(mng.cache.model_set.nodes)
+      || mng.cache.bl.state == bl_prepare
+      || mng.cache.bl.state == bl_done) {
+    return now;
+  }
+
+  while (usedmap) {
+    i = utils_ctz(usedmap);
+    BIT_CLR(usedmap, i);
+    if (OOM(&mng.cache.config.cache[i])
+        || RETRY_BO(&mng.cache.config.cache[i])) {
+      __deadline_update(&dl, MAX(now, mng.cache.config.cache[i].bo.due));
+    }
+    if (mng.cache.config.cache[i].expired
+        && !RETRY_BO(&mng.cache.config.cache[i])) {
+      __deadline_update(&dl, SEC_MS(mng.cache.config.cache[i].expired + 1));
+    }
+  }
+
+  for (i = 0; i < mng.cache.add.ceiling; i++) {
+    if (mng.cache.add.cache[i].busy) {
+      __deadline_update(&dl, SEC_MS(mng.cache.add.cache[i].expired));
+    }
+  }
+  if (mng.status.oom) {
+    __deadline_update(&dl, MAX(now, mng.status.oom_bo.due));
+  }
+  /* Quarantined nodes are released in Idle and by acc_loop */
+  if (mng.state == configured
+      || (mng.state >= adding_devices_em && mng.state <= removing_devices_em)) {
+    for (GList *l = mng.lists.quar; l; l = l->next) {
+      uint64_t due = breaker_due((node_t *)l->data);
+      if (due) {
+        __deadline_update(&dl, MAX(now, due));
+      }
+    }
+  }
+  __deadline_update(&dl, SEC_MS(demo_next_run()));
+  __deadline_update(&dl, nodes_sync_due());
+
+  if (mng.state > configured) {
+    /* Safety net for the states which are driven by polling */
+    __deadline_update(&dl, now + SEC_MS(MNG_LOOP_MAX_IDLE));
+  }
+  return dl;
+}
+
 void *mng_mainloop(void *p)
 {
   bool busy;
+  uint64_t due;
+  mng_state_t last;
   while (1) {
     busy = false;
+    last = mng.state;
     poll_cmd();
     bgevt_dispenser();
     switch (mng.state) {
@@ -291,10 +379,22 @@ void *mng_mainloop(void *p)
         break;
     }
     set_mng_state();
+    /* The probes of the quarantined nodes come due after the sync is done */
+    if (mng.state == configured && mng.lists.quar && acc_quar_release(&mng)) {
+      mng.status.seq.offs = 0;
+      mng.state = mng_rm_pending(&mng) ? removing_devices_em : configuring_devices_em;
+      LOGM("Probing Quarantined Nodes\n");
+    }
     busy |= models_loop(&mng);
     demo_run();
-    if (!busy) {
-      usleep(10 * 1000);
+    /* Group commit of the journal when no more records come */
+    due = nodes_sync_due();
+    if (due && due <= evloop_now_ms()) {
+      nodes_sync();
+    }
+    busy |= (last != mng.state);
+    if (!busy && !gecko_event_pending()) {
+      evloop_wait(next_deadline());
     }
   }
   return NULL;
@@ -302,16 +402,16 @@ void *mng_mainloop(void *p)
 
 static void poll_cmd(void)
 {
-  int i;
-  wordexp_t *w = cmd_deq(&i);
-  if (w) {
-    /* DUMP_PARAMS(w->we_wordc, w->we_wordv); */
-    if (ec_param_invalid == errof(commands[i].fn(w->we_wordc, w->we_wordv))) {
+  cmdslot_t *s;
+
+  /* Drain all the pending commands */
+  while (NULL != (s = cmd_peek())) {
+    /* DUMP_PARAMS(s->argc, s->argv); */
+    if (ec_param_invalid == errof(commands[s->offs].fn(s->argc, s->argv))) {
       printf(COLOR_HIGHLIGHT "Invalid Parameter(s)\nUsage: " COLOR_OFF);
-      print_cmd_usage(&commands[i]);
+      print_cmd_usage(&commands[s->offs]);
     }
-    wordfree(w);
-    free(w);
+    cmd_release();
   }
 }
 
@@ -345,16 +445,39 @@ static inline void __lists_clr(void)
   mng.lists.rm = NULL;
   g_list_free(mng.lists.fail);
   mng.lists.fail = NULL;
+  g_list_free(mng.lists.quar);
+  mng.lists.quar = NULL;
+  g_list_free(mng.lists.lpn.config);
+  mng.lists.lpn.config = NULL;
+  g_list_free(mng.lists.lpn.rm);
+  mng.lists.lpn.rm = NULL;
 }
 
 err_t mng_init(void *p)
 {
+  err_t e;
+  const bguart_t *u;
+
   __lists_clr();
+  acc_window_deinit(&mng);
+  add_window_deinit(&mng);
   memset(&mng, 0, sizeof(mng_t));
   mng.conn = 0xff;
   memcpy(mng.status.seq.prios, DEFAULT_SEQ_PRIO, 3);
   mng.cfg = get_provcfg();
+  acc_window_init(&mng);
+  add_window_init(&mng);
   acc_init(true);
+  bgevt_hdrs_init();
+  if (ec_success != (e = dcd_cache_init())) {
+    elog(e);
+  }
+
+  u = get_bguart_impl();
+  if (ec_success != (e = evloop_init((u && u->bglib_fd) ? u->bglib_fd() : -1))) {
+    /* Not fatal, the main loop falls back to polling */
+    elog(e);
+  }
   return ec_success;
 }
 
@@ -364,11 +487,13 @@ void mng_load_lists(void)
     return;
   }
   __lists_clr();
+  /* The devices to provision may have changed */
+  beacon_filter_clr();
   cfg_load_mnglists(load_lists);
   LOGM("[%d-%d-%d-%d] loaded to be [added-configured-removed-blacklisted]\n",
        g_list_length(mng.lists.add),
-       g_list_length(mng.lists.config),
-       g_list_length(mng.lists.rm),
+       mng_config_pending(&mng),
+       mng_rm_pending(&mng),
        g_list_length(mng.lists.bl));
 }
 
@@ -388,9 +513,6 @@ void list_nodes(void)
 
   LOGM("%d Nodes in NCP Target DDB\n", cnt);
   while (cnt) {
-    if (getprojargs()->enc) {
-      poll_update(50);
-    }
     struct gecko_cmd_packet *evt = gecko_peek_event();
     if (NULL == evt
         || BGLIB_MSG_ID(evt->header) != gecko_evt_mesh_prov_ddb_list_id) {
@@ -440,13 +562,9 @@ static gboolean load_lists(gpointer key, gpointer value, gpointer data)
     if (n->rmorbl & BL_BITMASK) {
       mng.lists.bl = g_list_append(mng.lists.bl, n);
     } else if (n->rmorbl & RM_BITMASK) {
-      if ((n->config.features.target & LPN_BITOFS)) {
-        mng.lists.rm = g_list_prepend(mng.lists.rm, n);
-      } else {
-        mng.lists.rm = g_list_append(mng.lists.rm, n);
-      }
+      acc_list_add(&mng, n, true);
     } else if (!n->done) {
-      mng.lists.config = g_list_append(mng.lists.config, n);
+      acc_list_add(&mng, n, false);
     }
   }
   return FALSE;
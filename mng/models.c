@@ -14,6 +14,8 @@
 #include "utils.h"
 
 /* Defines  *********************************************************** */
+#define IS_UNICAST_ADDR(x) ((x) && (x) < 0x8000)
+
 #ifdef DEMO_EN
 #if 0
 const char *demo_cmds[] = {
@@ -102,10 +104,151 @@ static struct demo{
 static uint8_t tid = 0;
 
 /* Static Variables *************************************************** */
+typedef struct {
+  uint8_t func;
+  /* Unicast addresses not covered yet */
+  GHashTable *targets;
+  /* Group address -> GList of the target members */
+  GHashTable *groups;
+  /* Groups which have at least one member out of the targets */
+  GHashTable *unusable;
+  /* Best group in one round of the selection */
+  uint16_t best;
+  int best_cnt;
+}plan_ctx_t;
 
 /* Static Functions Declaractions ************************************* */
 static err_t clicb_perc_set(int argc, char *argv[], uint8_t type);
 
+static gboolean __plan_collect(gpointer key,
+                               gpointer value,
+                               gpointer data)
+{
+  node_t *n = (node_t *)value;
+  plan_ctx_t *ctx = (plan_ctx_t *)data;
+  uint16list_t *sub = n->config.sublist;
+  gpointer grp;
+  bool target;
+
+  if (!(n->models.func & ctx->func) || !sub || !sub->len) {
+    return FALSE;
+  }
+  target = g_hash_table_contains(ctx->targets, GUINT_TO_POINTER(n->addr));
+  for (int i = 0; i < sub->len; i++) {
+    grp = GUINT_TO_POINTER(sub->data[i]);
+    if (!target) {
+      g_hash_table_insert(ctx->unusable, grp, grp);
+    } else if (n->done) {
+      /* Only the configured nodes are known to have subscribed */
+      g_hash_table_insert(ctx->groups,
+                          grp,
+                          g_list_prepend(g_hash_table_lookup(ctx->groups, grp),
+                                         GUINT_TO_POINTER(n->addr)));
+    }
+  }
+  return FALSE;
+}
+
+static void __plan_pick(gpointer key,
+                        gpointer value,
+                        gpointer data)
+{
+  plan_ctx_t *ctx = (plan_ctx_t *)data;
+  int cnt = 0;
+
+  if (g_hash_table_contains(ctx->unusable, key)) {
+    return;
+  }
+  for (GList *l = (GList *)value; l; l = l->next) {
+    if (g_hash_table_contains(ctx->targets, l->data)) {
+      cnt++;
+    }
+  }
+  if (cnt > ctx->best_cnt) {
+    ctx->best_cnt = cnt;
+    ctx->best = GPOINTER_TO_UINT(key);
+  }
+}
+
+/**
+ * @brief __fanout_plan - replace the unicast addresses in {nodes} with the
+ * subscription groups covering them where possible, a group is picked only if
+ * every light capable of {func} subscribing to it is in {nodes}, so no light
+ * receives a message not meant for it. Groups are picked greedily by the
+ * number of targets they still cover, the uncovered targets keep their
+ * unicast addresses and order. Group and virtual addresses in {nodes} are
+ * kept as they are.
+ *
+ * @param func - model function bit, e.g. ONOFF_SV_BIT
+ * @param nodes - list of the uint16_t * destination addresses, consumed
+ *
+ * @return the new list of the destination addresses
+ */
+static GList *__fanout_plan(uint8_t func, GList *nodes)
+{
+  plan_ctx_t ctx;
+  GList *out = NULL, *l, *next;
+  uint16_t *addr;
+  int grpnum = 0;
+
+  if (g_list_length(nodes) < MODEL_SET_GROUP_MIN) {
+    return nodes;
+  }
+
+  memset(&ctx, 0, sizeof(plan_ctx_t));
+  ctx.func = func;
+  ctx.targets = g_hash_table_new(g_direct_hash, g_direct_equal);
+  ctx.groups = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                     NULL, (GDestroyNotify)g_list_free);
+  ctx.unusable = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  for (l = nodes; l; l = l->next) {
+    addr = (uint16_t *)l->data;
+    if (IS_UNICAST_ADDR(*addr)) {
+      g_hash_table_insert(ctx.targets, GUINT_TO_POINTER(*addr), l);
+    }
+  }
+  cfgdb_nodes_foreach(__plan_collect, &ctx);
+
+  while (1) {
+    ctx.best_cnt = 0;
+    g_hash_table_foreach(ctx.groups, __plan_pick, &ctx);
+    if (ctx.best_cnt < MODEL_SET_GROUP_MIN) {
+      break;
+    }
+    l = (GList *)g_hash_table_lookup(ctx.groups,
+                                     GUINT_TO_POINTER(ctx.best));
+    for (; l; l = l->next) {
+      g_hash_table_remove(ctx.targets, l->data);
+    }
+    g_hash_table_remove(ctx.groups, GUINT_TO_POINTER(ctx.best));
+    addr = malloc(sizeof(uint16_t));
+    *addr = ctx.best;
+    out = g_list_append(out, addr);
+    grpnum++;
+  }
+
+  if (grpnum) {
+    for (l = nodes; l; l = next) {
+      next = l->next;
+      addr = (uint16_t *)l->data;
+      if (IS_UNICAST_ADDR(*addr)
+          && !g_hash_table_contains(ctx.targets, GUINT_TO_POINTER(*addr))) {
+        nodes = g_list_delete_link(nodes, l);
+        free(addr);
+      }
+    }
+    LOGD("Model set fans out to %d group(s) and %d unicast(s)\n",
+         grpnum, g_list_length(nodes));
+    nodes = g_list_concat(out, nodes);
+  }
+
+  g_hash_table_destroy(ctx.targets);
+  g_hash_table_destroy(ctx.groups);
+  g_hash_table_destroy(ctx.unusable);
+  return nodes;
+}
+
 #ifdef DEMO_EN
 #if 0
 err_t clicb_demo(int argc, char *argv[])
@@ -225,6 +368,8 @@ err_t clicb_onoff(int argc, char *argv[])
       mng->cache.model_set.nodes = g_list_append(mng->cache.model_set.nodes, addr);
     }
   }
+  mng->cache.model_set.nodes = __fanout_plan(ONOFF_SV_BIT,
+                                             mng->cache.model_set.nodes);
 
   if (mng->cache.model_set.nodes) {
     mng->cache.model_set.type = ONOFF_SV_BIT;
@@ -285,6 +430,8 @@ static err_t clicb_perc_set(int argc, char *argv[], uint8_t type)
       mng->cache.model_set.nodes = g_list_append(mng->cache.model_set.nodes, addr);
     }
   }
+  mng->cache.model_set.nodes = __fanout_plan(LIGHTNESS_SV_BIT,
+                                             mng->cache.model_set.nodes);
   if (mng->cache.model_set.nodes) {
     mng->cache.model_set.type = type;
   }
@@ -16,9 +16,9 @@
 #include "logging.h"
 #include "gecko_bglib.h"
 #include "bg_uart_cbs.h"
-#include "socket_handler.h"
 #include "generic_parser.h"
 #include "startup.h"
+#include "bgevt_hdr.h"
 
 /* Defines  *********************************************************** */
 
@@ -42,9 +42,6 @@ err_t nwk_init(void *p)
   }
 
   while (NULL == evt || BGLIB_MSG_ID(evt->header) != gecko_evt_mesh_prov_initialized_id) {
-    if (getprojargs()->enc) {
-      poll_update(50);
-    }
     evt = gecko_peek_event();
     /* Blocking wait for initialized event, timeout could be added to increase the robust */
     usleep(500);
@@ -221,6 +218,15 @@ static err_t on_initialized_config(struct gecko_msg_mesh_prov_initialized_evt_t
   return ec_success;
 }
 
+static const uint32_t dflt_evts[] = {
+  gecko_evt_le_gap_adv_timeout_id,
+};
+
+void bgevt_dflt_hdr_init(void)
+{
+  bgevt_register(bgevt_dflt_hdr, dflt_evts, ARR_LEN(dflt_evts));
+}
+
 int bgevt_dflt_hdr(const struct gecko_cmd_packet *evt)
 {
   switch (BGLIB_MSG_ID(evt->header)) {
@@ -92,7 +92,7 @@ void stat_config_loading_record(const mng_t *mng)
   if (!(mng->state == adding_devices_em || mng->state == configuring_devices_em)) {
     return;
   }
-  if (MAX_CONCURRENT_CONFIG_NODES == utils_popcount(mng->cache.config.used)) {
+  if (utils_popcount(mng->cache.config.used) >= mng->cache.config.win.size) {
     if (stat.config.full_loading.meas.state == rc_start) {
       return;
     }
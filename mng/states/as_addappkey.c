@@ -60,6 +60,8 @@ static int __add_appkey(config_cache_t *cache, mng_t *mng)
     &key_id);
   ASSERT(ret == asr_suc);
 
+  acc_cmd_async(cache);
+
   rsp = gecko_cmd_mesh_config_client_add_appkey(
     mng->cfg->subnets[0].netkey.id,
     cache->node->addr,
@@ -68,7 +70,7 @@ static int __add_appkey(config_cache_t *cache, mng_t *mng)
 
   if (rsp->result != bg_err_success) {
     if (rsp->result == bg_err_out_of_memory) {
-      oom_set(cache);
+      oom_set(cache, bo_config_em);
       return asr_oom;
     }
     FAIL_P(cache, rsp->result);
@@ -77,7 +79,7 @@ static int __add_appkey(config_cache_t *cache, mng_t *mng)
   } else {
     ONCE_P(cache);
     WAIT_RESPONSE_SET(cache);
-    cache->cc_handle = rsp->handle;
+    acc_handle_set(cache, rsp->handle);
     timer_set(cache, 1);
   }
   return asr_suc;
@@ -10,44 +10,33 @@
 #include "dev_config.h"
 #include "utils.h"
 #include "logging.h"
+#include "acc_plan.h"
 
 /* Defines  *********************************************************** */
-#define ELEMENT_ITERATOR_INDEX  0
-#define MODEL_ITERATOR_INDEX  1
-#define SUB_ADDR_ITERATOR_INDEX  2
-
-#define ONCE_P(cache)                                                                \
-  do {                                                                               \
-    LOGV(                                                                            \
-      "Node[0x%04x]:  --- Sub [Element-Model(%d-%04x:%04x) <- 0x%04x]\n",            \
-      cache->node->addr,                                                             \
-      cache->iterators[ELEMENT_ITERATOR_INDEX],                                      \
-      cache->vnm.vd,                                                                 \
-      cache->vnm.md,                                                                 \
-      cache->node->config.sublist->data[cache->iterators[SUB_ADDR_ITERATOR_INDEX]]); \
+#define SUB_MSG \
+  "Node[0x%04x]:  --- %s [Element-Model(%d-%04x:%04x) <- 0x%04x]\n"
+#define SUB_SUC_MSG \
+  "Node[0x%04x]:  --- %s [Element-Model(%d-%04x:%04x) <- 0x%04x] SUCCESS\n"
+#define SUB_FAIL_MSG \
+  "Node[0x%04x]:  --- %s [Element-Model(%d-%04x:%04x) <- 0x%04x] FAILED, Err <0x%04x>\n"
+
+#define OP_ARGS(cache, op)                                         \
+  (cache)->node->addr, (op)->act == sub_del_em ? "Unsub" : "Sub", \
+  (op)->elem, (op)->vd, (op)->md, (op)->arg
+
+#define ONCE_P(cache, op)                  \
+  do {                                     \
+    LOGV(SUB_MSG, OP_ARGS(cache, op));     \
   } while (0)
 
-#define SUC_P(cache)                                                                 \
-  do {                                                                               \
-    LOGD(                                                                            \
-      "Node[0x%04x]:  --- Sub [Element-Model(%d-%04x:%04x) <- 0x%04x] SUCCESS\n",    \
-      cache->node->addr,                                                             \
-      cache->iterators[ELEMENT_ITERATOR_INDEX],                                      \
-      cache->vnm.vd,                                                                 \
-      cache->vnm.md,                                                                 \
-      cache->node->config.sublist->data[cache->iterators[SUB_ADDR_ITERATOR_INDEX]]); \
+#define SUC_P(cache, op)                   \
+  do {                                     \
+    LOGD(SUB_SUC_MSG, OP_ARGS(cache, op)); \
   } while (0)
 
-#define FAIL_P(cache, err)                                                                     \
-  do {                                                                                         \
-    LOGE(                                                                                      \
-      "Node[0x%04x]:  --- Sub [Element-Model(%d-%04x:%04x) <- 0x%04x] FAILED, Err <0x%04x>\n", \
-      cache->node->addr,                                                                       \
-      cache->iterators[ELEMENT_ITERATOR_INDEX],                                                \
-      cache->vnm.vd,                                                                           \
-      cache->vnm.md,                                                                           \
-      cache->node->config.sublist->data[cache->iterators[SUB_ADDR_ITERATOR_INDEX]],            \
-      err);                                                                                    \
+#define FAIL_P(cache, op, err)                   \
+  do {                                           \
+    LOGE(SUB_FAIL_MSG, OP_ARGS(cache, op), err); \
   } while (0)
 
 /* Global Variables *************************************************** */
@@ -58,74 +47,66 @@ static const uint32_t events[] = {
   gecko_evt_mesh_config_client_model_sub_status_id
 };
 
-static const uint16_t not_sub_models[] = {
-  0x1201, /* Time Setup Server */
-};
-
 #define RELATE_EVENTS_NUM() (sizeof(events) / sizeof(uint32_t))
-#define NSPT_SUB_MODEL_NUM() (sizeof(not_sub_models) / sizeof(uint16_t))
 
 /* Static Functions Declaractions ************************************* */
-static int iter_addsub(config_cache_t *cache);
-
 static int __addsub(config_cache_t *cache, mng_t *mng)
 {
   struct gecko_msg_mesh_config_client_add_model_sub_rsp_t *arsp;
   struct gecko_msg_mesh_config_client_set_model_sub_rsp_t *srsp;
+  struct gecko_msg_mesh_config_client_remove_model_sub_rsp_t *drsp;
   uint16_t retval;
   uint32_t handle;
+  const plan_op_t *op = plan_op_cur(cache);
 
-  if (cache->iterators[SUB_ADDR_ITERATOR_INDEX] == 0) {
-    cache->vnm.vd =
-      cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-      ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].vid
-      : 0xFFFF;
-    cache->vnm.md =
-      cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-      ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].mid
-      : cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sig_models[cache->iterators[MODEL_ITERATOR_INDEX]];
+  ASSERT(op);
+  acc_cmd_async(cache);
 
+  /* Set the first address to overwrite the existing ones, add the others */
+  if (op->act == sub_set_em) {
     srsp = gecko_cmd_mesh_config_client_set_model_sub(
       mng->cfg->subnets[0].netkey.id,
       cache->node->addr,
-      cache->iterators[ELEMENT_ITERATOR_INDEX],
-      cache->vnm.vd,
-      cache->vnm.md,
-      cache->node->config.sublist->data[cache->iterators[SUB_ADDR_ITERATOR_INDEX]]);
+      op->elem,
+      op->vd,
+      op->md,
+      op->arg);
     retval = srsp->result;
     handle = srsp->handle;
+  } else if (op->act == sub_del_em) {
+    drsp = gecko_cmd_mesh_config_client_remove_model_sub(
+      mng->cfg->subnets[0].netkey.id,
+      cache->node->addr,
+      op->elem,
+      op->vd,
+      op->md,
+      op->arg);
+    retval = drsp->result;
+    handle = drsp->handle;
   } else {
-    cache->vnm.vd =
-      cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-      ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].vid
-      : 0xFFFF;
-    cache->vnm.md =
-      cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-      ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].mid
-      : cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sig_models[cache->iterators[MODEL_ITERATOR_INDEX]];
     arsp = gecko_cmd_mesh_config_client_add_model_sub(
       mng->cfg->subnets[0].netkey.id,
       cache->node->addr,
-      cache->iterators[ELEMENT_ITERATOR_INDEX],
-      cache->vnm.vd,
-      cache->vnm.md,
-      cache->node->config.sublist->data[cache->iterators[SUB_ADDR_ITERATOR_INDEX]]);
+      op->elem,
+      op->vd,
+      op->md,
+      op->arg);
     retval = arsp->result;
     handle = arsp->handle;
   }
 
   if (retval != bg_err_success) {
     if (retval == bg_err_out_of_memory) {
-      oom_set(cache);
+      oom_set(cache, bo_config_em);
       return asr_oom;
     }
-    FAIL_P(cache, retval);
+    FAIL_P(cache, op, retval);
     err_set_to_end(cache, retval, bgapi_em);
     return asr_bgapi;
   } else {
-    ONCE_P(cache);
+    ONCE_P(cache, op);
     WAIT_RESPONSE_SET(cache);
-    cache->cc_handle = handle;
+    acc_handle_set(cache, handle);
     timer_set(cache, 1);
   }
 
@@ -134,6 +115,9 @@ static int __addsub(config_cache_t *cache, mng_t *mng)
 
 bool addsub_guard(const config_cache_t *cache)
 {
+  if (cache->node->delta) {
+    return cache->node->delta->sub_add || cache->node->delta->sub_rm;
+  }
   return (cache->node->config.sublist && cache->node->config.sublist->len);
 }
 
@@ -143,6 +127,9 @@ int addsub_entry(config_cache_t *cache, func_guard guard)
     LOGW("State[%s] Guard Not Passed\n", state_names[cache->state]);
     return asr_tonext;
   }
+  if (!plan_op_first(cache, plan_sub_em)) {
+    return asr_tonext;
+  }
 
   return __addsub(cache, get_mng());
 }
@@ -162,7 +149,7 @@ int addsub_inprg(const struct gecko_cmd_packet *evt, config_cache_t *cache)
       switch (evt->data.evt_mesh_config_client_model_sub_status.result) {
         case bg_err_success:
           RETRY_CLEAR(cache);
-          SUC_P(cache);
+          SUC_P(cache, plan_op_cur(cache));
           break;
         case bg_err_timeout:
           /* bind any remaining_retry case here */
@@ -178,16 +165,17 @@ int addsub_inprg(const struct gecko_cmd_packet *evt, config_cache_t *cache)
           break;
         case bg_err_mesh_foundation_insufficient_resources:
           LOGW("Node[0x%04x]: Cannot Sub More Address, Passing\n", cache->node->addr);
-          cache->iterators[SUB_ADDR_ITERATOR_INDEX] = cache->node->config.sublist->len - 1;
+          plan_op_skip_model(cache);
           break;
         default:
           FAIL_P(cache,
+                 plan_op_cur(cache),
                  evt->data.evt_mesh_config_client_model_sub_status.result);
           err_set_to_end(cache, bg_err_timeout, bgevent_em);
           return asr_suc;
       }
 
-      if (iter_addsub(cache) == 1) {
+      if (!plan_op_next(cache)) {
         cache->next_state = -1;
         return asr_suc;
       }
@@ -255,49 +243,3 @@ bool is_addsub_pkts(uint32_t evtid)
   return 0;
 }
 
-static inline bool __sub_supported(uint16_t md)
-{
-  for (int i = 0; i < NSPT_SUB_MODEL_NUM(); i++) {
-    if (not_sub_models[i] == md) {
-      return false;
-    }
-  }
-  return true;
-}
-
-static int iter_addsub(config_cache_t *cache)
-{
-  int md, increment = 0;
-
-  if (++cache->iterators[SUB_ADDR_ITERATOR_INDEX] == cache->node->config.sublist->len) {
-    cache->iterators[SUB_ADDR_ITERATOR_INDEX] = 0;
-    do{
-      if (++cache->iterators[MODEL_ITERATOR_INDEX]
-          == cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-          + cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm_cnt) {
-        cache->iterators[MODEL_ITERATOR_INDEX] = 0;
-        increment = 0;
-        break;
-      } else {
-        md =
-          cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-          ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].mid
-          : cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sig_models[cache->iterators[MODEL_ITERATOR_INDEX]];
-        if (__sub_supported(md)) {
-          increment = 1;
-          break;
-        }
-        LOGW("Model - 0x%04x doesn't support Sub, pass.\n",
-             md);
-      }
-    }while(1);
-
-    if (!increment) {
-      if (++cache->iterators[ELEMENT_ITERATOR_INDEX] == cache->dcd.element_cnt) {
-        cache->iterators[ELEMENT_ITERATOR_INDEX] = 0;
-        return 1;
-      }
-    }
-  }
-  return 0;
-}
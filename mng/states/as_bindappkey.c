@@ -10,41 +10,37 @@
 #include "dev_config.h"
 #include "utils.h"
 #include "logging.h"
+#include "acc_plan.h"
 
 /* Defines  *********************************************************** */
-#define ELEMENT_ITERATOR_INDEX  0
-#define MODEL_ITERATOR_INDEX  1
-#define APP_KEY_ITERATOR_INDEX  2
-
-#define ONCE_P(cache)                                                                    \
-  do {                                                                                   \
-    LOGV("Node[0x%04x]:  --- Bind [refid(%d) <-> %s Model(%04x:%04x)]\n",                \
-         cache->node->addr,                                                              \
-         get_mng()->cfg->subnets[0].appkey[cache->iterators[APP_KEY_ITERATOR_INDEX]].id, \
-         cache->vnm.vd == SIG_VENDOR_ID ? "SIG" : "Vendor",                              \
-         cache->vnm.vd,                                                                  \
-         cache->vnm.md);                                                                 \
+#define BIND_MSG \
+  "Node[0x%04x]:  --- Bind [refid(%d) <-> %s Model(%d-%04x:%04x)]\n"
+#define BIND_SUC_MSG \
+  "Node[0x%04x]:  --- Bind [refid(%d) <-> %s Model(%d-%04x:%04x)] SUCCESS\n"
+#define BIND_FAIL_MSG \
+  "Node[0x%04x]:  --- Bind [refid(%d) <-> %s Model(%d-%04x:%04x)] FAILED, Err <0x%04x>\n"
+
+#define OP_ARGS(cache, op)                        \
+  (cache)->node->addr,                            \
+  (op)->arg,                                      \
+  (op)->vd == SIG_VENDOR_ID ? "SIG" : "Vendor",   \
+  (op)->elem,                                     \
+  (op)->vd,                                       \
+  (op)->md
+
+#define ONCE_P(cache, op)                   \
+  do {                                      \
+    LOGV(BIND_MSG, OP_ARGS(cache, op));     \
   } while (0)
 
-#define SUC_P(cache, config)                                                             \
-  do {                                                                                   \
-    LOGD("Node[0x%04x]:  --- Bind [refid(%d) <-> %s Model(%04x:%04x)] SUCCESS\n",        \
-         cache->node->addr,                                                              \
-         get_mng()->cfg->subnets[0].appkey[cache->iterators[APP_KEY_ITERATOR_INDEX]].id, \
-         cache->vnm.vd == SIG_VENDOR_ID ? "SIG" : "Vendor",                              \
-         cache->vnm.vd,                                                                  \
-         cache->vnm.md);                                                                 \
+#define SUC_P(cache, op)                    \
+  do {                                      \
+    LOGD(BIND_SUC_MSG, OP_ARGS(cache, op)); \
   } while (0)
 
-#define FAIL_P(cache, config, err)                                                             \
-  do {                                                                                         \
-    LOGE("Node[0x%04x]:  --- Bind [refid(%d) <-> %s Model(%04x:%04x)] FAILED, Err <0x%04x>\n", \
-         cache->node->addr,                                                                    \
-         get_mng()->cfg->subnets[0].appkey[cache->iterators[APP_KEY_ITERATOR_INDEX]].id,       \
-         cache->vnm.vd == SIG_VENDOR_ID ? "SIG" : "Vendor",                                    \
-         cache->vnm.vd,                                                                        \
-         cache->vnm.md,                                                                        \
-         err);                                                                                 \
+#define FAIL_P(cache, op, err)                     \
+  do {                                             \
+    LOGE(BIND_FAIL_MSG, OP_ARGS(cache, op), err);  \
   } while (0)
 
 /* Global Variables *************************************************** */
@@ -57,49 +53,49 @@ static const uint32_t events[] = {
 #define RELATE_EVENTS_NUM() (sizeof(events) / sizeof(uint32_t))
 
 /* Static Functions Declaractions ************************************* */
-static int iter_bindings(config_cache_t *cache);
+/* Skip the bindings whose appkey is not created */
+static const plan_op_t *__valid_op(config_cache_t *cache,
+                                   const plan_op_t *op)
+{
+  while (op && asr_suc != appkey_by_refid(get_mng(), op->arg, NULL)) {
+    op = plan_op_next(cache);
+  }
+  return op;
+}
 
 static int __bind_appkey(config_cache_t *cache, mng_t *mng)
 {
   int ret;
   uint16_t key_id = 0;
   struct gecko_msg_mesh_config_client_bind_model_rsp_t *rsp;
+  const plan_op_t *op = plan_op_cur(cache);
 
-  cache->vnm.vd =
-    (cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt)
-    ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].vid
-    : 0xFFFF;
-  cache->vnm.md =
-    (cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt)
-    ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].mid
-    : cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sig_models[cache->iterators[MODEL_ITERATOR_INDEX]];
-
-  ret = appkey_by_refid(
-    mng,
-    cache->node->config.bindings->data[cache->iterators[APP_KEY_ITERATOR_INDEX]],
-    &key_id);
+  ASSERT(op);
+  ret = appkey_by_refid(mng, op->arg, &key_id);
   ASSERT(asr_suc == ret);
 
+  acc_cmd_async(cache);
+
   rsp = gecko_cmd_mesh_config_client_bind_model(
     mng->cfg->subnets[0].netkey.id,
     cache->node->addr,
-    cache->iterators[ELEMENT_ITERATOR_INDEX],
+    op->elem,
     key_id,
-    cache->vnm.vd,
-    cache->vnm.md);
+    op->vd,
+    op->md);
 
   if (rsp->result != bg_err_success) {
     if (rsp->result == bg_err_out_of_memory) {
-      oom_set(cache);
+      oom_set(cache, bo_config_em);
       return asr_oom;
     }
-    FAIL_P(cache, pconfig, rsp->result);
+    FAIL_P(cache, op, rsp->result);
     err_set_to_end(cache, rsp->result, bgapi_em);
     return asr_bgapi;
   } else {
-    ONCE_P(cache);
+    ONCE_P(cache, op);
     WAIT_RESPONSE_SET(cache);
-    cache->cc_handle = rsp->handle;
+    acc_handle_set(cache, rsp->handle);
     timer_set(cache, 1);
   }
   return asr_suc;
@@ -116,6 +112,9 @@ int bindappkey_entry(config_cache_t *cache, func_guard guard)
     LOGM("State[%s] Guard Not Passed\n", state_names[cache->state]);
     return asr_tonext;
   }
+  if (!__valid_op(cache, plan_op_first(cache, plan_bind_em))) {
+    return asr_tonext;
+  }
   return __bind_appkey(cache, get_mng());
 }
 
@@ -135,7 +134,7 @@ int bindappkey_inprg(const struct gecko_cmd_packet *evt, config_cache_t *cache)
       switch (evt->data.evt_mesh_config_client_binding_status.result) {
         case bg_err_success:
           RETRY_CLEAR(cache);
-          SUC_P(cache, pconfig);
+          SUC_P(cache, plan_op_cur(cache));
           break;
         case bg_err_timeout:
           /* bind any remaining_retry case here */
@@ -151,13 +150,13 @@ int bindappkey_inprg(const struct gecko_cmd_packet *evt, config_cache_t *cache)
           break;
         default:
           FAIL_P(cache,
-                 pconfig,
+                 plan_op_cur(cache),
                  evt->data.evt_mesh_config_client_binding_status.result);
           err_set_to_end(cache, bg_err_timeout, bgevent_em);
           return asr_suc;
       }
 
-      if (iter_bindings(cache) == 1) {
+      if (!__valid_op(cache, plan_op_next(cache))) {
         cache->next_state = -1;
         return asr_suc;
       }
@@ -223,29 +222,3 @@ bool is_bindappkey_pkts(uint32_t evtid)
   return 0;
 }
 
-static int iter_bindings(config_cache_t *cache)
-{
-  while (++cache->iterators[APP_KEY_ITERATOR_INDEX] != cache->node->config.bindings->len) {
-    if (asr_suc == appkey_by_refid(
-          get_mng(),
-          cache->node->config.bindings->data[cache->iterators[APP_KEY_ITERATOR_INDEX]],
-          NULL)) {
-      break;
-    }
-  }
-
-  if (cache->iterators[APP_KEY_ITERATOR_INDEX] == cache->node->config.bindings->len) {
-    cache->iterators[APP_KEY_ITERATOR_INDEX] = 0;
-    if (++cache->iterators[MODEL_ITERATOR_INDEX]
-        == cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-        + cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm_cnt) {
-      cache->iterators[MODEL_ITERATOR_INDEX] = 0;
-      if (++cache->iterators[ELEMENT_ITERATOR_INDEX] == cache->dcd.element_cnt) {
-        cache->iterators[ELEMENT_ITERATOR_INDEX] = 0;
-        /* All bind appkey is done */
-        return 1;
-      }
-    }
-  }
-  return 0;
-}
@@ -45,6 +45,8 @@ static void __on_success(config_cache_t *cache)
   bt_shell_printf("Node[0x%04x] **Configured**\n", cache->node->addr);
   nodeset_errbits(cache->node->addr, 0);
   nodeset_done(cache->node->addr, 0x1);
+  /* Base of the next incremental reconfiguration */
+  cfgdb_node_applied_set(cache->node);
 
 #ifdef ON_END_DEBUG
   send_onoff(0xc030, 1);
@@ -11,6 +11,7 @@
 #include "utils.h"
 #include "logging.h"
 #include "generic_parser.h"
+#include "dcd_cache.h"
 
 /* Defines  *********************************************************** */
 #define GENERIC_ONOFF_SERVER_MDID       0x1000
@@ -56,18 +57,53 @@ static const uint32_t events[] = {
 static void __dcd_store(const uint8_t *data,
                         uint8_t len,
                         config_cache_t *cache);
+static void __dcd_cache_update(const uint8_t *data,
+                               uint8_t len,
+                               config_cache_t *cache);
+
+/*
+ * Load the DCD from the cache if the product of the node is known and one node
+ * of the same product has reported it before
+ */
+static bool __dcd_from_cache(config_cache_t *cache)
+{
+  const product_t *p = cache->node->config.product;
+  const uint8_t *data;
+  uint8_t len;
+
+  if (!p) {
+    return false;
+  }
+  if (cache->node->err > ERROR_BIT(get_dcd_em)
+      && cache->node->err < ERROR_BIT(end_em)) {
+    /* Resuming from the failed state is decided on the DCD end event */
+    return false;
+  }
+  if (NULL == (data = dcd_cache_get(p->cid, p->pid, p->vid, &len))) {
+    return false;
+  }
+  __dcd_store(data, len, cache);
+  LOGD("Node[0x%04x]:  --- Get DCD from Cache [%04x-%04x-%04x]\n",
+       cache->node->addr,
+       p->cid,
+       p->pid,
+       p->vid);
+  return true;
+}
 
 static int __dcd_get(config_cache_t *cache, mng_t *mng)
 {
   struct gecko_msg_mesh_config_client_get_dcd_rsp_t *rsp;
 
+  acc_cmd_async(cache);
+
   rsp = gecko_cmd_mesh_config_client_get_dcd(mng->cfg->subnets[0].netkey.id,
                                              cache->node->addr,
                                              0);
 
   if (rsp->result != bg_err_success) {
     if (rsp->result == bg_err_out_of_memory) {
-      oom_set(cache);
+      oom_set(cache, bo_config_em);
       return asr_oom;
     }
     FAIL_P(cache, rsp->result);
@@ -76,7 +112,7 @@ static int __dcd_get(config_cache_t *cache, mng_t *mng)
   } else {
     ONCE_P(cache);
     WAIT_RESPONSE_SET(cache);
-    cache->cc_handle = rsp->handle;
+    acc_handle_set(cache, rsp->handle);
     timer_set(cache, 1);
   }
 
@@ -95,6 +131,9 @@ int getdcd_entry(config_cache_t *cache, func_guard guard)
     LOGW("State[%s] Guard Not Passed\n", state_names[cache->state]);
     return asr_tonext;
   }
+  if (__dcd_from_cache(cache)) {
+    return asr_tonext;
+  }
   return __dcd_get(cache, get_mng());
 }
 
@@ -112,6 +151,9 @@ int getdcd_inprg(const struct gecko_cmd_packet *evt, config_cache_t *cache)
         __dcd_store(evt->data.evt_mesh_config_client_dcd_data.data.data,
                     evt->data.evt_mesh_config_client_dcd_data.data.len,
                     cache);
+        __dcd_cache_update(evt->data.evt_mesh_config_client_dcd_data.data.data,
+                           evt->data.evt_mesh_config_client_dcd_data.data.len,
+                           cache);
       }
       break;
 
@@ -214,6 +256,31 @@ bool is_getdcd_pkts(uint32_t evtid)
   return 0;
 }
 
+static void __dcd_cache_update(const uint8_t *data,
+                               uint8_t len,
+                               config_cache_t *cache)
+{
+  const product_t *p = cache->node->config.product;
+
+  if (len < 6) {
+    return;
+  }
+  /* Verify the product declared in the config file against the node */
+  if (p && (p->cid != BUILD_UINT16(data[0], data[1])
+            || p->pid != BUILD_UINT16(data[2], data[3])
+            || p->vid != BUILD_UINT16(data[4], data[5]))) {
+    LOGW("Node[0x%04x]: Product [%04x-%04x-%04x] Mismatches DCD [%04x-%04x-%04x]\n",
+         cache->node->addr,
+         p->cid,
+         p->pid,
+         p->vid,
+         BUILD_UINT16(data[0], data[1]),
+         BUILD_UINT16(data[2], data[3]),
+         BUILD_UINT16(data[4], data[5]));
+  }
+  dcd_cache_put(data, len);
+}
+
 static void __dcd_store(const uint8_t *data,
                         uint8_t len,
                         config_cache_t *cache)
@@ -46,13 +46,15 @@ static int __rm(config_cache_t *cache, mng_t *mng)
   struct gecko_msg_mesh_config_client_reset_node_rsp_t *rsp;
 
   /* First one, should set */
+  acc_cmd_async(cache);
+
   rsp = gecko_cmd_mesh_config_client_reset_node(
     mng->cfg->subnets[0].netkey.id,
     cache->node->addr);
 
   if (rsp->result != bg_err_success) {
     if (rsp->result == bg_err_out_of_memory) {
-      oom_set(cache);
+      oom_set(cache, bo_rm_em);
       return asr_oom;
     }
     FAIL_P(cache, rsp->result);
@@ -61,7 +63,7 @@ static int __rm(config_cache_t *cache, mng_t *mng)
   } else {
     ONCE_P(cache);
     WAIT_RESPONSE_SET(cache);
-    cache->cc_handle = rsp->handle;
+    acc_handle_set(cache, rsp->handle);
     timer_set(cache, 1);
   }
   return asr_suc;
@@ -125,6 +125,7 @@ static int __setconfig(config_cache_t *cache, mng_t *mng)
 
   switch (which) {
     case RELAY_BITOFS:
+      acc_cmd_async(cache);
       rrsp = gecko_cmd_mesh_config_client_set_relay(
         mng->cfg->subnets[0].netkey.id,
         cache->node->addr,
@@ -136,6 +137,7 @@ static int __setconfig(config_cache_t *cache, mng_t *mng)
       handle = rrsp->handle;
       break;
     case PROXY_BITOFS:
+      acc_cmd_async(cache);
       prsp = gecko_cmd_mesh_config_client_set_gatt_proxy(
         mng->cfg->subnets[0].netkey.id,
         cache->node->addr,
@@ -144,6 +146,7 @@ static int __setconfig(config_cache_t *cache, mng_t *mng)
       handle = prsp->handle;
       break;
     case FRIEND_BITOFS:
+      acc_cmd_async(cache);
       frsp = gecko_cmd_mesh_config_client_set_friend(
         mng->cfg->subnets[0].netkey.id,
         cache->node->addr,
@@ -152,6 +155,7 @@ static int __setconfig(config_cache_t *cache, mng_t *mng)
       handle = frsp->handle;
       break;
     case TTL_BITOFS:
+      acc_cmd_async(cache);
       trsp = gecko_cmd_mesh_config_client_set_default_ttl(
         mng->cfg->subnets[0].netkey.id,
         cache->node->addr,
@@ -160,6 +164,7 @@ static int __setconfig(config_cache_t *cache, mng_t *mng)
       handle = trsp->handle;
       break;
     case NETTX_BITOFS:
+      acc_cmd_async(cache);
       ntrsp = gecko_cmd_mesh_config_client_set_network_transmit(
         mng->cfg->subnets[0].netkey.id,
         cache->node->addr,
@@ -169,6 +174,7 @@ static int __setconfig(config_cache_t *cache, mng_t *mng)
       handle = ntrsp->handle;
       break;
     case SNB_BITOFS:
+      acc_cmd_async(cache);
       brsp = gecko_cmd_mesh_config_client_set_beacon(
         mng->cfg->subnets[0].netkey.id,
         cache->node->addr,
@@ -182,7 +188,7 @@ static int __setconfig(config_cache_t *cache, mng_t *mng)
 
   if (retval != bg_err_success) {
     if (retval == bg_err_out_of_memory) {
-      oom_set(cache);
+      oom_set(cache, bo_config_em);
       return asr_oom;
     }
     set_configs_print_state(which, failed_em, cache, retval);
@@ -191,7 +197,7 @@ static int __setconfig(config_cache_t *cache, mng_t *mng)
   } else {
     /* set_configs_print_state(which, once_em, cache, pconfig, 0); */
     WAIT_RESPONSE_SET(cache);
-    cache->cc_handle = handle;
+    acc_handle_set(cache, handle);
     timer_set(cache, 1);
   }
 
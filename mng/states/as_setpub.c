@@ -10,6 +10,7 @@
 #include "dev_config.h"
 #include "utils.h"
 #include "logging.h"
+#include "acc_plan.h"
 
 /* Defines  *********************************************************** */
 #define SET_PUB_MSG \
@@ -18,43 +19,40 @@
   "Node[0x%04x]:  --- Pub [Element-Model(%d-%04x:%04x) -> 0x%04x] SUCCESS\n"
 #define SET_PUB_FAIL_MSG \
   "Node[0x%04x]:  --- Pub [Element-Model(%d-%04x:%04x) -> 0x%04x] FAILED, Err <0x%04x>\n"
-
-#define ELEMENT_ITERATOR_INDEX  0
-#define MODEL_ITERATOR_INDEX  1
 /* Global Variables *************************************************** */
 
 /* Static Variables *************************************************** */
 
 /* Static Functions Declaractions ************************************* */
-#define ONCE_P(cache)                              \
-  do {                                             \
-    LOGV(SET_PUB_MSG,                              \
-         cache->node->addr,                        \
-         cache->iterators[ELEMENT_ITERATOR_INDEX], \
-         cache->vnm.vd,                            \
-         cache->vnm.md,                            \
-         cache->node->config.pub->addr);           \
+#define ONCE_P(cache, op)                \
+  do {                                   \
+    LOGV(SET_PUB_MSG,                    \
+         cache->node->addr,              \
+         (op)->elem,                     \
+         (op)->vd,                       \
+         (op)->md,                       \
+         cache->node->config.pub->addr); \
   } while (0)
 
-#define SUC_P(cache)                               \
-  do {                                             \
-    LOGD(SET_PUB_SUC_MSG,                          \
-         cache->node->addr,                        \
-         cache->iterators[ELEMENT_ITERATOR_INDEX], \
-         cache->vnm.vd,                            \
-         cache->vnm.md,                            \
-         cache->node->config.pub->addr);           \
+#define SUC_P(cache, op)                 \
+  do {                                   \
+    LOGD(SET_PUB_SUC_MSG,                \
+         cache->node->addr,              \
+         (op)->elem,                     \
+         (op)->vd,                       \
+         (op)->md,                       \
+         cache->node->config.pub->addr); \
   } while (0)
 
-#define FAIL_P(cache, err)                         \
-  do {                                             \
-    LOGE(SET_PUB_FAIL_MSG,                         \
-         cache->node->addr,                        \
-         cache->iterators[ELEMENT_ITERATOR_INDEX], \
-         cache->vnm.vd,                            \
-         cache->vnm.md,                            \
-         cache->node->config.pub->addr,            \
-         err);                                     \
+#define FAIL_P(cache, op, err)           \
+  do {                                   \
+    LOGE(SET_PUB_FAIL_MSG,               \
+         cache->node->addr,              \
+         (op)->elem,                     \
+         (op)->vd,                       \
+         (op)->md,                       \
+         cache->node->config.pub->addr,  \
+         err);                           \
   } while (0)
 
 /* Global Variables *************************************************** */
@@ -64,56 +62,31 @@ static const uint32_t events[] = {
   gecko_evt_mesh_config_client_model_pub_status_id
 };
 
-/*
- * Models don't support publishing shouldn't be configured the publication
- */
-static const uint16_t not_pub_models[] = {
-  0x1007, /* Generic Power OnOff Setup Server */
-  0x100A,  /* Generic Power Level Setup Server */
-  0x100F,  /* Generic Location Setup Server */
-
-  0x1201, /* Time Setup Server */
-  0x1204, /* Scene Setup Server */
-  0x1207, /* Scheduler Setup Server */
-
-  0x1301, /* Light Lightness Setup Server */
-  0x1304, /* Light CTL Setup Server */
-  0x1308,  /* Light HSL Setup Server */
-  0x130D,  /* Light xyL Setup Server */
-};
-
 #define RELATE_EVENTS_NUM() (sizeof(events) / sizeof(uint32_t))
-#define NSPT_PUB_MODEL_NUM() (sizeof(not_pub_models) / sizeof(uint16_t))
 /* Static Variables *************************************************** */
 
 /* Static Functions Declaractions ************************************* */
-static int iter_setpub(config_cache_t *cache);
-
 static int __setpub(config_cache_t *cache, mng_t *mng)
 {
   int ret;
   uint16_t key_id = 0;
   struct gecko_msg_mesh_config_client_set_model_pub_rsp_t *rsp;
+  const plan_op_t *op = plan_op_cur(cache);
 
-  cache->vnm.vd =
-    cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-    ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].vid
-    : 0xFFFF;
-  cache->vnm.md =
-    cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-    ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].mid
-    : cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sig_models[cache->iterators[MODEL_ITERATOR_INDEX]];
+  ASSERT(op);
   ret = appkey_by_refid(mng,
                         cache->node->config.pub->aki,
                         &key_id);
   ASSERT(ret == asr_suc);
 
+  acc_cmd_async(cache);
+
   rsp = gecko_cmd_mesh_config_client_set_model_pub(
     mng->cfg->subnets[0].netkey.id,
     cache->node->addr,
-    cache->iterators[ELEMENT_ITERATOR_INDEX],
-    cache->vnm.vd,
-    cache->vnm.md,
+    op->elem,
+    op->vd,
+    op->md,
     cache->node->config.pub->addr,
     key_id,
     0,
@@ -124,16 +97,16 @@ static int __setpub(config_cache_t *cache, mng_t *mng)
 
   if (rsp->result != bg_err_success) {
     if (rsp->result == bg_err_out_of_memory) {
-      oom_set(cache);
+      oom_set(cache, bo_config_em);
       return asr_oom;
     }
-    FAIL_P(cache, rsp->result);
+    FAIL_P(cache, op, rsp->result);
     err_set_to_end(cache, rsp->result, bgapi_em);
     return asr_bgapi;
   } else {
-    ONCE_P(cache);
+    ONCE_P(cache, op);
     WAIT_RESPONSE_SET(cache);
-    cache->cc_handle = rsp->handle;
+    acc_handle_set(cache, rsp->handle);
     timer_set(cache, 1);
   }
 
@@ -161,6 +134,9 @@ int setpub_entry(config_cache_t *cache, func_guard guard)
     LOGW("State[%s] Guard Not Passed\n", state_names[cache->state]);
     return asr_tonext;
   }
+  if (!plan_op_first(cache, plan_pub_em)) {
+    return asr_tonext;
+  }
 
   return __setpub(cache, get_mng());
 }
@@ -182,10 +158,11 @@ int setpub_inprg(const struct gecko_cmd_packet *evt, config_cache_t *cache)
         case bg_err_mesh_not_initialized:
           if (evt->data.evt_mesh_config_client_model_pub_status.result
               == bg_err_mesh_not_initialized) {
-            LOGV("0x%04x Model Doesn't Support Publishing\n", cache->vnm.md);
+            LOGV("0x%04x Model Doesn't Support Publishing\n",
+                 plan_op_cur(cache)->md);
           }
           RETRY_CLEAR(cache);
-          SUC_P(cache);
+          SUC_P(cache, plan_op_cur(cache));
           break;
         case bg_err_timeout:
           /* bind any remaining_retry case here */
@@ -201,12 +178,13 @@ int setpub_inprg(const struct gecko_cmd_packet *evt, config_cache_t *cache)
           break;
         default:
           FAIL_P(cache,
+                 plan_op_cur(cache),
                  evt->data.evt_mesh_config_client_model_pub_status.result);
           err_set_to_end(cache, evt->data.evt_mesh_config_client_model_pub_status.result, bgevent_em);
           return asr_suc;
       }
 
-      if (iter_setpub(cache) == 1) {
+      if (!plan_op_next(cache)) {
         cache->next_state = -1;
         return asr_suc;
       }
@@ -273,47 +251,3 @@ bool is_setpub_pkts(uint32_t evtid)
   return 0;
 }
 
-static inline bool __pub_supported(uint16_t md)
-{
-  for (int i = 0; i < NSPT_PUB_MODEL_NUM(); i++) {
-    if (not_pub_models[i] == md) {
-      return false;
-    }
-  }
-  return true;
-}
-
-static int iter_setpub(config_cache_t *cache)
-{
-  int md, increment = 0;
-
-  do {
-    if (++cache->iterators[MODEL_ITERATOR_INDEX]
-        == cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-        + cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm_cnt) {
-      cache->iterators[MODEL_ITERATOR_INDEX] = 0;
-      increment = 0;
-      break;
-    } else {
-      md =
-        cache->iterators[MODEL_ITERATOR_INDEX] >= cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt
-        ? cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].vm[cache->iterators[MODEL_ITERATOR_INDEX] - cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sigm_cnt].mid
-        : cache->dcd.elems[cache->iterators[ELEMENT_ITERATOR_INDEX]].sig_models[cache->iterators[MODEL_ITERATOR_INDEX]];
-
-      if (__pub_supported(md)) {
-        increment = 1;
-        break;
-      }
-      LOGW("Model - 0x%04x doesn't support Pub, pass.\n",
-           md);
-    }
-  } while (1);
-
-  if (!increment) {
-    if (++cache->iterators[ELEMENT_ITERATOR_INDEX] == cache->dcd.element_cnt) {
-      cache->iterators[ELEMENT_ITERATOR_INDEX] = 0;
-      return 1;
-    }
-  }
-  return 0;
-}
@@ -0,0 +1,1140 @@
+/*************************************************************************
+    > File Name: ncp_emu.c
+    > Author: Kevin
+    > Created Time: 2020-02-20
+    > Description: Software stand-in of the NCP target, speaks BGAPI over a
+    > pty or the domain socket so the host can be benchmarked without radio
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+/* posix_openpt, cfmakeraw */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "host_gecko.h"
+
+/* Defines  *********************************************************** */
+#define EMU_MAX_DEVS 4096
+#define EMU_DFLT_DEVS 16
+#define EMU_PKT_MAX (BGLIB_MSG_HEADER_LEN + BGLIB_MSG_MAX_PAYLOAD)
+/* Unknown commands get result 0 followed by zeros, long enough for any rsp */
+#define EMU_GENERIC_RSP_LEN 32
+#define EMU_BOOT_DELAY 10
+#define EMU_INIT_DELAY 5
+#define EMU_MAX_POLL 100
+#define EMU_DFLT_CC_TIMEOUT 5000
+#define UNICAST_MAX 0x8000
+
+#define EMU_HDR(id, len) \
+  ((id) | (((len) & 0xff) << 8) | (((len) & 0x700) >> 8))
+
+#define USAGE                                                                 \
+  "Usage: %s [options]\n"                                                     \
+  "  -s <path>   Listen on the domain socket instead of creating a pty\n"     \
+  "  -l <path>   Symlink to the pty slave, so the host has a stable port\n"   \
+  "  -n <num>    Number of emulated unprovisioned devices [%d]\n"             \
+  "  -u <file>   Read the device UUIDs from file, one hex UUID per line\n"    \
+  "  -j <tmpl>   Print the nodes config file of the devices and exit\n"       \
+  "  -S <seed>   Seed of the pseudo random numbers [1]\n"                     \
+  "  -L <ms>     Config client status latency [50]\n"                         \
+  "  -J <ms>     Jitter added to every latency [20]\n"                        \
+  "  -P <ms>     Provisioning latency [300]\n"                                \
+  "  -b <ms>     Unprovisioned beacon interval of each device [1000]\n"       \
+  "  -x <pct>    Config client message loss rate [0]\n"                       \
+  "  -o <pct>    Out of memory rate of provision and config client cmds [0]\n" \
+  "  -f <pct>    Provisioning failure rate [0]\n"                             \
+  "  -c <num>    Max concurrent config client transactions [8]\n"             \
+  "  -m <num>    Max concurrent provisioning sessions [2]\n"
+
+enum {
+  dev_unprov,
+  dev_provisioning,
+  dev_provisioned,
+  /* Blacklisted and key refreshed out, neither beacons nor responds */
+  dev_excluded
+};
+
+/* Actions applied when the event is delivered */
+#define ACT_CC_DONE   (1 << 0)
+#define ACT_PROV_OK   (1 << 1)
+#define ACT_PROV_FAIL (1 << 2)
+#define ACT_NODE_RESET (1 << 3)
+#define ACT_KR_DONE   (1 << 4)
+
+typedef struct {
+  uint8_t uuid[16];
+  /* In the DDB if not 0 */
+  uint16_t addr;
+  uint8_t state;
+  uint8_t blacklisted;
+  uint64_t next_beacon;
+}emu_dev_t;
+
+typedef struct {
+  uint64_t due;
+  /* Keeps the events due at the same time in order */
+  uint32_t seq;
+  int act;
+  int dev;
+  uint16_t addr;
+  uint16_t len;
+  uint8_t buf[EMU_PKT_MAX];
+}emu_evt_t;
+
+/* Global Variables *************************************************** */
+
+/* Static Variables *************************************************** */
+static struct {
+  int devnum;
+  const char *uuid_file;
+  const char *sock;
+  const char *link;
+  int json_tmpl;
+  uint32_t seed;
+  int latency;
+  int jitter;
+  int prov_latency;
+  int beacon_intv;
+  int loss;
+  int oom;
+  int prov_fail;
+  int cc_max;
+  int prov_max;
+} opt = {
+  EMU_DFLT_DEVS, NULL, NULL, NULL, -1, 1, 50, 20, 300, 1000, 0, 0, 0, 8, 2
+};
+
+static struct {
+  int fd;
+  int srv;
+  uint8_t rx[EMU_PKT_MAX * 2];
+  int rxlen;
+  uint8_t *tx;
+  size_t txlen;
+  size_t txcap;
+
+  uint32_t rnd;
+  bool scanning;
+  bool kr_busy;
+  uint8_t networks;
+  uint16_t addr;
+  uint32_t ivi;
+  uint8_t netkey[16];
+  uint16_t appkeys;
+  uint16_t next_addr;
+  uint32_t handle;
+  uint32_t cc_timeout;
+  int cc_busy;
+  int prov_busy;
+
+  emu_dev_t *devs;
+  int devnum;
+  /* Unicast address -> index of the device + 1 */
+  uint16_t addr_idx[UNICAST_MAX];
+
+  /* Min heap of the pending events */
+  emu_evt_t **heap;
+  int evtnum;
+  int evtcap;
+  uint32_t seq;
+
+  struct {
+    uint32_t cmds;
+    uint32_t beacons;
+    uint32_t provisioned;
+    uint32_t prov_failed;
+    uint32_t cc_status;
+    uint32_t cc_lost;
+    uint32_t oom;
+  } stat;
+} emu = { -1, -1 };
+
+static volatile sig_atomic_t quit = 0;
+
+/* Static Functions Declaractions ************************************* */
+static uint64_t __now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* xorshift32, deterministic for the same seed */
+static uint32_t __rand(void)
+{
+  uint32_t x = emu.rnd;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return emu.rnd = x;
+}
+
+static inline bool __chance(int pct)
+{
+  return pct > 0 && (int)(__rand() % 100) < pct;
+}
+
+static inline uint64_t __latency(int base)
+{
+  return base + (opt.jitter > 0 ? __rand() % (opt.jitter + 1) : 0);
+}
+
+static void __on_signal(int sig)
+{
+  quit = 1;
+}
+
+/*
+ * Devices
+ */
+static void __uuid_gen(int i, uint8_t *uuid)
+{
+  memcpy(uuid, "NCP-EMU-UUID", 12);
+  uuid[12] = (uint8_t)(i >> 24);
+  uuid[13] = (uint8_t)(i >> 16);
+  uuid[14] = (uint8_t)(i >> 8);
+  uuid[15] = (uint8_t)i;
+}
+
+static int __hex2uuid(const char *s, uint8_t *uuid)
+{
+  unsigned int v;
+
+  for (int i = 0; i < 16; i++) {
+    if (1 != sscanf(s + i * 2, "%2x", &v)) {
+      return -1;
+    }
+    uuid[i] = (uint8_t)v;
+  }
+  return 0;
+}
+
+static int __devs_load(void)
+{
+  FILE *fp;
+  char line[128];
+
+  emu.devs = calloc(EMU_MAX_DEVS, sizeof(emu_dev_t));
+  if (!opt.uuid_file) {
+    if (opt.devnum > EMU_MAX_DEVS) {
+      opt.devnum = EMU_MAX_DEVS;
+    }
+    for (int i = 0; i < opt.devnum; i++) {
+      __uuid_gen(i, emu.devs[i].uuid);
+    }
+    emu.devnum = opt.devnum;
+    return 0;
+  }
+
+  if (NULL == (fp = fopen(opt.uuid_file, "r"))) {
+    fprintf(stderr, "Open %s error[%s]\n", opt.uuid_file, strerror(errno));
+    return -1;
+  }
+  while (emu.devnum < EMU_MAX_DEVS && fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#' || strlen(line) < 32) {
+      continue;
+    }
+    if (__hex2uuid(line, emu.devs[emu.devnum].uuid)) {
+      fprintf(stderr, "Invalid UUID line dropped - %s", line);
+      continue;
+    }
+    emu.devnum++;
+  }
+  fclose(fp);
+  return 0;
+}
+
+static emu_dev_t *__dev_by_uuid(const uint8_t *uuid)
+{
+  for (int i = 0; i < emu.devnum; i++) {
+    if (!memcmp(emu.devs[i].uuid, uuid, 16)) {
+      return &emu.devs[i];
+    }
+  }
+  return NULL;
+}
+
+static emu_dev_t *__dev_by_addr(uint16_t addr)
+{
+  if (!addr || addr >= UNICAST_MAX || !emu.addr_idx[addr]) {
+    return NULL;
+  }
+  return &emu.devs[emu.addr_idx[addr] - 1];
+}
+
+static void __ddb_add(emu_dev_t *d, uint16_t addr)
+{
+  d->addr = addr;
+  emu.addr_idx[addr] = (uint16_t)(d - emu.devs) + 1;
+}
+
+static void __ddb_del(emu_dev_t *d)
+{
+  if (d->addr) {
+    emu.addr_idx[d->addr] = 0;
+    d->addr = 0;
+  }
+}
+
+static void __json_print(void)
+{
+  printf("{\n"
+         "  \"SyncTime\": \"0x00000000\",\n"
+         "  \"Subnets\": [\n"
+         "    {\n"
+         "      \"RefId\": \"0x0000\",\n"
+         "      \"Nodes\": [\n");
+  for (int i = 0; i < emu.devnum; i++) {
+    printf("        {\n"
+           "          \"UUID\": \"");
+    for (int j = 0; j < 16; j++) {
+      printf("%02x", emu.devs[i].uuid[j]);
+    }
+    printf("\",\n"
+           "          \"Address\": \"0x0000\",\n"
+           "          \"Err\": \"0x00000000\",\n"
+           "          \"Template ID\": \"0x%02x\",\n"
+           "          \"RM_Blacklist\": \"0x00\",\n"
+           "          \"Functionality\": \"0x00\",\n"
+           "          \"Done\": \"0x00\"\n"
+           "        }%s\n",
+           opt.json_tmpl,
+           i == emu.devnum - 1 ? "" : ",");
+  }
+  printf("      ]\n"
+         "    }\n"
+         "  ],\n"
+         "  \"Backlog\": []\n"
+         "}\n");
+}
+
+/*
+ * Output
+ */
+static void __tx(const uint8_t *buf, size_t len)
+{
+  if (emu.fd < 0) {
+    return;
+  }
+  if (emu.txlen + len > emu.txcap) {
+    emu.txcap = (emu.txlen + len) * 2;
+    emu.tx = realloc(emu.tx, emu.txcap);
+  }
+  memcpy(emu.tx + emu.txlen, buf, len);
+  emu.txlen += len;
+}
+
+static void __tx_flush(void)
+{
+  ssize_t n;
+
+  while (emu.fd >= 0 && emu.txlen) {
+    n = write(emu.fd, emu.tx, emu.txlen);
+    if (n <= 0) {
+      return;
+    }
+    memmove(emu.tx, emu.tx + n, emu.txlen - n);
+    emu.txlen -= n;
+  }
+}
+
+static void __send(uint32_t id, const void *payload, uint16_t len)
+{
+  uint8_t buf[EMU_PKT_MAX];
+  uint32_t hdr = EMU_HDR(id, len);
+
+  memcpy(buf, &hdr, BGLIB_MSG_HEADER_LEN);
+  memcpy(buf + BGLIB_MSG_HEADER_LEN, payload, len);
+  __tx(buf, BGLIB_MSG_HEADER_LEN + len);
+}
+
+static void __rsp_result(uint32_t id, uint16_t result)
+{
+  uint8_t payload[EMU_GENERIC_RSP_LEN] = { 0 };
+
+  memcpy(payload, &result, sizeof(uint16_t));
+  __send(id, payload, sizeof(payload));
+}
+
+/*
+ * Pending events
+ */
+static inline bool __evt_before(const emu_evt_t *a, const emu_evt_t *b)
+{
+  return a->due < b->due || (a->due == b->due && a->seq < b->seq);
+}
+
+static emu_evt_t *__sched(uint64_t due,
+                          uint32_t id,
+                          const void *payload,
+                          uint16_t len)
+{
+  emu_evt_t *e = calloc(1, sizeof(emu_evt_t));
+  uint32_t hdr = EMU_HDR(id, len);
+  int i, p;
+
+  e->due = due;
+  e->seq = emu.seq++;
+  e->dev = -1;
+  e->len = BGLIB_MSG_HEADER_LEN + len;
+  memcpy(e->buf, &hdr, BGLIB_MSG_HEADER_LEN);
+  memcpy(e->buf + BGLIB_MSG_HEADER_LEN, payload, len);
+
+  if (emu.evtnum == emu.evtcap) {
+    emu.evtcap = emu.evtcap ? emu.evtcap * 2 : 64;
+    emu.heap = realloc(emu.heap, emu.evtcap * sizeof(emu_evt_t *));
+  }
+  for (i = emu.evtnum++; i; i = p) {
+    p = (i - 1) / 2;
+    if (!__evt_before(e, emu.heap[p])) {
+      break;
+    }
+    emu.heap[i] = emu.heap[p];
+  }
+  emu.heap[i] = e;
+  return e;
+}
+
+static emu_evt_t *__evt_pop(void)
+{
+  emu_evt_t *top, *last;
+  int i = 0, c;
+
+  if (!emu.evtnum) {
+    return NULL;
+  }
+  top = emu.heap[0];
+  last = emu.heap[--emu.evtnum];
+  while ((c = i * 2 + 1) < emu.evtnum) {
+    if (c + 1 < emu.evtnum && __evt_before(emu.heap[c + 1], emu.heap[c])) {
+      c++;
+    }
+    if (!__evt_before(emu.heap[c], last)) {
+      break;
+    }
+    emu.heap[i] = emu.heap[c];
+    i = c;
+  }
+  emu.heap[i] = last;
+  return top;
+}
+
+static void __evts_clr(void)
+{
+  for (int i = 0; i < emu.evtnum; i++) {
+    free(emu.heap[i]);
+  }
+  emu.evtnum = 0;
+}
+
+static void __evt_deliver(emu_evt_t *e)
+{
+  emu_dev_t *d = e->dev >= 0 ? &emu.devs[e->dev] : NULL;
+
+  if (e->act & ACT_CC_DONE) {
+    emu.cc_busy--;
+  }
+  if (e->act & ACT_PROV_OK) {
+    emu.prov_busy--;
+    __ddb_add(d, e->addr);
+    d->state = dev_provisioned;
+    emu.stat.provisioned++;
+  }
+  if (e->act & ACT_PROV_FAIL) {
+    emu.prov_busy--;
+    if (d && d->state == dev_provisioning) {
+      d->state = dev_unprov;
+    }
+    emu.stat.prov_failed++;
+  }
+  if (e->act & ACT_NODE_RESET) {
+    /* Factory reset, beaconing again while still in the DDB until deleted */
+    d->state = dev_unprov;
+    d->blacklisted = 0;
+  }
+  if (e->act & ACT_KR_DONE) {
+    emu.kr_busy = false;
+    for (int i = 0; i < 16; i++) {
+      emu.netkey[i] ^= (uint8_t)__rand();
+    }
+    for (int i = 0; i < emu.devnum; i++) {
+      if (emu.devs[i].blacklisted && emu.devs[i].state == dev_provisioned) {
+        emu.devs[i].state = dev_excluded;
+      }
+    }
+  }
+  __tx(e->buf, e->len);
+  free(e);
+}
+
+static int __evts_due(uint64_t now)
+{
+  while (emu.evtnum && emu.heap[0]->due <= now) {
+    __evt_deliver(__evt_pop());
+  }
+  return emu.evtnum ? (int)(emu.heap[0]->due - now) : EMU_MAX_POLL;
+}
+
+static int __beacons(uint64_t now)
+{
+  struct gecko_cmd_packet p;
+  struct gecko_msg_mesh_prov_unprov_beacon_evt_t *b
+    = &p.data.evt_mesh_prov_unprov_beacon;
+  int next = EMU_MAX_POLL;
+  emu_dev_t *d;
+
+  if (!emu.scanning) {
+    return next;
+  }
+  for (int i = 0; i < emu.devnum; i++) {
+    d = &emu.devs[i];
+    if (d->state != dev_unprov) {
+      continue;
+    }
+    if (d->next_beacon > now) {
+      if (d->next_beacon - now < next) {
+        next = d->next_beacon - now;
+      }
+      continue;
+    }
+    memset(b, 0, sizeof(*b));
+    memcpy(b->address.addr, d->uuid + 10, sizeof(b->address.addr));
+    b->uuid.len = 16;
+    memcpy(b->uuid.data, d->uuid, 16);
+    __send(gecko_evt_mesh_prov_unprov_beacon_id, b, sizeof(*b) + 16);
+    emu.stat.beacons++;
+    d->next_beacon += opt.beacon_intv;
+    if (d->next_beacon <= now) {
+      d->next_beacon = now + opt.beacon_intv;
+    }
+  }
+  return next;
+}
+
+/*
+ * Commands
+ */
+static void __session_reset(void)
+{
+  __evts_clr();
+  emu.scanning = false;
+  emu.kr_busy = false;
+  emu.cc_busy = 0;
+  emu.prov_busy = 0;
+  for (int i = 0; i < emu.devnum; i++) {
+    if (emu.devs[i].state == dev_provisioning) {
+      emu.devs[i].state = dev_unprov;
+    }
+  }
+}
+
+static void __factory_reset(void)
+{
+  emu.networks = 0;
+  emu.addr = 0;
+  emu.ivi = 0;
+  emu.appkeys = 0;
+  emu.next_addr = 1;
+  memset(emu.netkey, 0, 16);
+  for (int i = 0; i < emu.devnum; i++) {
+    __ddb_del(&emu.devs[i]);
+    emu.devs[i].state = dev_unprov;
+    emu.devs[i].blacklisted = 0;
+  }
+}
+
+static void __on_reset(uint64_t now)
+{
+  struct gecko_msg_system_boot_evt_t b = { 0 };
+
+  __session_reset();
+  b.major = 2;
+  b.minor = 13;
+  __sched(now + EMU_BOOT_DELAY, gecko_evt_system_boot_id, &b, sizeof(b));
+}
+
+static void __on_provision(const struct gecko_cmd_packet *cmd, uint64_t now)
+{
+  const struct gecko_msg_mesh_prov_provision_device_cmd_t *c
+    = &cmd->data.cmd_mesh_prov_provision_device;
+  struct gecko_cmd_packet p;
+  emu_dev_t *d = c->uuid.len == 16 ? __dev_by_uuid(c->uuid.data) : NULL;
+  uint64_t due = now + __latency(opt.prov_latency);
+  emu_evt_t *e;
+
+  if (emu.prov_busy >= opt.prov_max || __chance(opt.oom)) {
+    emu.stat.oom++;
+    __rsp_result(gecko_rsp_mesh_prov_provision_device_id, bg_err_out_of_memory);
+    return;
+  }
+  if (d && d->addr) {
+    __rsp_result(gecko_rsp_mesh_prov_provision_device_id,
+                 bg_err_mesh_already_exists);
+    return;
+  }
+  __rsp_result(gecko_rsp_mesh_prov_provision_device_id, bg_err_success);
+  emu.prov_busy++;
+
+  if (!d || d->state != dev_unprov || __chance(opt.prov_fail)) {
+    struct gecko_msg_mesh_prov_provisioning_failed_evt_t *f
+      = &p.data.evt_mesh_prov_provisioning_failed;
+    f->reason = 1;
+    f->uuid.len = 16;
+    memcpy(f->uuid.data, c->uuid.data, 16);
+    e = __sched(due, gecko_evt_mesh_prov_provisioning_failed_id, f,
+                sizeof(*f) + 16);
+    e->act = ACT_PROV_FAIL;
+  } else {
+    struct gecko_msg_mesh_prov_device_provisioned_evt_t *s
+      = &p.data.evt_mesh_prov_device_provisioned;
+    s->address = emu.next_addr++;
+    s->uuid.len = 16;
+    memcpy(s->uuid.data, d->uuid, 16);
+    e = __sched(due, gecko_evt_mesh_prov_device_provisioned_id, s,
+                sizeof(*s) + 16);
+    e->act = ACT_PROV_OK;
+    e->addr = s->address;
+    d->state = dev_provisioning;
+  }
+  if (d) {
+    e->dev = d - emu.devs;
+  }
+}
+
+/* Config client commands and the status events they end with */
+static const struct {
+  uint32_t cmd;
+  uint32_t evt;
+} cc_map[] = {
+  { gecko_cmd_mesh_config_client_get_dcd_id,
+    gecko_evt_mesh_config_client_dcd_data_end_id },
+  { gecko_cmd_mesh_config_client_add_appkey_id,
+    gecko_evt_mesh_config_client_appkey_status_id },
+  { gecko_cmd_mesh_config_client_bind_model_id,
+    gecko_evt_mesh_config_client_binding_status_id },
+  { gecko_cmd_mesh_config_client_set_model_pub_id,
+    gecko_evt_mesh_config_client_model_pub_status_id },
+  { gecko_cmd_mesh_config_client_add_model_sub_id,
+    gecko_evt_mesh_config_client_model_sub_status_id },
+  { gecko_cmd_mesh_config_client_set_model_sub_id,
+    gecko_evt_mesh_config_client_model_sub_status_id },
+  { gecko_cmd_mesh_config_client_set_relay_id,
+    gecko_evt_mesh_config_client_relay_status_id },
+  { gecko_cmd_mesh_config_client_set_friend_id,
+    gecko_evt_mesh_config_client_friend_status_id },
+  { gecko_cmd_mesh_config_client_set_gatt_proxy_id,
+    gecko_evt_mesh_config_client_gatt_proxy_status_id },
+  { gecko_cmd_mesh_config_client_set_default_ttl_id,
+    gecko_evt_mesh_config_client_default_ttl_status_id },
+  { gecko_cmd_mesh_config_client_set_network_transmit_id,
+    gecko_evt_mesh_config_client_network_transmit_status_id },
+  { gecko_cmd_mesh_config_client_set_beacon_id,
+    gecko_evt_mesh_config_client_beacon_status_id },
+  { gecko_cmd_mesh_config_client_reset_node_id,
+    gecko_evt_mesh_config_client_reset_status_id },
+};
+
+/*
+ * CID 0x02ff PID 0x0001 VID 0x0001 CRPL 0x0020 Features relay|proxy|friend,
+ * one element with config server, health server, onoff, lightness and CTL
+ * servers
+ */
+static const uint8_t dcd_page0[] = {
+  0xff, 0x02, 0x01, 0x00, 0x01, 0x00, 0x20, 0x00, 0x07, 0x00,
+  0x00, 0x00, 0x05, 0x00,
+  0x00, 0x00, 0x02, 0x00, 0x00, 0x10, 0x00, 0x13, 0x03, 0x13
+};
+
+static int __cc_status_id(uint32_t cmd)
+{
+  for (int i = 0; i < sizeof(cc_map) / sizeof(cc_map[0]); i++) {
+    if (cc_map[i].cmd == cmd) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void __on_cc(const struct gecko_cmd_packet *cmd, int which, uint64_t now)
+{
+  struct {
+    uint16_t result;
+    uint32_t handle;
+  } __attribute__((packed)) rsp;
+  uint8_t payload[EMU_GENERIC_RSP_LEN] = { 0 };
+  /* All config client commands start with enc_netkey_index, server_address */
+  uint16_t addr = cmd->data.payload[2] | (cmd->data.payload[3] << 8);
+  uint32_t id = BGLIB_MSG_ID(cmd->header);
+  emu_dev_t *d = __dev_by_addr(addr);
+  bool lost;
+  uint64_t due;
+  emu_evt_t *e;
+
+  if (emu.cc_busy >= opt.cc_max || __chance(opt.oom)) {
+    emu.stat.oom++;
+    rsp.result = bg_err_out_of_memory;
+    rsp.handle = 0;
+    __send(id, &rsp, sizeof(rsp));
+    return;
+  }
+  rsp.result = bg_err_success;
+  rsp.handle = ++emu.handle;
+  __send(id, &rsp, sizeof(rsp));
+  emu.cc_busy++;
+
+  /* No response is seen as timeout by the config client */
+  lost = !d || d->state != dev_provisioned || __chance(opt.loss);
+  due = now + (lost ? emu.cc_timeout : __latency(opt.latency));
+
+  if (!lost && id == gecko_cmd_mesh_config_client_get_dcd_id) {
+    struct gecko_cmd_packet p;
+    struct gecko_msg_mesh_config_client_dcd_data_evt_t *dd
+      = &p.data.evt_mesh_config_client_dcd_data;
+    dd->handle = rsp.handle;
+    dd->page = 0;
+    dd->data.len = sizeof(dcd_page0);
+    memcpy(dd->data.data, dcd_page0, sizeof(dcd_page0));
+    __sched(due, gecko_evt_mesh_config_client_dcd_data_id, dd,
+            sizeof(*dd) + sizeof(dcd_page0));
+  }
+
+  rsp.result = lost ? bg_err_timeout : bg_err_success;
+  memcpy(payload, &rsp, sizeof(rsp));
+  e = __sched(due, cc_map[which].evt, payload, sizeof(payload));
+  e->act = ACT_CC_DONE;
+  if (lost) {
+    emu.stat.cc_lost++;
+  } else {
+    emu.stat.cc_status++;
+    if (id == gecko_cmd_mesh_config_client_reset_node_id) {
+      e->act |= ACT_NODE_RESET;
+      e->dev = d - emu.devs;
+    }
+  }
+}
+
+static void __on_kr_start(const struct gecko_cmd_packet *cmd, uint64_t now)
+{
+  struct gecko_cmd_packet p;
+  struct gecko_msg_mesh_prov_key_refresh_node_update_evt_t *nu
+    = &p.data.evt_mesh_prov_key_refresh_node_update;
+  struct gecko_msg_mesh_prov_key_refresh_phase_update_evt_t pu;
+  struct gecko_msg_mesh_prov_key_refresh_complete_evt_t kc;
+  uint16_t key = cmd->data.cmd_mesh_prov_key_refresh_start.netkey_index;
+  uint64_t t = now;
+  bool *dropped;
+  emu_dev_t *d;
+  emu_evt_t *e;
+
+  if (emu.kr_busy) {
+    __rsp_result(gecko_rsp_mesh_prov_key_refresh_start_id, bg_err_wrong_state);
+    return;
+  }
+  __rsp_result(gecko_rsp_mesh_prov_key_refresh_start_id, bg_err_success);
+  emu.kr_busy = true;
+
+  /* A node missing one phase is stuck there till the end */
+  dropped = calloc(emu.devnum, sizeof(bool));
+  for (uint8_t phase = 1; phase <= 3; phase++) {
+    for (int i = 0; i < emu.devnum; i++) {
+      d = &emu.devs[i];
+      if (!d->addr || d->blacklisted || d->state != dev_provisioned
+          || dropped[i]) {
+        continue;
+      }
+      if (__chance(opt.loss)) {
+        dropped[i] = true;
+        continue;
+      }
+      t += __latency(opt.latency);
+      nu->key = key;
+      nu->phase = phase == 3 ? 0 : phase;
+      nu->uuid.len = 16;
+      memcpy(nu->uuid.data, d->uuid, 16);
+      __sched(t, gecko_evt_mesh_prov_key_refresh_node_update_id, nu,
+              sizeof(*nu) + 16);
+    }
+    pu.key = key;
+    pu.phase = phase == 3 ? 0 : phase;
+    __sched(t, gecko_evt_mesh_prov_key_refresh_phase_update_id, &pu,
+            sizeof(pu));
+  }
+  free(dropped);
+  kc.key = key;
+  kc.result = bg_err_success;
+  e = __sched(t, gecko_evt_mesh_prov_key_refresh_complete_id, &kc, sizeof(kc));
+  e->act = ACT_KR_DONE;
+}
+
+static void __on_cmd(const struct gecko_cmd_packet *cmd, uint64_t now)
+{
+  struct gecko_cmd_packet p;
+  uint32_t id = BGLIB_MSG_ID(cmd->header);
+  emu_dev_t *d;
+  int which;
+
+  emu.stat.cmds++;
+  memset(&p, 0, sizeof(p));
+  switch (id) {
+    case gecko_cmd_system_reset_id:
+      /* No response */
+      __on_reset(now);
+      break;
+    case gecko_cmd_flash_ps_erase_all_id:
+      __factory_reset();
+      __rsp_result(id, bg_err_success);
+      break;
+    case gecko_cmd_mesh_prov_init_id:
+    {
+      struct gecko_msg_mesh_prov_initialized_evt_t ini;
+      __rsp_result(id, bg_err_success);
+      ini.networks = emu.networks;
+      ini.address = emu.addr;
+      ini.ivi = emu.ivi;
+      __sched(now + EMU_INIT_DELAY, gecko_evt_mesh_prov_initialized_id,
+              &ini, sizeof(ini));
+    }
+    break;
+    case gecko_cmd_mesh_prov_initialize_network_id:
+      emu.addr = cmd->data.cmd_mesh_prov_initialize_network.address;
+      emu.ivi = cmd->data.cmd_mesh_prov_initialize_network.ivi;
+      if (emu.next_addr <= emu.addr) {
+        emu.next_addr = emu.addr + 1;
+      }
+      __rsp_result(id, bg_err_success);
+      break;
+    case gecko_cmd_mesh_prov_create_network_id:
+      p.data.rsp_mesh_prov_create_network.result
+        = emu.networks ? bg_err_mesh_already_exists : bg_err_success;
+      if (!emu.networks) {
+        emu.networks = 1;
+        memcpy(emu.netkey, cmd->data.cmd_mesh_prov_create_network.key.data,
+               16);
+      }
+      __send(id, &p.data.payload, EMU_GENERIC_RSP_LEN);
+      break;
+    case gecko_cmd_mesh_prov_create_appkey_id:
+      p.data.rsp_mesh_prov_create_appkey.appkey_index = emu.appkeys++;
+      __send(id, &p.data.payload, EMU_GENERIC_RSP_LEN);
+      break;
+    case gecko_cmd_mesh_test_get_key_id:
+      p.data.rsp_mesh_test_get_key.id = cmd->data.cmd_mesh_test_get_key.index;
+      memcpy(p.data.rsp_mesh_test_get_key.key.data, emu.netkey, 16);
+      __send(id, &p.data.payload, EMU_GENERIC_RSP_LEN);
+      break;
+    case gecko_cmd_mesh_config_client_set_default_timeout_id:
+      emu.cc_timeout
+        = cmd->data.cmd_mesh_config_client_set_default_timeout.timeout_ms;
+      __rsp_result(id, bg_err_success);
+      break;
+    case gecko_cmd_mesh_prov_scan_unprov_beacons_id:
+      emu.scanning = true;
+      __rsp_result(id, bg_err_success);
+      break;
+    case gecko_cmd_mesh_prov_stop_scan_unprov_beacons_id:
+      emu.scanning = false;
+      __rsp_result(id, bg_err_success);
+      break;
+    case gecko_cmd_mesh_prov_provision_device_id:
+      __on_provision(cmd, now);
+      break;
+    case gecko_cmd_mesh_prov_ddb_get_id:
+      d = __dev_by_uuid(cmd->data.cmd_mesh_prov_ddb_get.uuid.data);
+      if (!d || !d->addr) {
+        __rsp_result(id, bg_err_mesh_does_not_exist);
+        break;
+      }
+      p.data.rsp_mesh_prov_ddb_get.address = d->addr;
+      p.data.rsp_mesh_prov_ddb_get.elements = 1;
+      __send(id, &p.data.payload, EMU_GENERIC_RSP_LEN);
+      break;
+    case gecko_cmd_mesh_prov_ddb_delete_id:
+      d = __dev_by_uuid(cmd->data.cmd_mesh_prov_ddb_delete.uuid.data);
+      if (!d || !d->addr) {
+        __rsp_result(id, bg_err_mesh_does_not_exist);
+        break;
+      }
+      __ddb_del(d);
+      /* Assume the device is factory reset along with the deletion */
+      if (d->state == dev_provisioned) {
+        d->state = dev_unprov;
+      }
+      __rsp_result(id, bg_err_success);
+      break;
+    case gecko_cmd_mesh_prov_ddb_list_devices_id:
+    {
+      struct gecko_msg_mesh_prov_ddb_list_evt_t l;
+      uint16_t cnt = 0;
+      for (int i = 0; i < emu.devnum; i++) {
+        cnt += !!emu.devs[i].addr;
+      }
+      p.data.rsp_mesh_prov_ddb_list_devices.count = cnt;
+      __send(id, &p.data.payload, EMU_GENERIC_RSP_LEN);
+      for (int i = 0; i < emu.devnum; i++) {
+        if (!emu.devs[i].addr) {
+          continue;
+        }
+        memcpy(l.uuid.data, emu.devs[i].uuid, 16);
+        l.address = emu.devs[i].addr;
+        l.elements = 1;
+        __sched(now, gecko_evt_mesh_prov_ddb_list_id, &l, sizeof(l));
+      }
+    }
+    break;
+    case gecko_cmd_mesh_prov_set_key_refresh_blacklist_id:
+      d = __dev_by_uuid(cmd->data.cmd_mesh_prov_set_key_refresh_blacklist.uuid.data);
+      if (!d || !d->addr) {
+        __rsp_result(id, bg_err_mesh_does_not_exist);
+        break;
+      }
+      d->blacklisted = cmd->data.cmd_mesh_prov_set_key_refresh_blacklist.status;
+      __rsp_result(id, bg_err_success);
+      break;
+    case gecko_cmd_mesh_prov_key_refresh_start_id:
+      __on_kr_start(cmd, now);
+      break;
+    default:
+      if (-1 != (which = __cc_status_id(id))) {
+        __on_cc(cmd, which, now);
+      } else {
+        __rsp_result(id, bg_err_success);
+      }
+      break;
+  }
+}
+
+/*
+ * Input
+ */
+static void __rx(uint64_t now)
+{
+  struct gecko_cmd_packet cmd;
+  uint32_t hdr;
+  int pktlen;
+  ssize_t n;
+
+  n = read(emu.fd, emu.rx + emu.rxlen, sizeof(emu.rx) - emu.rxlen);
+  if (n <= 0) {
+    if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+      if (emu.srv >= 0) {
+        /* Socket mode, wait for the host to connect again */
+        fprintf(stderr, "Host disconnected\n");
+        close(emu.fd);
+        emu.fd = -1;
+        emu.rxlen = 0;
+        emu.txlen = 0;
+        __session_reset();
+      } else {
+        /* The pty slave is not opened */
+        usleep(EMU_MAX_POLL * 1000);
+      }
+    }
+    return;
+  }
+  emu.rxlen += n;
+
+  while (emu.rxlen >= BGLIB_MSG_HEADER_LEN) {
+    memcpy(&hdr, emu.rx, BGLIB_MSG_HEADER_LEN);
+    if ((emu.rx[0] & (gecko_dev_type_gecko | gecko_msg_type_evt))
+        != gecko_dev_type_gecko || BGLIB_MSG_LEN(hdr) > BGLIB_MSG_MAX_PAYLOAD) {
+      /* Out of sync, drop one byte */
+      memmove(emu.rx, emu.rx + 1, --emu.rxlen);
+      continue;
+    }
+    pktlen = BGLIB_MSG_HEADER_LEN + BGLIB_MSG_LEN(hdr);
+    if (pktlen > emu.rxlen) {
+      break;
+    }
+    memset(&cmd, 0, sizeof(cmd));
+    memcpy(&cmd, emu.rx, pktlen);
+    memmove(emu.rx, emu.rx + pktlen, emu.rxlen - pktlen);
+    emu.rxlen -= pktlen;
+    __on_cmd(&cmd, now);
+  }
+}
+
+static int __open_pty(void)
+{
+  struct termios tio;
+  const char *slave;
+
+  if (-1 == (emu.fd = posix_openpt(O_RDWR | O_NOCTTY))
+      || grantpt(emu.fd) || unlockpt(emu.fd)
+      || NULL == (slave = ptsname(emu.fd))) {
+    fprintf(stderr, "Create pty error[%s]\n", strerror(errno));
+    return -1;
+  }
+  if (0 == tcgetattr(emu.fd, &tio)) {
+    cfmakeraw(&tio);
+    tcsetattr(emu.fd, TCSANOW, &tio);
+  }
+  fcntl(emu.fd, F_SETFL, fcntl(emu.fd, F_GETFL) | O_NONBLOCK);
+  if (opt.link) {
+    unlink(opt.link);
+    if (symlink(slave, opt.link)) {
+      fprintf(stderr, "Link %s error[%s]\n", opt.link, strerror(errno));
+      return -1;
+    }
+  }
+  printf("NCP emulator on %s\n", opt.link ? opt.link : slave);
+  return 0;
+}
+
+static int __open_sock(void)
+{
+  struct sockaddr_un sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strncpy(sa.sun_path, opt.sock, sizeof(sa.sun_path) - 1);
+  unlink(opt.sock);
+  if (-1 == (emu.srv = socket(AF_UNIX, SOCK_STREAM, 0))
+      || bind(emu.srv, (struct sockaddr *)&sa, sizeof(sa))
+      || listen(emu.srv, 1)) {
+    fprintf(stderr, "Socket %s error[%s]\n", opt.sock, strerror(errno));
+    return -1;
+  }
+  printf("NCP emulator listening on %s\n", opt.sock);
+  return 0;
+}
+
+static void __stat_print(void)
+{
+  printf("Commands            %u\n"
+         "Beacons             %u\n"
+         "Provisioned         %u\n"
+         "Provisioning failed %u\n"
+         "Config status       %u\n"
+         "Config timeout      %u\n"
+         "OOM                 %u\n",
+         emu.stat.cmds,
+         emu.stat.beacons,
+         emu.stat.provisioned,
+         emu.stat.prov_failed,
+         emu.stat.cc_status,
+         emu.stat.cc_lost,
+         emu.stat.oom);
+}
+
+static int __args(int argc, char *argv[])
+{
+  int c;
+
+  while (-1 != (c = getopt(argc, argv, "s:l:n:u:j:S:L:J:P:b:x:o:f:c:m:h"))) {
+    switch (c) {
+      case 's': opt.sock = optarg; break;
+      case 'l': opt.link = optarg; break;
+      case 'n': opt.devnum = atoi(optarg); break;
+      case 'u': opt.uuid_file = optarg; break;
+      case 'j': opt.json_tmpl = strtol(optarg, NULL, 0); break;
+      case 'S': opt.seed = strtoul(optarg, NULL, 0); break;
+      case 'L': opt.latency = atoi(optarg); break;
+      case 'J': opt.jitter = atoi(optarg); break;
+      case 'P': opt.prov_latency = atoi(optarg); break;
+      case 'b': opt.beacon_intv = atoi(optarg); break;
+      case 'x': opt.loss = atoi(optarg); break;
+      case 'o': opt.oom = atoi(optarg); break;
+      case 'f': opt.prov_fail = atoi(optarg); break;
+      case 'c': opt.cc_max = atoi(optarg); break;
+      case 'm': opt.prov_max = atoi(optarg); break;
+      default:
+        printf(USAGE, argv[0], EMU_DFLT_DEVS);
+        return -1;
+    }
+  }
+  if (opt.devnum < 0 || opt.beacon_intv <= 0 || opt.cc_max <= 0
+      || opt.prov_max <= 0) {
+    printf(USAGE, argv[0], EMU_DFLT_DEVS);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  struct pollfd pfd;
+  uint64_t now;
+  int tmo, t;
+
+  if (__args(argc, argv) || __devs_load()) {
+    return EXIT_FAILURE;
+  }
+  if (opt.json_tmpl >= 0) {
+    __json_print();
+    return EXIT_SUCCESS;
+  }
+  emu.rnd = opt.seed ? opt.seed : 1;
+  emu.cc_timeout = EMU_DFLT_CC_TIMEOUT;
+  __factory_reset();
+  now = __now();
+  /* Spread the beacons over the interval */
+  for (int i = 0; i < emu.devnum; i++) {
+    emu.devs[i].next_beacon = now + (uint64_t)opt.beacon_intv * i / (emu.devnum ? emu.devnum : 1);
+  }
+
+  if (opt.sock ? __open_sock() : __open_pty()) {
+    return EXIT_FAILURE;
+  }
+  printf("%d device(s) emulated\n", emu.devnum);
+  fflush(stdout);
+  signal(SIGINT, __on_signal);
+  signal(SIGTERM, __on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  while (!quit) {
+    now = __now();
+    tmo = __evts_due(now);
+    if ((t = __beacons(now)) < tmo) {
+      tmo = t;
+    }
+    __tx_flush();
+
+    if (emu.fd < 0) {
+      pfd.fd = emu.srv;
+      pfd.events = POLLIN;
+    } else {
+      pfd.fd = emu.fd;
+      pfd.events = POLLIN | (emu.txlen ? POLLOUT : 0);
+    }
+    if (tmo > EMU_MAX_POLL) {
+      tmo = EMU_MAX_POLL;
+    }
+    if (poll(&pfd, 1, tmo) <= 0) {
+      continue;
+    }
+    if (emu.fd < 0) {
+      if (-1 != (emu.fd = accept(emu.srv, NULL, NULL))) {
+        fcntl(emu.fd, F_SETFL, fcntl(emu.fd, F_GETFL) | O_NONBLOCK);
+        fprintf(stderr, "Host connected\n");
+      }
+      continue;
+    }
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+      __rx(__now());
+    }
+  }
+
+  __stat_print();
+  if (opt.link) {
+    unlink(opt.link);
+  }
+  if (opt.sock) {
+    unlink(opt.sock);
+  }
+  return EXIT_SUCCESS;
+}
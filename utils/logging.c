@@ -9,10 +9,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <time.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "logging.h"
 #include "utils.h"
@@ -25,6 +28,15 @@
 #define LINE_NAME_LENGTH  5
 #define FILE_LINE_LENGTH  (FILE_NAME_LENGTH + LINE_NAME_LENGTH + 3)
 
+/*
+ * Log records are formatted into a lock-free ring by the callers and written
+ * to the file by the writer thread, LOG_RING_SLOTS MUST be power of 2
+ */
+#define LOG_RING_SLOTS 512
+#define LOG_RING_MASK (LOG_RING_SLOTS - 1)
+/* Record without the [Time][file:line][LVL] prefix */
+#define LVL_RAW 0x7f
+
 /* #define LOGGING_DBG */
 #ifdef LOGGING_DBG
 #define LD(...) printf(__VA_ARGS__)
@@ -39,16 +51,48 @@ typedef struct {
   FILE *fp;
   log_lvl_t level;
   bool tostdout;
-  size_t log_len;
-  char *buf;
 }logcfg_t;
 
 static logcfg_t lcfg = {
   NULL,
   LVL_VER,
-  0,
-  0,
-  NULL
+  0
+};
+
+/*
+ * Only the message is formatted by the caller, the prefix is built by the
+ * writer from the binary fields
+ */
+typedef struct {
+  /* Sequence of the slot, see __ring_put */
+  size_t seq;
+  time_t t;
+  const char *file;
+  unsigned int line;
+  int lvl;
+  char msg[LOGBUF_SIZE];
+}logrec_t;
+
+static struct {
+  logrec_t slots[LOG_RING_SLOTS];
+  size_t head;
+  size_t tail;
+  unsigned int dropped;
+  bool running;
+  /* Set by the writer under {mutex} before it waits on {cond} */
+  bool sleeping;
+  pthread_t tid;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  /* Cached timestamp string of the second {ts_sec} */
+  time_t ts_sec;
+  char ts[32];
+  size_t ts_len;
+  /* Buffer to build the line in */
+  char line[LOGBUF_SIZE + 64];
+} lring = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
 };
 
 /* Static Functions Declaractions ************************************* */
@@ -56,41 +100,48 @@ static logcfg_t lcfg = {
 /**
  * @brief get_now_str - fill the @param{str} with time as [Time]
  *
+ * The string is cached and only rebuilt when the second changes
+ *
+ * @param t - the time to format
  * @param str - buffer to be filled
  * @param input_len - length of the buffer
  * @param len - real filled length
  *
  * @return @ref{err_t}
  */
-static err_t fill_time(char *str,
+static err_t fill_time(time_t t,
+                       char *str,
                        size_t input_len,
                        size_t *len)
 {
-  time_t t;
-  struct tm *tm;
+  struct tm tm;
   size_t r;
 
   if (!str || !len || !input_len) {
     return err(ec_param_null);
   }
 
-  time(&t);
-  tm = localtime(&t);
-
-  str[0] = '[';
-  r = strftime(str + 1,
-               input_len - 1,
-               "%F %X",
-               tm);
-  if (r == 0 || r + 2 > input_len) {
-    return err(ec_length_leak);
+  if (t != lring.ts_sec || !lring.ts_len) {
+    localtime_r(&t, &tm);
+    lring.ts[0] = '[';
+    r = strftime(lring.ts + 1,
+                 sizeof(lring.ts) - 2,
+                 "%F %X",
+                 &tm);
+    if (r == 0) {
+      return err(ec_length_leak);
+    }
+    lring.ts[r + 1] = ']';
+    lring.ts[r + 2] = '\0';
+    lring.ts_len = r + 2;
+    lring.ts_sec = t;
   }
-  str[r + 1] = ']';
   /* The fact -  "%F %X" always takes 21 bytes length */
-  if (input_len > r + 2) {
-    str[r + 2] = '\0';
+  if (lring.ts_len + 1 > input_len) {
+    return err(ec_length_leak);
   }
-  *len = r + 2;
+  memcpy(str, lring.ts, lring.ts_len + 1);
+  *len = lring.ts_len;
 
   return ec_success;
 }
@@ -102,8 +153,8 @@ static err_t fill_file_line(const char *file_name,
                             size_t offset,
                             size_t *len)
 {
-  char *p, *n, *posend;
-  char tmp[FILE_NAME_LENGTH] = { 0 };
+  char *p;
+  size_t n;
   if (!file_name || !str || !len || !input_len) {
     return err(ec_param_null);
   }
@@ -114,20 +165,12 @@ static err_t fill_file_line(const char *file_name,
 
   p[0] = '[';
 
-  n = strrchr(file_name, '/');
-  if (!n) {
-    n = strrchr(file_name, '\\');
-  }
-  n = (n ? n + 1 : (char *)file_name);
-  posend = strchr(n, '.');
-
-  memcpy(tmp,
-         n,
-         MIN(FILE_NAME_LENGTH, posend - n));
+  /* {file_name} is __FILENAME__, keep the tail which tells the file best */
+  n = strlen(file_name);
   snprintf(p + 1,
            input_len - offset - 1,
            "%10.10s:%-5d",
-           tmp,
+           file_name + n - MIN(n, FILE_NAME_LENGTH),
            line);
   p[FILE_LINE_LENGTH - 1] = ']';
   if (offset + FILE_LINE_LENGTH < input_len) {
@@ -192,52 +235,255 @@ static err_t fill_lvl(int lvl,
   return ec_success;
 }
 
-err_t __log(const char *file_name,
-            unsigned int line,
-            int lvl,
-            const char *fmt,
-            ...)
+/*
+ * Build the whole line of the record in {out}
+ */
+static size_t __format(const logrec_t *r, char *out, size_t outlen)
 {
-  err_t e;
-  va_list valist;
+  size_t len = 0;
 
-  if (lvl > (int)lcfg.level) {
-    return ec_success;
+  if (r->lvl == LVL_RAW) {
+    len = strlen(r->msg);
+    memcpy(out, r->msg, len + 1);
+    return len;
   }
-  lcfg.buf = calloc(1, LOGBUF_SIZE);
+  if (ec_success != fill_time(r->t, out, outlen, &len)
+      || ec_success != fill_file_line(r->file, r->line, out, outlen,
+                                      len, &len)
+      || ec_success != fill_lvl(r->lvl, out, outlen, len, &len)) {
+    return 0;
+  }
+  len += snprintf(out + len, outlen - len, "%s", r->msg);
+  return MIN(len, outlen - 1);
+}
 
-  ECG(ec_success,
-      fill_time(lcfg.buf, LOGBUF_SIZE, &lcfg.log_len),
-      out);
-  ECG(ec_success,
-      fill_file_line(file_name, line, lcfg.buf, LOGBUF_SIZE,
-                     lcfg.log_len, &lcfg.log_len),
-      out);
-  ECG(ec_success,
-      fill_lvl(lvl, lcfg.buf, LOGBUF_SIZE,
-               lcfg.log_len, &lcfg.log_len),
-      out);
+static void __output(const logrec_t *r)
+{
+  size_t len = __format(r, lring.line, sizeof(lring.line));
 
-  va_start(valist, fmt);
-  vsnprintf(lcfg.buf + lcfg.log_len,
-            LOGBUF_SIZE - lcfg.log_len,
-            fmt,
-            valist);
+  if (!len) {
+    return;
+  }
   if (lcfg.fp) {
-    fprintf(lcfg.fp, "%s", lcfg.buf);
-    fflush(lcfg.fp);
+    fwrite(lring.line, len, 1, lcfg.fp);
   }
   if (lcfg.tostdout) {
-    printf("%s", lcfg.buf);
+    fwrite(lring.line, len, 1, stdout);
+  }
+}
+
+/*
+ * Bounded multi-producer queue, the sequence of each slot tells whether it's
+ * free for the producer at {head} (seq == head) or ready for the consumer at
+ * {tail} (seq == tail + 1)
+ */
+static logrec_t *__ring_claim(void)
+{
+  size_t pos, seq;
+  logrec_t *r;
+
+  pos = __atomic_load_n(&lring.head, __ATOMIC_RELAXED);
+  for (;;) {
+    r = &lring.slots[pos & LOG_RING_MASK];
+    seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos) {
+      if (__atomic_compare_exchange_n(&lring.head, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return r;
+      }
+    } else if ((intptr_t)(seq - pos) < 0) {
+      /* Full */
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&lring.head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/*
+ * Producers only take the lock when the writer is (going to be) sleeping. The
+ * writer sets {sleeping} before checking the ring again and producers check
+ * {sleeping} after publishing the record, so at least one of them sees the
+ * other and no wakeup is lost.
+ */
+static void __writer_wake(void)
+{
+  if (!__atomic_load_n(&lring.sleeping, __ATOMIC_SEQ_CST)) {
+    return;
+  }
+  pthread_mutex_lock(&lring.mutex);
+  pthread_cond_signal(&lring.cond);
+  pthread_mutex_unlock(&lring.mutex);
+}
+
+static void __ring_commit(logrec_t *r)
+{
+  size_t pos = r->seq;
+  __atomic_store_n(&r->seq, pos + 1, __ATOMIC_SEQ_CST);
+  __writer_wake();
+}
+
+static bool __ring_ready(void)
+{
+  const logrec_t *r = &lring.slots[lring.tail & LOG_RING_MASK];
+  return __atomic_load_n(&r->seq, __ATOMIC_SEQ_CST) == lring.tail + 1;
+}
+
+/*
+ * Only called by the writer thread, or after it's stopped
+ */
+static int __ring_drain(void)
+{
+  logrec_t *r;
+  int n = 0;
+  unsigned int dropped;
+
+  while (__ring_ready()) {
+    r = &lring.slots[lring.tail & LOG_RING_MASK];
+    __output(r);
+    __atomic_store_n(&r->seq, lring.tail + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+    lring.tail++;
+    n++;
+  }
+  dropped = __atomic_exchange_n(&lring.dropped, 0, __ATOMIC_RELAXED);
+  if (dropped) {
+    logrec_t w = { 0 };
+    w.t = time(NULL);
+    w.file = __FILENAME__;
+    w.line = __LINE__;
+    w.lvl = LVL_WRN;
+    snprintf(w.msg, LOGBUF_SIZE, "%u log(s) dropped, ring full\n", dropped);
+    __output(&w);
+    n++;
+  }
+  if (n) {
+    if (lcfg.fp) {
+      fflush(lcfg.fp);
+    }
+    if (lcfg.tostdout) {
+      fflush(stdout);
+    }
+  }
+  return n;
+}
+
+static void *__writer(void *p)
+{
+  while (__atomic_load_n(&lring.running, __ATOMIC_ACQUIRE)) {
+    if (__ring_drain()) {
+      continue;
+    }
+    pthread_mutex_lock(&lring.mutex);
+    __atomic_store_n(&lring.sleeping, true, __ATOMIC_SEQ_CST);
+    if (!__ring_ready()
+        && __atomic_load_n(&lring.running, __ATOMIC_SEQ_CST)) {
+      pthread_cond_wait(&lring.cond, &lring.mutex);
+    }
+    __atomic_store_n(&lring.sleeping, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lring.mutex);
+  }
+  __ring_drain();
+  return NULL;
+}
+
+static void __writer_stop(void)
+{
+  if (!__atomic_load_n(&lring.running, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  pthread_mutex_lock(&lring.mutex);
+  __atomic_store_n(&lring.running, false, __ATOMIC_SEQ_CST);
+  pthread_cond_signal(&lring.cond);
+  pthread_mutex_unlock(&lring.mutex);
+  pthread_join(lring.tid, NULL);
+}
+
+static err_t __writer_start(void)
+{
+  for (size_t i = 0; i < LOG_RING_SLOTS; i++) {
+    lring.slots[i].seq = i;
+  }
+  lring.head = 0;
+  lring.tail = 0;
+  lring.dropped = 0;
+  lring.sleeping = false;
+  __atomic_store_n(&lring.running, true, __ATOMIC_RELEASE);
+  if (0 != pthread_create(&lring.tid, NULL, __writer, NULL)) {
+    __atomic_store_n(&lring.running, false, __ATOMIC_RELEASE);
+    return err(ec_errno);
+  }
+  return ec_success;
+}
+
+static void __log_enqueue(const char *file_name,
+                          unsigned int line,
+                          int lvl,
+                          const char *fmt,
+                          va_list valist)
+{
+  logrec_t *r, direct;
+
+  if (lvl == LVL_AST || !__atomic_load_n(&lring.running, __ATOMIC_ACQUIRE)) {
+    /* Assert aborts right after, and no writer before init, write directly */
+    r = &direct;
+  } else {
+    /* Errors, warnings and messages wait for a free slot, the chatty debug
+     * and verbose ones are dropped when the writer falls behind */
+    while (NULL == (r = __ring_claim())) {
+      if (lvl > LVL_MSG) {
+        __atomic_fetch_add(&lring.dropped, 1, __ATOMIC_RELAXED);
+        return;
+      }
+      __writer_wake();
+      sched_yield();
+    }
+  }
+  r->t = time(NULL);
+  r->file = file_name;
+  r->line = line;
+  r->lvl = lvl;
+  vsnprintf(r->msg, LOGBUF_SIZE, fmt, valist);
+
+  if (r != &direct) {
+    __ring_commit(r);
+    return;
+  }
+  if (lvl == LVL_AST) {
+    __writer_stop();
+  }
+  __output(r);
+  if (lcfg.fp) {
     fflush(lcfg.fp);
   }
+  if (lcfg.tostdout) {
+    fflush(stdout);
+  }
+}
+
+static void __log_raw(const char *fmt, ...)
+{
+  va_list valist;
+
+  va_start(valist, fmt);
+  __log_enqueue(NULL, 0, LVL_RAW, fmt, valist);
+  va_end(valist);
+}
 
-  out:
-  if (lcfg.buf) {
-    free(lcfg.buf);
-    lcfg.buf = NULL;
+err_t __log(const char *file_name,
+            unsigned int line,
+            int lvl,
+            const char *fmt,
+            ...)
+{
+  va_list valist;
+
+  if (lvl > (int)lcfg.level) {
+    return ec_success;
   }
-  return e;
+  va_start(valist, fmt);
+  __log_enqueue(file_name, line, lvl, fmt, valist);
+  va_end(valist);
+  return ec_success;
 }
 
 void logging_demo(void)
@@ -260,12 +506,7 @@ void logging_demo(void)
 
 void log_n(void)
 {
-  if (lcfg.fp) {
-    fprintf(lcfg.fp, "\n");
-  }
-  if (lcfg.tostdout) {
-    printf("\n");
-  }
+  __log_raw("\n");
 }
 
 static void log_welcome(void)
@@ -287,6 +528,8 @@ static void log_welcome(void)
   }
 }
 
+static bool atexit_registered = false;
+
 err_t logging_init(const char *path,
                    bool tostdout,
                    unsigned int lvl_threshold)
@@ -306,16 +549,25 @@ err_t logging_init(const char *path,
     fprintf(stderr, "Cannot open %s\n", path);
     return err(ec_file_ope);
   }
-  setlinebuf(lcfg.fp);
   lcfg.tostdout = tostdout;
   lcfg.level = lvl_threshold;
 
   log_welcome();
+  if (ec_success != __writer_start()) {
+    /* Not fatal, log synchronously */
+    fprintf(stderr, "Cannot start the log writer, error[%u]\n", errno);
+    setlinebuf(lcfg.fp);
+  } else if (!atexit_registered) {
+    /* Don't lose the queued logs on exit() */
+    atexit(__writer_stop);
+    atexit_registered = true;
+  }
   return ec_success;
 }
 
 void logging_deinit(void)
 {
+  __writer_stop();
   if (lcfg.fp) {
     fclose(lcfg.fp);
   }
@@ -42,4 +42,11 @@ static const char *source_files[] = {
     "uart_posix", /* 41 */
     "platform", /* 42 */
     "read_char", /* 43 */
+    "evloop", /* 44 */
+    "dcd_cache", /* 45 */
+    "json_journal", /* 46 */
+    "bg_trace", /* 47 */
+    "acc_plan", /* 48 */
+    "backoff", /* 49 */
+    "breaker", /* 50 */
 };
\ No newline at end of file
@@ -48,7 +48,6 @@ enum {
 #define ARG_KEY_SOCK_ENC "Socket Encription"
 
 /* Global Variables *************************************************** */
-pthread_mutex_t qlock = PTHREAD_MUTEX_INITIALIZER;
 jmp_buf initjmpbuf;
 
 /* Static Variables *************************************************** */
@@ -171,7 +170,11 @@ static void print_usage(const char *name)
                   "       -b baud_rate                        Valid in Insecure Mode\n"
                   "       -s server_domain_socket_path        Valid in Secure Mode\n"
                   "       -c client_domain_socket_path        Valid in Secure Mode\n"
-                  "       -e is_domain_socket_encrypted[1/0]  Valid in Secure Mode\n",
+                  "       -e is_domain_socket_encrypted[1/0]  Valid in Secure Mode\n"
+                  "       -r record_file                      Record the BGAPI traffic\n"
+                  "       -R record_file                      Replay the recorded BGAPI traffic instead of\n"
+                  "                                           connecting to the NCP target\n"
+                  "       -t                                  Replay with the recorded timing\n",
           name);
   exit(EXIT_FAILURE);
 }
@@ -184,7 +187,7 @@ const proj_args_t *getprojargs(void)
 static void store_args(lbitmap_t *dirty, int argc, char *argv[])
 {
   int c;
-  while (-1 != (c = getopt(argc, argv, "m:p:b:s:c:e:f:"))) {
+  while (-1 != (c = getopt(argc, argv, "m:p:b:s:c:e:f:r:R:t"))) {
     switch (c) {
       case 'm':
         BIT_SET(*dirty, ARG_DIRTY_ENC);
@@ -218,6 +221,15 @@ static void store_args(lbitmap_t *dirty, int argc, char *argv[])
         BIT_SET(*dirty, ARG_DIRTY_SOCK_ENC);
         projargs.sock.enc = (bool)atoi(optarg);
         break;
+      case 'r':
+        strcpy(projargs.capture, optarg);
+        break;
+      case 'R':
+        strcpy(projargs.replay, optarg);
+        break;
+      case 't':
+        projargs.realtime = true;
+        break;
       default:
         printf("Argument Not Realized\n");
         print_usage(argv[0]);
@@ -349,9 +361,10 @@ static void setprojargs(int argc, char *argv[])
     }
   }
 
-  /* Sanity check */
-  if ((projargs.enc && (!projargs.sock.srv[0] || !projargs.sock.clt[0]))
-      || (!projargs.enc && (!projargs.serial.port[0] || !projargs.serial.br))) {
+  /* Sanity check, nothing to connect to when replaying */
+  if (!projargs.replay[0]
+      && ((projargs.enc && (!projargs.sock.srv[0] || !projargs.sock.clt[0]))
+          || (!projargs.enc && (!projargs.serial.port[0] || !projargs.serial.br)))) {
     printf("**Arguments ERROR** - check the arguments and the .config file\n");
     print_usage(argv[0]);
     exit(1);
@@ -405,6 +418,11 @@ static void setprojargs(int argc, char *argv[])
   if (r) {
     *r = '\0';
   }
+  if (projargs.replay[0]) {
+    /* Replaying bypasses both the UART and the socket */
+    projargs.enc = false;
+    projargs.capture[0] = '\0';
+  }
 
   projargs.initialized = true;
 }